@@ -3,77 +3,231 @@
  Name        : SN74HC164N.c
  Author      :
  Version     :
- Description : Support for the SN74HC164N shift register
+ Description : Support for the SN74HC164N shift register. A value is
+             : only shifted in when it changes, or every refresh_interval
+             : steps if set; the 8 new bits overwrite the whole register,
+             : so no clear cycle is needed between values.
  ==============================================
  */
 
 #include <string.h>
 
+// Set to 1 to shift through an SSP port instead of bit-banging GPIO
+#ifndef SN74HC164N_SSP_ENABLED
+#define SN74HC164N_SSP_ENABLED 0
+#endif
+
+#define SN74HC164N_SSP_TNF (1 << 1)  // SSP status: transmit FIFO not full
+
+/*
+ * Set to 1 to bit-bang fixed pins chosen at compile time. Every substep
+ * is then a single store of a constant mask to the port's FIOSET or
+ * FIOCLR, and the register pointers and masks in the state are unused.
+ */
+#ifndef SN74HC164N_FIXED_ENABLED
+#define SN74HC164N_FIXED_ENABLED 0
+#endif
+
+#ifndef SN74HC164N_FIXED_GPIO
+#define SN74HC164N_FIXED_GPIO    LPC_GPIO0
+#endif
+#ifndef SN74HC164N_FIXED_CLOCK
+#define SN74HC164N_FIXED_CLOCK   9
+#endif
+#ifndef SN74HC164N_FIXED_A
+#define SN74HC164N_FIXED_A       7
+#endif
+#ifndef SN74HC164N_FIXED_REFRESH
+#define SN74HC164N_FIXED_REFRESH 25000 // Default refresh_interval, 0 for never
+#endif
+
+#if SN74HC164N_FIXED_ENABLED && SN74HC164N_SSP_ENABLED
+#error "SN74HC164N_FIXED_ENABLED bit-bangs and cannot use the SSP port"
+#endif
+
 typedef struct {
-    int step;
+    int step;                           // Substep of the shift, 0 when idle
     int bits;
-    int holdtime;
+    int refresh_interval;   // Steps before re-shifting an unchanged value,
+                            // 0 to shift on changes only
     volatile uint32_t  *reg_clock;
     volatile uint32_t  *reg_clear;
     volatile uint32_t  *reg_a;
     int mask_clock;
     int mask_clear;
     int mask_a;
+    volatile uint32_t  *reg_ssp_data;   // SSP DR, or NULL to bit-bang
+    volatile uint32_t  *reg_ssp_status; // SSP SR
+    int sent;                           // Value in the register, -1 if unknown
+    int shift_bits;                     // Value being bit-banged
+    int idle_ticks;                     // Steps since the last shift ended
+    uint32_t busy_ticks;                // Ticks spent driving the pins
+    uint32_t num_updates;               // Values shifted in
 } SN74HC164N_state;
 
 void SN74HC164N_init(SN74HC164N_state *state){
     memset(state, 0, sizeof(SN74HC164N_state));
     state->step = 0;
     state->bits = 2;
-    state->holdtime = 1000;
+#if SN74HC164N_FIXED_ENABLED
+    state->refresh_interval = SN74HC164N_FIXED_REFRESH;
+#else
+    state->refresh_interval = 0;
+#endif
+    state->sent = -1;
+}
+
+/*
+ * Sends bits through the SSP port if they changed since the last update.
+ * The port must be an 8-bit SPI master with CPOL = CPHA = 0: it shifts
+ * the most significant bit first on rising clock edges, the same order
+ * SN74HC164N_step uses, and all 8 bits overwrite the register so no
+ * clear is needed. Takes about a microsecond on the wire and returns at
+ * once. Returns 1 if a byte was sent.
+ */
+int SN74HC164N_update(SN74HC164N_state *state){
+    int bits = state->bits & 0xFF;
+
+    if (bits == state->sent) return 0;
+    if (!(*state->reg_ssp_status & SN74HC164N_SSP_TNF)) return 0;
+    *state->reg_ssp_data = bits;
+    state->sent = bits;
+    state->idle_ticks = 0;
+    state->num_updates++;
+    return 1;
+}
+
+// Pulses the asynchronous clear input
+void SN74HC164N_clear(SN74HC164N_state *state){
+    *state->reg_clear &= ~state->mask_clear;
+    *state->reg_clear |= state->mask_clear;
+    state->sent = 0;
 }
 
+#if SN74HC164N_FIXED_ENABLED
+#define SN74HC164N_CLOCK_LOW  0x100
+#define SN74HC164N_CLOCK_HIGH 0x200
+
+// Substeps of one bit; the data substep holds the mask of the bit to send
+#define SN74HC164N_SCHEDULE_BIT(i) \
+    SN74HC164N_CLOCK_LOW, 1 << (i), SN74HC164N_CLOCK_HIGH, 0
+
+// All 32 substeps of a shift, most significant bit first
+static const uint16_t SN74HC164N_schedule[32] = {
+    SN74HC164N_SCHEDULE_BIT(7), SN74HC164N_SCHEDULE_BIT(6),
+    SN74HC164N_SCHEDULE_BIT(5), SN74HC164N_SCHEDULE_BIT(4),
+    SN74HC164N_SCHEDULE_BIT(3), SN74HC164N_SCHEDULE_BIT(2),
+    SN74HC164N_SCHEDULE_BIT(1), SN74HC164N_SCHEDULE_BIT(0),
+};
+
+// The four substeps of a single bit, sent as bit 0
+static const uint16_t SN74HC164N_bit_schedule[4] = {
+    SN74HC164N_SCHEDULE_BIT(0),
+};
+
+// Runs a schedule entry for bits with one store to a fixed address
+static inline void SN74HC164N_fixed_substep(int op, int bits){
+    if (op & SN74HC164N_CLOCK_LOW){
+        SN74HC164N_FIXED_GPIO->FIOCLR = 1 << SN74HC164N_FIXED_CLOCK;
+    } else if (op & SN74HC164N_CLOCK_HIGH){
+        SN74HC164N_FIXED_GPIO->FIOSET = 1 << SN74HC164N_FIXED_CLOCK;
+    } else if (op & bits){
+        SN74HC164N_FIXED_GPIO->FIOSET = 1 << SN74HC164N_FIXED_A;
+    } else if (op){
+        SN74HC164N_FIXED_GPIO->FIOCLR = 1 << SN74HC164N_FIXED_A;
+    }
+}
+
+/*
+ * SN74HC164N_step for the fixed pins: the same 32 tick shift, with the
+ * substep looked up in SN74HC164N_schedule instead of computed.
+ */
+void SN74HC164N_fixed_step(SN74HC164N_state *state){
+    int step = state->step;
+
+    if (step == 0){
+        int refresh = state->refresh_interval &&
+            ++state->idle_ticks >= state->refresh_interval;
+        if ((state->bits & 0xFF) == state->sent && !refresh) return;
+        state->shift_bits = state->bits & 0xFF;
+        state->idle_ticks = 0;
+    }
+
+    SN74HC164N_fixed_substep(SN74HC164N_schedule[step], state->shift_bits);
+    state->busy_ticks++;
+
+    if (++step == 32){
+        step = 0;
+        state->sent = state->shift_bits;
+        state->num_updates++;
+    }
+    state->step = step;
+}
+#endif
+
+/*
+ * Bit-bangs one quarter of a bit: clock low, data, clock high (the
+ * register shifts on this edge), then a spare step.
+ */
+void SN74HC164N_substep(SN74HC164N_state *state, int substep, int bit){
+#if SN74HC164N_FIXED_ENABLED
+    (void) state;
+    SN74HC164N_fixed_substep(SN74HC164N_bit_schedule[substep & 3], bit & 1);
+#else
+    switch(substep){
+        case 0:
+            *state->reg_clock &= ~state->mask_clock;
+            break;
+        case 1:
+            if (bit){
+                *state->reg_a |= state->mask_a;
+            } else {
+                *state->reg_a &= ~state->mask_a;
+            }
+            break;
+        case 2:
+            *state->reg_clock |= state->mask_clock;
+            break;
+        default:
+            break;
+    }
+#endif
+}
+
+/*
+ * Drives the register, one substep per timer tick. While idle this only
+ * checks whether bits changed or a refresh is due; a shift then takes 32
+ * ticks, and a value changed part way through is picked up afterwards.
+ */
 void SN74HC164N_step(SN74HC164N_state *state){
-    if (state->step <= 31){
-        int substep = (state->step) % 4;
-        int s, mask;
-        switch(substep){
-            case 0:
-                *state->reg_clock &= ~state->mask_clock;
-                break;
-            case 1:
-                s = 7-(state->step / 4);
-                mask = 1 << s;
-                if ((state->bits) & mask){
-                    *state->reg_a |= state->mask_a;
-                } else {
-                    *state->reg_a &= ~state->mask_a;
-                }
-                break;
-            case 2:
-                *state->reg_clock |= state->mask_clock;
-                break;
-            default:
-                break;
+#if SN74HC164N_FIXED_ENABLED
+    SN74HC164N_fixed_step(state);
+#else
+    if (state->reg_ssp_data){
+        if (state->refresh_interval &&
+                ++state->idle_ticks >= state->refresh_interval){
+            state->sent = -1;   // Resend the unchanged value
         }
+        SN74HC164N_update(state);
+        return;
     }
-    
-    if (state->step >= state->holdtime){
-        int clearstep = state->step - state->holdtime;
-        switch(clearstep){
-            case 1:
-                *state->reg_clock &= ~state->mask_clock;
-                break;
-            case 2:
-                *state->reg_clear &= ~state->mask_clear;
-                break;
-            case 3:
-                *state->reg_clock |= state->mask_clock;
-                break;
-            case 4:
-                *state->reg_clear |= state->mask_clear;
-                break;
-            default:
-                break;
-        }
-        if (clearstep > 5){
-            state->step = -1;
-        }
+
+    if (state->step == 0){
+        int refresh = state->refresh_interval &&
+            ++state->idle_ticks >= state->refresh_interval;
+        if ((state->bits & 0xFF) == state->sent && !refresh) return;
+        state->shift_bits = state->bits & 0xFF;
+        state->idle_ticks = 0;
+    }
+
+    int s = 7-(state->step / 4);
+    SN74HC164N_substep(state, state->step % 4, (state->shift_bits >> s) & 1);
+    state->busy_ticks++;
+
+    if (++state->step == 32){
+        state->step = 0;
+        state->sent = state->shift_bits;
+        state->num_updates++;
     }
-    state->step++;
+#endif
 }
@@ -12,61 +12,319 @@
 #include "LPC17xx.h"
 #endif
 
+#include <cr_section_macros.h>
 #include <stdio.h>
+#include <string.h>
+
+// Set to 1 to log every payload bit as it is sent; printed from the
+// main loop
+#ifndef TRANSMIT_TRACE
+#define TRANSMIT_TRACE 0
+#endif
+
+#include "tracelog.c" // Deferred Trace Log
+#include "clock_util.c" // Clock Utility
+#include "clock_presets.h" // Clock Settings, generated by clock_planner.c
+#include "peripheral_clock.c" // Peripheral Clock and Timer Planner
+#include "clock_measure.c" // cclk Measurement Against the RTC
+#include "pwm_carrier.c" // PWM Carrier Modulation
+#include "jitter.c"   // Transmit Timing Measurement
+#include "compress.c" // Payload Compression
+#include "fec.c"      // Forward Error Correction
+#include "linecode.c" // 4B5B Line Coding
+#include "pam4.c"     // PAM-4 Symbol Mapping
+#include "transmit.c" // Frame Transmitter
+#include "transmit_ssp.c" // SSP Transmit Backend
+#include "transmit_dma.c" // GPDMA Transmit Backend
+#include "transmit_parallel.c" // 8-Lane Parallel Transmitter
+#include "arq.c"      // Selective-Repeat ARQ
+#include "rate.c"     // Bit Rate Adaptation
+#include "receive.c"  // Receive Utility, for acks on the return path
+
+// Set to 1 to shift frames out of MOSI1 (P0[9], the LED pin) at
+// SSP_BIT_RATE instead of one TIMER0 interrupt per bit
+#ifndef TRANSMIT_SSP_ENABLED
+#define TRANSMIT_SSP_ENABLED 0
+#endif
+#define SSP_BIT_RATE 1000000
+
+#if TRANSMIT_SSP_ENABLED && RATE_ADAPT_ENABLED
+#error "SSP transmit runs at the fixed SSP_BIT_RATE, disable RATE_ADAPT_ENABLED"
+#endif
+
+#if TRANSMIT_SSP_ENABLED && PAM4_ENABLED
+#error "SSP transmit sends on/off bits only, disable PAM4_ENABLED"
+#endif
+
+// Bit period without rate adaptation. TIMER0, and TIMER1 for DMA, are
+// planned from the applied clock to keep it whatever the cclk.
+#define BIT_PERIOD_US 48000
+
+// Set to 1 to have GPDMA write the LED pin through FIO0SET/FIO0CLR once
+// per TIMER1 match, every BIT_PERIOD_US
+#ifndef TRANSMIT_DMA_ENABLED
+#define TRANSMIT_DMA_ENABLED 0
+#endif
+
+#if TRANSMIT_DMA_ENABLED && (TRANSMIT_SSP_ENABLED || RATE_ADAPT_ENABLED)
+#error "DMA transmit excludes SSP transmit and rate adaptation"
+#endif
+
+#if TRANSMIT_DMA_ENABLED && PAM4_ENABLED
+#error "DMA transmit sends on/off bits only, disable PAM4_ENABLED"
+#endif
+
+// Set to 1 to send one message per LED on the P2[0..7] byte lane
+#ifndef TRANSMIT_PARALLEL_ENABLED
+#define TRANSMIT_PARALLEL_ENABLED 0
+#endif
+
+#if TRANSMIT_PARALLEL_ENABLED && \
+	(ARQ_ENABLED || TRANSMIT_SSP_ENABLED || TRANSMIT_DMA_ENABLED)
+#error "Parallel transmit excludes ARQ and the SSP and DMA backends"
+#endif
+
+#if TRANSMIT_PARALLEL_ENABLED && PAM4_ENABLED
+#error "Parallel transmit sends on/off bits only, disable PAM4_ENABLED"
+#endif
+
+// Applied at startup from its CLOCK_PRESET in clock_presets.h. The bit
+// timer and, with PWM_CARRIER_ENABLED, the carrier on PWM1.1 (P2[0]) in
+// place of the LED are computed for it.
+#define CPU_FREQUENCY 100000000
+
+#if PWM_CARRIER_ENABLED && (PAM4_ENABLED || TRANSMIT_SSP_ENABLED || \
+	TRANSMIT_DMA_ENABLED || TRANSMIT_PARALLEL_ENABLED)
+#error "PWM carrier excludes PAM-4 and the SSP, DMA and parallel backends"
+#endif
+
+// Set to 1 to time every LED edge with TIMER2: jumper the LED pin to
+// CAP2.0 on P0[4]
+#ifndef JITTER_MEASURE_ENABLED
+#define JITTER_MEASURE_ENABLED 0
+#endif
+#define JITTER_REPORT_EDGES 1000
+#define JITTER_BIN_US 1         // Histogram bin width
+
+#if JITTER_MEASURE_ENABLED && (TRANSMIT_SSP_ENABLED || TRANSMIT_DMA_ENABLED || \
+	PWM_CARRIER_ENABLED)
+#error "Jitter measurement times the TIMER0-driven transmitters only"
+#endif
+
+// With ARQ, TIMER0 ticks this many times per bit so the ack receiver
+// can oversample the return path
+#if ARQ_ENABLED
+#define TICKS_PER_BIT 10
+#else
+#define TICKS_PER_BIT 1
+#endif
+
+// Resend a frame if no ack arrives within this many ticks
+#define ARQ_TIMEOUT_TICKS (TICKS_PER_BIT * 1200)
+
+// PAM-4 acks are burst-converted at no less than this rate, a 10 MHz ADC clock
+#define ADC_SAMPLE_RATE 153846
 
 const unsigned int INTERRUPT_PIN = (1<<8);
 const unsigned int LED_PIN = (1<<9);
+const unsigned int ACK_PIN = (1<<6);
 char *OUTPUT_STRING = "Hello world!";
-const unsigned int BITS_IN_MESSAGE = 96;
-int bitsSent = 0;
-int sending = 0;
+const char *LANE_STRINGS[TRANSMIT_LANES] = {
+	"Hello lane 0", "Hello lane 1", "Hello lane 2", "Hello lane 3",
+	"Hello lane 4", "Hello lane 5", "Hello lane 6", "Hello lane 7"
+};
+
+int systime = 0;
+transmit_state tstate;
+timer_plan bitTimer;      // TIMER0 planned for one tick of a bit
+uint32_t bitPeriod = 0;   // The bit period bitTimer was planned for, in us
+#if TRANSMIT_PARALLEL_ENABLED
+transmit_parallel_state pstate;
+#endif
+volatile int messageRequested = 0;
+
+#if ARQ_ENABLED
+arq_sender   arq;
+receive_state ackState;
+char arqFrame[ARQ_FRAME_LEN];
+rate_controller rate;
+int timeoutsSeen = 0;
+#if PAM4_ENABLED
+adc_plan ackAdc;          // Ack ADC clock, divider chosen before bring-up
+#endif
+#endif
+
+#if CLOCK_MEASURE_ENABLED
+clock_measure_state measure;
+int measurementsSeen = 0;
+#endif
+
+#if JITTER_MEASURE_ENABLED
+jitter_edge_queue jitterEdges;
+jitter_stats jitterStats;
+#endif
+
+#if TRANSMIT_DMA_ENABLED
+// The GPDMA cannot reach the local SRAM, so the waveform lives in AHB SRAM
+__BSS(RAM2) transmit_dma_state dmaState;
+timer_plan dmaTimer;      // TIMER1 planned for one bit
+#endif
+
+// TIMER0 ISR duration, printed every ISR_TIMING_REPORT interrupts
+#define ISR_TIMING_REPORT 10000
+trace_timing isrTiming;
+
+void TIMER0_IRQHandler() {
+    trace_timing_begin(&isrTiming);
+    LPC_TIM0->IR = 1;
+    systime++;
+#if TRANSMIT_PARALLEL_ENABLED
+    transmit_parallel_step(&pstate);
+#elif !TRANSMIT_SSP_ENABLED && !TRANSMIT_DMA_ENABLED
+    transmit_step(&tstate);
+#endif
+#if ARQ_ENABLED
+    receive_step(&ackState, systime);
+#endif
+    trace_timing_end(&isrTiming);
+    return;
+}
 
 /*
- * Sets the designated output pin to on or off.
- * Sets the output pin to high if bit >= 1, 0 if bit is 0.
+ * Prints the symbols logged by the ISR, and every ISR_TIMING_REPORT
+ * interrupts the ISR duration in cycles. Semihosted printf is slow, so
+ * the log drops records rather than stall the ISR if this falls behind.
  */
-void setBitToPin(int bit) {
-    if (bit) {
-   	 LPC_GPIO0->FIOPIN |= LED_PIN;
-    } else {
-   	 LPC_GPIO0->FIOPIN &= ~LED_PIN;
-    }
+void printTrace(void) {
+	trace_flush(&global_trace);
+	if (isrTiming.count >= ISR_TIMING_REPORT) {
+		NVIC_DisableIRQ(TIMER0_IRQn);
+		trace_timing stats = isrTiming;
+		trace_timing_init(&isrTiming);
+		NVIC_EnableIRQ(TIMER0_IRQn);
+		printf("\nisr cycles min %lu avg %lu max %lu, dropped %lu\n",
+			(unsigned long) stats.min, (unsigned long) (stats.total / stats.count),
+			(unsigned long) stats.max, (unsigned long) global_trace.num_dropped);
+	}
 }
 
-void sendBit(char message[], int position) {
-	int index = position/8;
-	int bitNum = (position%8);
-    int bit = message[index] & (1<<bitNum);
-	setBitToPin(bit);
-	printf("%d %d %d %d, ", position, index, bit, bitNum);
+#if TRANSMIT_SSP_ENABLED
+void SSP1_IRQHandler() {
+	// Stop the FIFO interrupt once the queue has been drained into it
+	if (!transmit_ssp_fill(&tstate, LPC_SSP1))
+		LPC_SSP1->IMSC = 0;
 }
+#endif
 
-void TIMER0_IRQHandler() {
-    LPC_TIM0->IR = 1;
-    if (sending == 2) {
-    	if (bitsSent < BITS_IN_MESSAGE)
-    		sendBit(OUTPUT_STRING,bitsSent);
-    	else
-    		setBitToPin(0);
-    }
-    else if (sending == 1) {
-   	 setBitToPin(bitsSent%8 >= 4);
-   	 if (bitsSent >= 7) {
-   		 sending = 2;
-   		 bitsSent = -1;
-   	 }
-    }
-    else if (sending == 0) {
-   	 setBitToPin(!(bitsSent%2));
-   	 if (bitsSent >= 7) {
-   		 sending = 1;
-   		 bitsSent = -1;
-   	 }
-    }
+#if TRANSMIT_DMA_ENABLED
+void DMA_IRQHandler() {
+	// Channel 1 (clear words) finished a block; render it again
+	if (LPC_GPDMA->DMACIntTCStat & (1 << 1)) {
+		LPC_GPDMA->DMACIntTCClear = 1 << 1;
+		transmit_dma_refill(&dmaState, &tstate);
+	}
+}
+#endif
 
-    bitsSent++;
-    return;
+/*
+ * Plans TIMER0 for bits of period_us from the applied clock, keeping the
+ * divider chosen at startup, and loads it, restarting the count.
+ */
+void setBitPeriod(uint32_t period_us) {
+	if (timer_plan_fixed(&global_settings, bitTimer.pclksel, period_us,
+			1000000 * TICKS_PER_BIT, &bitTimer) || CLOCK_REPORT_ENABLED)
+		printf("Bit period %lu us: %d ppm\n", (unsigned long) period_us,
+			bitTimer.error_ppm);
+	bitPeriod = period_us;
+	LPC_TIM0->TC = 0;
+	LPC_TIM0->PC = 0;
+	timer_plan_apply(LPC_TIM0, &bitTimer);
+}
+
+#if CLOCK_MEASURE_ENABLED
+void RTC_IRQHandler() {
+	clock_measure_second(&measure, CLOCK_DWT_CYCCNT);
+	LPC_RTC->ILR = 1;
+}
+
+/*
+ * Retunes TIMER0 to the cclk measured against the RTC. The SSP, DMA
+ * and carrier clocks keep the plans they were given at startup.
+ */
+void driveMeasure(void) {
+	// RTC_IRQHandler updates the measurement, so work from a copy
+	__disable_irq();
+	clock_measure_state seen = measure;
+	__enable_irq();
+
+	if (seen.num_measurements == measurementsSeen) return;
+	measurementsSeen = seen.num_measurements;
+
+	clock_settings corrected = global_settings;
+	int error = clock_measure_correct(&seen, &corrected);
+	if (error || CLOCK_REPORT_ENABLED)
+		printf("cclk %d Hz measured: %d ppm\n", seen.frequency,
+			seen.error_ppm);
+	if (error || corrected.frequency == global_settings.frequency) return;
+
+	global_settings = corrected;
+	timer_plan_fixed(&global_settings, bitTimer.pclksel, bitPeriod,
+		1000000 * TICKS_PER_BIT, &bitTimer);
+	__disable_irq();
+	timer_plan_retune(LPC_TIM0, &bitTimer);
+	clock_measure_restart(&measure, global_settings.frequency);
+	__enable_irq();
+}
+#endif
+
+/*
+ * Queues text for the transmitter. Returns -1 if it cannot be queued.
+ */
+int queueFrame(const char *text) {
+	if (transmit_queue(&tstate, text)) return -1;
+#if TRANSMIT_SSP_ENABLED
+	// Fires straight away while the FIFO has room
+	LPC_SSP1->IMSC = TRANSMIT_SSP_TXIM;
+#endif
+	return 0;
+}
+
+#if JITTER_MEASURE_ENABLED
+void TIMER2_IRQHandler() {
+	LPC_TIM2->IR = 1 << 4;    // CR0 interrupt
+	jitter_edge_push(&jitterEdges, LPC_TIM2->CR0);
+}
+
+/*
+ * Histogram bin width in TIMER2 ticks, which run at TIMER0's pclk.
+ */
+uint32_t jitterBinWidth(void) {
+	uint32_t width = bitTimer.pclk / 1000000 * JITTER_BIN_US;
+	return width ? width : 1;
+}
+
+/*
+ * Folds captured edges into the statistics and prints them every
+ * JITTER_REPORT_EDGES edges. TIMER2 counts every tick of TIMER0's pclk,
+ * so the ideal bit period is TIMER0's period, prescale included, times
+ * TICKS_PER_BIT.
+ */
+void measureJitter(void) {
+	uint32_t nominal = (bitTimer.match + 1) * (bitTimer.prescale + 1) *
+		TICKS_PER_BIT;
+
+	// Start over when the bit rate changes
+	if (nominal != jitterStats.nominal)
+		jitter_stats_init(&jitterStats, nominal, jitterBinWidth());
+
+	jitter_drain(&jitterEdges, &jitterStats);
+	if (jitterStats.num_edges >= JITTER_REPORT_EDGES) {
+		jitter_print(&jitterStats);
+		printf("dropped %lu\n", (unsigned long) jitterEdges.num_dropped);
+		jitter_stats_init(&jitterStats, nominal, jitterBinWidth());
+	}
 }
+#endif
 
 int checkPinInputRising(uint32_t pin) {
     return (pin & LPC_GPIOINT->IO0IntStatR);
@@ -75,25 +333,227 @@ int checkPinInputRising(uint32_t pin) {
 void EINT3_IRQHandler() {
     if (checkPinInputRising(INTERRUPT_PIN)) {
     	LPC_TIM0->TCR = 1;
-    	bitsSent = 0;
-    	sending = 0;
+    	messageRequested = 1;
     }
     LPC_GPIOINT->IO0IntClr |= INTERRUPT_PIN;
     return;
 }
 
+#if ARQ_ENABLED
+void initAckReceiver(void) {
+#if PAM4_ENABLED
+	receive_init(&ackState, (volatile uint32_t *) &LPC_ADC->ADDR0, 0);
+#else
+	receive_init(&ackState, &LPC_GPIO0->FIOPIN, ACK_PIN);
+#endif
+}
+
+/*
+ * Feeds the ARQ window from the main loop: queues requested messages,
+ * applies received acks, and queues the next due frame whenever the
+ * transmit queue has room. The ISR only steps the transmitter and
+ * receiver.
+ */
+void driveArq(void) {
+	if (messageRequested &&
+			arq_sender_queue(&arq, OUTPUT_STRING, strlen(OUTPUT_STRING)) >= 0) {
+		messageRequested = 0;
+	}
+
+	if (ackState.state == SIGNAL_COMPLETE) {
+		if (arq_sender_ack(&arq, ackState.bit_buffer) == 0 && RATE_ADAPT_ENABLED)
+			rate_controller_report(&rate, arq.last_report);
+		NVIC_DisableIRQ(TIMER0_IRQn);
+		initAckReceiver();
+		NVIC_EnableIRQ(TIMER0_IRQn);
+	}
+
+#if RATE_ADAPT_ENABLED
+	if (arq.num_timeouts != timeoutsSeen) {
+		timeoutsSeen = arq.num_timeouts;
+		rate_controller_timeout(&rate);
+	}
+
+	// Change rate only between frames, while no ack is arriving. Stop
+	// queueing frames until the change is made.
+	uint32_t period = rate_bit_period(&rate);
+	if (period != bitPeriod) {
+		if (!transmit_busy(&tstate) && ackState.state == SIGNAL_WAITING)
+			setBitPeriod(period);
+		return;
+	}
+#endif
+
+	if (!transmit_queue_full(&tstate) &&
+			arq_sender_next(&arq, systime, arqFrame) >= 0) {
+		queueFrame(arqFrame);
+	}
+}
+#endif
+
+/*
+ * Chooses every peripheral's PCLKSEL divider for the clock about to be
+ * applied. The dividers may only change while PLL0 is disconnected, so
+ * this runs before apply_clock_settings and every plan after it keeps
+ * them. TIMER0's divider serves every bit period the rate table holds,
+ * and TIMER2 shares it so edge times stay in TIMER0's units.
+ */
+void selectPeripheralClocks(const clock_settings *clock) {
+	timer_plan_period(clock, BIT_PERIOD_US, 1000000 * TICKS_PER_BIT,
+		&bitTimer);
+	pclk_select(PCLK_TIMER0, bitTimer.pclksel);
+#if JITTER_MEASURE_ENABLED
+	pclk_select(PCLK_TIMER2, bitTimer.pclksel);
+#endif
+#if PWM_CARRIER_ENABLED
+	pclk_select(PCLK_PWM1, pwm_carrier_pclksel(PWM_CARRIER_PCLK_DIV));
+#endif
+#if TRANSMIT_SSP_ENABLED
+	pclk_select(PCLK_SSP1, 1);
+#endif
+#if TRANSMIT_DMA_ENABLED
+	timer_plan_period_us(clock, BIT_PERIOD_US, &dmaTimer);
+	pclk_select(PCLK_TIMER1, dmaTimer.pclksel);
+#endif
+#if ARQ_ENABLED && PAM4_ENABLED
+	adc_plan_rate(clock, ADC_SAMPLE_RATE, &ackAdc);
+	pclk_select(PCLK_ADC, ackAdc.pclksel);
+#endif
+}
+
 int main(void) {
 	LPC_GPIO0->FIODIR |= LED_PIN;
 	LPC_GPIO0->FIODIR &= ~INTERRUPT_PIN;
 
+	// Settings worked out ahead of time by clock_planner.c
+	global_settings = (clock_settings) CLOCK_PRESET(CPU_FREQUENCY);
+	clock_settings *clock = &global_settings;
+	selectPeripheralClocks(clock);
+	if (apply_clock_settings(clock) || CLOCK_REPORT_ENABLED)
+		clock_bringup_print();
+
+#if PWM_CARRIER_ENABLED
+	if (pwm_carrier_calculate(clock, PWM_CARRIER_PCLK_DIV,
+			PWM_CARRIER_FREQUENCY, &global_pwm_carrier))
+		printf("Carrier %d Hz out of range\n", PWM_CARRIER_FREQUENCY);
+	pwm_carrier_init(&global_pwm_carrier);
+#endif
+
+#if PAM4_ENABLED
+	// Drive the LED from AOUT on P0[26] instead of LED_PIN
+	LPC_PINCON->PINSEL1 &= ~(3 << 20);
+	LPC_PINCON->PINSEL1 |=  (2 << 20);
+	transmit_init(&tstate, &LPC_DAC->DACR, 0, TICKS_PER_BIT);
+#else
+	transmit_init(&tstate, &LPC_GPIO0->FIOPIN, LED_PIN, TICKS_PER_BIT);
+#endif
+	transmit_set_bit(&tstate, 0);
+
+#if TRANSMIT_SSP_ENABLED
+	// SSP1 clocked from cclk, MOSI1 on P0[9] in place of the GPIO
+	ssp_plan sspPlan;
+	LPC_SC->PCONP |= 1 << 10;
+	if (ssp_plan_rate(clock, 1, SSP_BIT_RATE, &sspPlan))
+		printf("SSP bit rate %d out of range\n", SSP_BIT_RATE);
+	transmit_ssp_init(LPC_SSP1, &sspPlan);
+	LPC_PINCON->PINSEL0 &= ~(3 << 18);
+	LPC_PINCON->PINSEL0 |=  (2 << 18);
+	NVIC_EnableIRQ(SSP1_IRQn);
+#endif
+
+#if TRANSMIT_DMA_ENABLED
+	// TIMER1 MAT1.0 and MAT1.1 both match once per bit and request DMA
+	// channels 0 (set words) and 1 (clear words)
+	LPC_SC->PCONP |= (1 << 2) | (1 << 29);
+	LPC_SC->DMAREQSEL |= (1 << 2) | (1 << 3);
+	LPC_GPDMA->DMACConfig = 1;
+	transmit_dma_init(&dmaState, &tstate, &LPC_GPIO0->FIOSET, &LPC_GPIO0->FIOCLR);
+	transmit_dma_start(&dmaState, LPC_GPDMACH0, LPC_GPDMACH1, 10, 11);
+	NVIC_EnableIRQ(DMA_IRQn);
+	if (timer_plan_fixed(clock, dmaTimer.pclksel, BIT_PERIOD_US, 1000000,
+			&dmaTimer))
+		printf("DMA bit period %d us out of range\n", BIT_PERIOD_US);
+	timer_plan_apply(LPC_TIM1, &dmaTimer);
+	LPC_TIM1->MR1 = dmaTimer.match;
+	LPC_TIM1->MCR = 2;   			 /* Reset on MR0, no interrupt */
+	LPC_TIM1->TCR = 1;
+#endif
+#if TRANSMIT_PARALLEL_ENABLED
+	LPC_GPIO2->FIODIR0 = 0xFF;
+	LPC_GPIO2->FIOPIN0 = 0;
+	transmit_parallel_init(&pstate, &LPC_GPIO2->FIOPIN0, TICKS_PER_BIT);
+#endif
+	trace_init(&global_trace);
+	trace_timing_init(&isrTiming);
+
+#if ARQ_ENABLED
+#if PAM4_ENABLED
+	// Acks arrive as PAM-4 too: burst-convert AD0.0 on P0[23]
+	LPC_SC->PCONP |= 1 << 12;
+	LPC_PINCON->PINSEL1 &= ~(3 << 14);
+	LPC_PINCON->PINSEL1 |=  (1 << 14);
+	if (adc_plan_fixed(clock, ackAdc.pclksel, ADC_SAMPLE_RATE, &ackAdc))
+		printf("ADC rate %d out of range\n", ADC_SAMPLE_RATE);
+	LPC_ADC->ADCR = 1 | (ackAdc.clkdiv << 8) | (1 << 16) | (1 << 21);
+#endif
+	LPC_GPIO0->FIODIR &= ~ACK_PIN;
+	initAckReceiver();
+	arq_sender_init(&arq, ARQ_TIMEOUT_TICKS);
+	rate_controller_init(&rate);
+#endif
+
     LPC_GPIOINT->IO0IntEnR |= INTERRUPT_PIN; //Enable rising edge interrupt
     NVIC_EnableIRQ(EINT3_IRQn);
 
-    LPC_TIM0->MR0 = 1200000;
+#if RATE_ADAPT_ENABLED
+    setBitPeriod(rate_bit_period(&rate));
+#else
+    setBitPeriod(BIT_PERIOD_US);
+#endif
     LPC_TIM0->MCR = 3;   			 /* Interrupt and Reset on MR0 */
     NVIC_EnableIRQ(TIMER0_IRQn);
 
+#if JITTER_MEASURE_ENABLED
+    // Capture both edges on CAP2.0, P0[4]. The capture ISR runs below
+    // TIMER0 so it cannot delay the edges it is timing.
+    jitter_edge_queue_init(&jitterEdges);
+    jitter_stats_init(&jitterStats, (bitTimer.match + 1) *
+        (bitTimer.prescale + 1) * TICKS_PER_BIT, jitterBinWidth());
+    LPC_SC->PCONP |= 1 << 22;
+    LPC_PINCON->PINSEL0 |= 3 << 8;
+    LPC_TIM2->PR  = 0;
+    LPC_TIM2->CCR = 1 | 2 | 4;  		 /* Rising, falling, interrupt */
+    LPC_TIM2->TCR = 1;
+    NVIC_SetPriority(TIMER0_IRQn, 0);
+    NVIC_SetPriority(TIMER2_IRQn, 1);
+    NVIC_EnableIRQ(TIMER2_IRQn);
+#endif
+
+#if CLOCK_MEASURE_ENABLED
+	clock_measure_init(&measure, clock->frequency, CLOCK_MEASURE_SECONDS);
+	clock_measure_start();
+#endif
+
 	while(1) {
+#if ARQ_ENABLED
+		driveArq();
+#elif TRANSMIT_PARALLEL_ENABLED
+		// Each button press sends every lane its message once more
+		if (messageRequested &&
+				transmit_parallel_queue(&pstate, LANE_STRINGS, TRANSMIT_LANES) == 0)
+			messageRequested = 0;
+#else
+		// Each button press queues one more copy of the message
+		if (messageRequested && queueFrame(OUTPUT_STRING) == 0)
+			messageRequested = 0;
+#endif
+		printTrace();
+#if JITTER_MEASURE_ENABLED
+		measureJitter();
+#endif
+#if CLOCK_MEASURE_ENABLED
+		driveMeasure();
+#endif
 	}
 	return 0 ;
-}
\ No newline at end of file
+}
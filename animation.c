@@ -0,0 +1,101 @@
+/*
+ ==============================================
+ Name        : animation.c
+ Author      :
+ Version     :
+ Description : Keyframe animation for the 8 outputs of a shift register.
+             : A pattern is a set of looping tracks, each a table of
+             : keyframes held for a number of frames, drawn over the
+             : tracks added before it. Frames are counted, not timed,
+             : so the frame rate is set by whatever calls
+             : animation_next, normally a timer.
+ ==============================================
+ */
+
+#include <string.h>
+
+#define ANIMATION_MAX_TRACKS 4
+
+typedef struct {
+    unsigned char bits;         // Outputs lit, bit n for output n
+    unsigned short frames;      // Frames the keyframe is held for
+} animation_keyframe;
+
+typedef struct {
+    const animation_keyframe *keyframes;
+    int num_keyframes;
+    int phase;          // Frames into the loop the track starts at
+    int dim_period;     // Lit on one frame in dim_period, 1 for always
+} animation_track;
+
+typedef struct {
+    const animation_track *tracks[ANIMATION_MAX_TRACKS];
+    int num_tracks;
+    int key[ANIMATION_MAX_TRACKS];          // Keyframe shown by each track
+    int frames_left[ANIMATION_MAX_TRACKS];  // Frames before its next one
+    int dim_count[ANIMATION_MAX_TRACKS];    // Lit when this is 0
+    uint32_t frame;                         // Frames produced so far
+} animation_state;
+
+void animation_init(animation_state *anim){
+    memset(anim, 0, sizeof(animation_state));
+}
+
+/*
+ * Adds a track, wound forward to its phase. Returns 0, or -1 if there
+ * are already ANIMATION_MAX_TRACKS tracks or the track is empty.
+ */
+int animation_add_track(animation_state *anim, const animation_track *track){
+    int n = anim->num_tracks;
+    int loop = 0;
+    int t;
+
+    if (n >= ANIMATION_MAX_TRACKS || track->num_keyframes <= 0 ||
+            track->dim_period <= 0) return -1;
+    for (int i=0; i<track->num_keyframes; i++){
+        loop += track->keyframes[i].frames;
+    }
+    if (loop == 0) return -1;
+
+    t = track->phase % loop;
+    anim->key[n] = 0;
+    while (t >= track->keyframes[anim->key[n]].frames){
+        t -= track->keyframes[anim->key[n]].frames;
+        anim->key[n]++;
+    }
+    anim->frames_left[n] = track->keyframes[anim->key[n]].frames - t;
+    anim->dim_count[n] = track->phase % track->dim_period;
+    anim->tracks[n] = track;
+    anim->num_tracks++;
+    return 0;
+}
+
+// Returns the outputs lit in the current frame and moves to the next
+unsigned char animation_next(animation_state *anim){
+    unsigned char bits = 0;
+
+    for (int n=0; n<anim->num_tracks; n++){
+        const animation_track *track = anim->tracks[n];
+
+        // Tracks are layered in order; a dimmed track's off frames blank
+        // its outputs in the tracks below too
+        if (anim->dim_count[n] == 0){
+            bits |= track->keyframes[anim->key[n]].bits;
+        } else {
+            bits &= ~track->keyframes[anim->key[n]].bits;
+        }
+        if (++anim->dim_count[n] == track->dim_period){
+            anim->dim_count[n] = 0;
+        }
+
+        // Zero length keyframes are skipped
+        if (--anim->frames_left[n] == 0){
+            do {
+                if (++anim->key[n] == track->num_keyframes) anim->key[n] = 0;
+                anim->frames_left[n] = track->keyframes[anim->key[n]].frames;
+            } while (anim->frames_left[n] == 0);
+        }
+    }
+    anim->frame++;
+    return bits;
+}
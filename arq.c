@@ -0,0 +1,272 @@
+/*
+ ==============================================
+ Name        : arq.c
+ Author      :
+ Version     :
+ Description : Selective-repeat ARQ for the light link. Data frames carry
+             : a sequence number and a CRC-8. The receiver answers over
+             : the return light path with the next sequence number it
+             : expects, plus a bitmap of the later frames it already
+             : holds. The sender resends the gaps named by that bitmap at
+             : once, and any other unacknowledged frame on timeout.
+             :
+             : All header fields are offset by ARQ_HEADER_BASE so frames
+             : remain null-terminated strings on the wire:
+             :   data frame  seq, payload..., crc high nibble, crc low nibble
+             :   ack frame   ARQ_ACK_MARKER, next seq, bitmap low, bitmap high,
+             :               link report
+ ==============================================
+ */
+
+#include <string.h>
+
+// Set to 1 to send data frames through the ARQ window and wait for acks.
+// Transmitter and receiver must agree on this setting.
+#ifndef ARQ_ENABLED
+#define ARQ_ENABLED 0
+#endif
+
+// Frames in flight; a power of two no larger than ARQ_SEQ_MOD/2
+#ifndef ARQ_WINDOW
+#define ARQ_WINDOW 4
+#endif
+
+#define ARQ_SEQ_MOD      16
+#define ARQ_MAX_PAYLOAD  32
+#define ARQ_HEADER_BASE  0x40
+#define ARQ_ACK_MARKER   '!'
+
+// Buffer sizes including the null terminator
+#define ARQ_FRAME_LEN    (ARQ_MAX_PAYLOAD + 4)
+#define ARQ_ACK_LEN      6
+
+// One frame held in a window
+typedef struct {
+    char data[ARQ_MAX_PAYLOAD + 1];
+    int  len;
+    int  in_use;        // Queued and not yet acknowledged, or received
+    int  sent;          // Transmitted at least once
+    int  nacked;        // Receiver reported it missing; resend immediately
+    int  systime_sent;
+} arq_slot;
+
+// Sending side state
+typedef struct {
+    arq_slot slots[ARQ_WINDOW];
+    int base;           // Oldest unacknowledged sequence number
+    int next;           // Sequence number of the next queued frame
+    int timeout;        // Ticks to wait for an ack before resending
+    int num_sent;
+    int num_retransmits;
+    int num_timeouts;   // Resends caused by a missing ack
+    int last_report;    // Link report carried by the newest ack
+} arq_sender;
+
+// Receiving side state
+typedef struct {
+    arq_slot slots[ARQ_WINDOW];
+    int base;           // Next sequence number to deliver in order
+    int num_rejected;   // Frames dropped for a bad CRC or header
+} arq_receiver;
+
+// Distance from sequence number a forward to b
+int arq_seq_distance(int a, int b){
+    return (b - a + ARQ_SEQ_MOD) % ARQ_SEQ_MOD;
+}
+
+// CRC-8, polynomial x^8 + x^2 + x + 1
+int arq_crc8(const char *data, int len){
+    int crc = 0;
+    int i, b;
+
+    for (i = 0; i < len; i++){
+        crc ^= (unsigned char) data[i];
+        for (b = 0; b < 8; b++){
+            crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+        }
+    }
+    return crc & 0xFF;
+}
+
+void arq_sender_init(arq_sender *s, int timeout){
+    memset(s, 0, sizeof(arq_sender));
+    s->timeout = timeout;
+}
+
+// Number of frames queued and not yet acknowledged
+int arq_sender_pending(arq_sender *s){
+    return arq_seq_distance(s->base, s->next);
+}
+
+/*
+ * Queues len bytes for reliable delivery. Returns the frame's sequence
+ * number, or -1 if the window is full or the payload is too long.
+ */
+int arq_sender_queue(arq_sender *s, const char *data, int len){
+    arq_slot *slot;
+    int seq = s->next;
+
+    if (len > ARQ_MAX_PAYLOAD || arq_sender_pending(s) >= ARQ_WINDOW){
+        return -1;
+    }
+
+    slot = &s->slots[seq % ARQ_WINDOW];
+    memcpy(slot->data, data, len);
+    slot->data[len] = '\0';
+    slot->len    = len;
+    slot->in_use = 1;
+    slot->sent   = 0;
+    slot->nacked = 0;
+
+    s->next = (s->next + 1) % ARQ_SEQ_MOD;
+    return seq;
+}
+
+/*
+ * Picks the oldest frame that is new, reported missing, or timed out,
+ * writes it to frame (ARQ_FRAME_LEN bytes) and returns its sequence
+ * number. Returns -1 if nothing is due at systime.
+ */
+int arq_sender_next(arq_sender *s, int systime, char *frame){
+    int i;
+
+    for (i = 0; i < arq_sender_pending(s); i++){
+        int seq = (s->base + i) % ARQ_SEQ_MOD;
+        arq_slot *slot = &s->slots[seq % ARQ_WINDOW];
+
+        if (!slot->in_use) continue;
+        if (slot->sent && !slot->nacked &&
+                systime - slot->systime_sent < s->timeout) continue;
+
+        if (slot->sent) s->num_retransmits++;
+        if (slot->sent && !slot->nacked) s->num_timeouts++;
+        s->num_sent++;
+        slot->sent   = 1;
+        slot->nacked = 0;
+        slot->systime_sent = systime;
+
+        frame[0] = (char)(ARQ_HEADER_BASE + seq);
+        memcpy(&frame[1], slot->data, slot->len);
+        int crc = arq_crc8(frame, slot->len + 1);
+        frame[slot->len + 1] = (char)(ARQ_HEADER_BASE + (crc >> 4));
+        frame[slot->len + 2] = (char)(ARQ_HEADER_BASE + (crc & 0x0F));
+        frame[slot->len + 3] = '\0';
+        return seq;
+    }
+    return -1;
+}
+
+/*
+ * Applies an ack frame from the receiver: slides the window past every
+ * frame before the expected sequence number, releases the frames marked
+ * in the bitmap, and flags the gaps below the newest marked frame for
+ * immediate resend. Returns -1 if the ack is malformed.
+ */
+int arq_sender_ack(arq_sender *s, const char *ack){
+    int expected, bitmap, i, newest;
+
+    if (strlen(ack) != ARQ_ACK_LEN - 1 || ack[0] != ARQ_ACK_MARKER) return -1;
+    expected = ack[1] - ARQ_HEADER_BASE;
+    bitmap   = (ack[2] - ARQ_HEADER_BASE) | ((ack[3] - ARQ_HEADER_BASE) << 4);
+    if (expected < 0 || expected >= ARQ_SEQ_MOD) return -1;
+    s->last_report = ack[4] - ARQ_HEADER_BASE;
+
+    // Stale acks can name a sequence number outside the window
+    if (arq_seq_distance(s->base, expected) > arq_sender_pending(s)) return 0;
+
+    while (s->base != expected){
+        s->slots[s->base % ARQ_WINDOW].in_use = 0;
+        s->base = (s->base + 1) % ARQ_SEQ_MOD;
+    }
+
+    newest = -1;
+    for (i = 0; i < ARQ_WINDOW - 1; i++){
+        int seq = (expected + 1 + i) % ARQ_SEQ_MOD;
+        if (!(bitmap & (1 << i))) continue;
+        if (arq_seq_distance(s->base, seq) >= arq_sender_pending(s)) break;
+        s->slots[seq % ARQ_WINDOW].in_use = 0;
+        newest = i;
+    }
+
+    // Anything older than a frame that arrived was lost
+    for (i = -1; i < newest; i++){
+        arq_slot *slot = &s->slots[(expected + 1 + i) % ARQ_SEQ_MOD % ARQ_WINDOW];
+        if (slot->in_use && slot->sent) slot->nacked = 1;
+    }
+
+    // Drop acknowledged frames from the front of the window
+    while (s->base != s->next && !s->slots[s->base % ARQ_WINDOW].in_use){
+        s->base = (s->base + 1) % ARQ_SEQ_MOD;
+    }
+    return 0;
+}
+
+void arq_receiver_init(arq_receiver *r){
+    memset(r, 0, sizeof(arq_receiver));
+}
+
+/*
+ * Checks a received data frame and holds it for in-order delivery.
+ * Returns 1 if the frame was valid, even if it was a duplicate, and -1
+ * if it was corrupted.
+ */
+int arq_receiver_accept(arq_receiver *r, const char *frame){
+    int len = strlen(frame);
+    int seq, crc;
+
+    if (len < 3 || len - 3 > ARQ_MAX_PAYLOAD){
+        r->num_rejected++;
+        return -1;
+    }
+    seq = frame[0] - ARQ_HEADER_BASE;
+    crc = ((frame[len-2] - ARQ_HEADER_BASE) << 4) | (frame[len-1] - ARQ_HEADER_BASE);
+    if (seq < 0 || seq >= ARQ_SEQ_MOD || crc != arq_crc8(frame, len - 2)){
+        r->num_rejected++;
+        return -1;
+    }
+
+    if (arq_seq_distance(r->base, seq) < ARQ_WINDOW){
+        arq_slot *slot = &r->slots[seq % ARQ_WINDOW];
+        if (!slot->in_use){
+            slot->len = len - 3;
+            memcpy(slot->data, &frame[1], slot->len);
+            slot->data[slot->len] = '\0';
+            slot->in_use = 1;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Copies the next in-order payload to out (ARQ_MAX_PAYLOAD + 1 bytes)
+ * and returns its length, or returns -1 if it has not arrived yet.
+ */
+int arq_receiver_deliver(arq_receiver *r, char *out){
+    arq_slot *slot = &r->slots[r->base % ARQ_WINDOW];
+    int len;
+
+    if (!slot->in_use) return -1;
+    len = slot->len;
+    memcpy(out, slot->data, len + 1);
+    slot->in_use = 0;
+    r->base = (r->base + 1) % ARQ_SEQ_MOD;
+    return len;
+}
+
+// Writes the ack frame (ARQ_ACK_LEN bytes) describing what has arrived.
+// report (0-63) is passed through to the sender's last_report.
+void arq_receiver_ack(arq_receiver *r, char *ack, int report){
+    int bitmap = 0;
+    int i;
+
+    for (i = 0; i < ARQ_WINDOW - 1; i++){
+        int seq = (r->base + 1 + i) % ARQ_SEQ_MOD;
+        if (r->slots[seq % ARQ_WINDOW].in_use) bitmap |= 1 << i;
+    }
+    ack[0] = ARQ_ACK_MARKER;
+    ack[1] = (char)(ARQ_HEADER_BASE + r->base);
+    ack[2] = (char)(ARQ_HEADER_BASE + (bitmap & 0x0F));
+    ack[3] = (char)(ARQ_HEADER_BASE + (bitmap >> 4));
+    ack[4] = (char)(ARQ_HEADER_BASE + report);
+    ack[5] = '\0';
+}
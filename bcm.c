@@ -0,0 +1,94 @@
+/*
+ ==============================================
+ Name        : bcm.c
+ Author      :
+ Version     :
+ Description : Binary code modulation brightness for the 8 outputs of a
+             : shift register. Bit p of every output's level forms bit
+             : plane p, which is shown for 2^p timer ticks, so one cycle
+             : of 2^BCM_BITS - 1 ticks averages to each level with only
+             : BCM_BITS register updates. Needs an update that finishes
+             : well inside one tick, i.e. the SSP backend.
+ ==============================================
+ */
+
+#include <string.h>
+
+#ifndef BCM_ENABLED
+#define BCM_ENABLED 0
+#endif
+
+// Brightness bits per output, 4 to 8
+#ifndef BCM_BITS
+#define BCM_BITS 6
+#endif
+
+#define BCM_OUTPUTS    8
+#define BCM_MAX_LEVEL  ((1 << BCM_BITS) - 1)
+#define BCM_CYCLE_TICKS BCM_MAX_LEVEL
+
+#if BCM_BITS < 4 || BCM_BITS > 8
+#error "BCM_BITS must be 4 to 8"
+#endif
+
+typedef struct {
+    volatile unsigned char levels[BCM_OUTPUTS]; // Set by the main loop
+    unsigned char planes[BCM_BITS];     // Planes of the cycle being shown
+    int plane;                          // Plane on display
+    int ticks_left;                     // Ticks before the next plane
+    uint32_t num_planes;                // Planes handed to the register
+} bcm_state;
+
+void bcm_init(bcm_state *bcm){
+    memset(bcm, 0, sizeof(bcm_state));
+    bcm->plane = BCM_BITS - 1;  // The first step starts a new cycle
+}
+
+void bcm_set_level(bcm_state *bcm, int output, int level){
+    if (level > BCM_MAX_LEVEL) level = BCM_MAX_LEVEL;
+    if (level < 0) level = 0;
+    bcm->levels[output] = (unsigned char) level;
+}
+
+// Lights the outputs set in bits at level and turns the rest off
+void bcm_set_byte(bcm_state *bcm, int bits, int level){
+    int i;
+    for (i = 0; i < BCM_OUTPUTS; i++){
+        bcm_set_level(bcm, i, (bits >> i) & 1 ? level : 0);
+    }
+}
+
+/*
+ * Splits the current levels into bit planes. Bit i of plane p is bit p
+ * of output i's level. Done once per cycle so a level changed part way
+ * through a cycle never mixes planes of two levels.
+ */
+void bcm_build_planes(bcm_state *bcm){
+    int p, i;
+
+    for (p = 0; p < BCM_BITS; p++){
+        unsigned char plane = 0;
+        for (i = 0; i < BCM_OUTPUTS; i++){
+            plane |= ((bcm->levels[i] >> p) & 1) << i;
+        }
+        bcm->planes[p] = plane;
+    }
+}
+
+/*
+ * Advances one timer tick. When the next plane is due, writes it to
+ * *bits and returns 1; the caller shifts it into the register. Returns 0
+ * on the other ticks.
+ */
+int bcm_step(bcm_state *bcm, int *bits){
+    if (bcm->ticks_left > 0 && --bcm->ticks_left > 0) return 0;
+
+    if (++bcm->plane == BCM_BITS){
+        bcm->plane = 0;
+        bcm_build_planes(bcm);
+    }
+    bcm->ticks_left = 1 << bcm->plane;
+    *bits = bcm->planes[bcm->plane];
+    bcm->num_planes++;
+    return 1;
+}
@@ -0,0 +1,149 @@
+/*
+ ==============================================
+ Name        : clock_measure.c
+ Author      :
+ Version     :
+ Description : Measures the cclk actually running against the 32.768 kHz
+             : RTC crystal. The RTC's counter increment interrupt comes
+             : once every 32768 RTC clocks; the DWT cycle counter read
+             : there counts the cclk cycles in each second, and a window
+             : of them gives the measured cclk and its error against
+             : the frequency clock_settings promise. An IRC-fed PLL can
+             : be off by 1%; the RTC crystal is good to about 20 ppm.
+ ==============================================
+ */
+
+#ifndef CLOCK_MEASURE_ENABLED
+#define CLOCK_MEASURE_ENABLED 0
+#endif
+
+// RTC seconds per measurement
+#ifndef CLOCK_MEASURE_SECONDS
+#define CLOCK_MEASURE_SECONDS 4
+#endif
+
+// Measurements further off than this are taken to be a fault, not cclk
+#ifndef CLOCK_MEASURE_MAX_PPM
+#define CLOCK_MEASURE_MAX_PPM 30000
+#endif
+
+typedef struct {
+    int nominal;            // cclk the settings promise for this window
+    int window;             // RTC seconds per measurement
+    int seconds;            // RTC seconds into the window, -1 before it starts
+    uint32_t last;          // Cycle count at the last RTC second
+    uint64_t cycles;        // cclk cycles in the window so far
+    int frequency;          // cclk measured by the last complete window
+    int error_ppm;          // Measured against nominal
+    int num_measurements;   // Complete windows
+    int suspended;          // 1 while cclk is not at nominal
+    int resync;             // 1 to take the next second's count afresh
+} clock_measure_state;
+
+/*
+ * Starts a new window at the next RTC second, against nominal. Call it
+ * whenever cclk changes, since a window must not span two clocks.
+ */
+void clock_measure_restart(clock_measure_state *s, int nominal){
+    s->nominal = nominal;
+    s->seconds = -1;
+    s->cycles = 0;
+}
+
+/*
+ * Stops counting while cclk runs at something other than nominal,
+ * keeping the whole seconds already in the window. Nothing is lost if it
+ * is already suspended.
+ */
+void clock_measure_suspend(clock_measure_state *s){
+    s->suspended = 1;
+}
+
+/*
+ * Carries the window on from the next RTC second, once cclk is back at
+ * nominal. The second cclk changed in is not counted.
+ */
+void clock_measure_resume(clock_measure_state *s){
+    if (!s->suspended) return;
+    s->suspended = 0;
+    s->resync = 1;
+}
+
+void clock_measure_init(clock_measure_state *s, int nominal, int window){
+    memset(s, 0, sizeof(clock_measure_state));
+    s->window = window > 0 ? window : 1;
+    clock_measure_restart(s, nominal);
+}
+
+/*
+ * Works out the cclk that ran cycles in seconds RTC seconds, and its
+ * error against nominal. Returns -1 if the error is beyond
+ * CLOCK_MEASURE_MAX_PPM, leaving both filled in.
+ */
+int clock_measure_compute(uint64_t cycles, int seconds, int nominal,
+        int *frequency, int *error_ppm){
+    if (seconds <= 0 || nominal <= 0) return -1;
+
+    uint64_t f = (cycles + seconds / 2) / seconds;
+    if (f > 0x7FFFFFFF) f = 0x7FFFFFFF;
+    *frequency = (int) f;
+    *error_ppm = pclk_error_ppm(cycles, (uint64_t) nominal * seconds);
+    return abs(*error_ppm) > CLOCK_MEASURE_MAX_PPM ? -1 : 0;
+}
+
+/*
+ * Takes the cycle count at an RTC second. Returns 1 when it completes a
+ * measurement, which also starts the next window, or 0.
+ */
+int clock_measure_second(clock_measure_state *s, uint32_t now){
+    if (s->suspended) return 0;
+    if (s->seconds < 0 || s->resync){
+        s->last = now;
+        if (s->seconds < 0) s->seconds = 0;
+        s->resync = 0;
+        return 0;
+    }
+
+    // Counted a second at a time so the 32 bit counter may wrap
+    s->cycles += now - s->last;
+    s->last = now;
+    if (++s->seconds < s->window) return 0;
+
+    clock_measure_compute(s->cycles, s->seconds, s->nominal, &s->frequency,
+        &s->error_ppm);
+    s->num_measurements++;
+    s->seconds = 0;
+    s->cycles = 0;
+    return 1;
+}
+
+/*
+ * Scales clock's frequency by the last measurement, so that settings for
+ * another divider of the same PLL0 setup are corrected too. Returns -1,
+ * leaving clock alone, if there is no measurement or it is out of range.
+ */
+int clock_measure_correct(const clock_measure_state *s, clock_settings *clock){
+    if (s->num_measurements == 0 || s->nominal <= 0 ||
+            abs(s->error_ppm) > CLOCK_MEASURE_MAX_PPM) return -1;
+
+    clock->frequency = (int) (((uint64_t) clock->frequency * s->frequency +
+        s->nominal / 2) / s->nominal);
+    return 0;
+}
+
+#ifndef CLOCK_UTIL_HOST
+/*
+ * Starts the RTC if it is not running and enables its interrupt once a
+ * second, leaving the time and calibration as they are. The caller's
+ * RTC_IRQHandler reads the cycle counter first, passes it to
+ * clock_measure_second and clears the interrupt with LPC_RTC->ILR = 1.
+ */
+void clock_measure_start(){
+    LPC_SC->PCONP |= 1 << 9;
+    LPC_RTC->CCR = (LPC_RTC->CCR & ~2) | 1;  // CLKEN, CTCRST clear
+    LPC_RTC->AMR = 0xFF;                     // No alarms
+    LPC_RTC->CIIR = 1;                       // IMSEC
+    LPC_RTC->ILR = 3;
+    NVIC_EnableIRQ(RTC_IRQn);
+}
+#endif
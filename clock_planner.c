@@ -0,0 +1,288 @@
+/**
+ * LPC Clock Planner
+ *
+ * Host command line tool around calculate_clock_settings. Build and run
+ * it on a PC, not the LPC:
+ *
+ *   gcc -O2 -o clock_planner clock_planner.c
+ *
+ *   clock_planner 120M 100M 72000000    Best settings for each frequency
+ *   clock_planner -                     Frequencies read from stdin
+ *   clock_planner -l [MIN [MAX]]        Every achievable cclk in a range
+ *   clock_planner -g 120M 100M          Header of presets, see below
+ *
+ * Frequencies are in Hz, with an optional k or M suffix.
+ *
+ * -g prints a header defining CLOCK_PRESET_<frequency> for each
+ * frequency, so firmware can apply settings worked out here instead of
+ * searching at boot. clock_presets.h is made this way:
+ *
+ *   clock_planner -g 120M 100M > clock_presets.h
+ */
+
+#define CLOCK_UTIL_HOST
+#include "clock_util.c"
+
+#define PLANNER_MAX_CLOCKS 4000000
+
+// Sources in CLKSRCSEL order
+const int planner_sources[3] = {
+    CLOCK_SPEED_IRC_OSC, CLOCK_SPEED_OSC_CLK, CLOCK_SPEED_RTC_CLK
+};
+const char *planner_source_names[3] = {"irc", "osc", "rtc"};
+
+/**
+ * An achievable cclk, exactly num / den Hz.
+ */
+typedef struct {
+    uint64_t num;
+    uint32_t den;
+    uint32_t fcco;       // pll0clk in Hz, 0 without the PLL
+    unsigned char src;
+    unsigned char N;
+    unsigned char D;
+    unsigned char use_pll;
+    unsigned short M;
+} planner_clock;
+
+/**
+ * Parses a frequency in Hz, with an optional k or M suffix. Returns 0 if
+ * it is not a frequency.
+ */
+int planner_parse(const char *text){
+    char *end;
+    double f = strtod(text, &end);
+
+    if (end == text) return 0;
+    if (*end == 'k' || *end == 'K') { f *= 1e3; end++; }
+    else if (*end == 'M')           { f *= 1e6; end++; }
+    if (*end != '\0' || f < 1 || f > 2e9) return 0;
+    return (int) (f + 0.5);
+}
+
+// Returns the exact cclk of settings as num / den Hz
+void planner_exact(const clock_settings *s, uint64_t *num, uint32_t *den){
+    int f = planner_sources[s->val_CLKSRCSEL];
+
+    if (s->val_PLL0CON){
+        *num = 2 * (uint64_t) f * (s->val_M_factor + 1);
+        *den = (s->val_N_factor + 1) * (s->val_D_factor + 1);
+    } else {
+        *num = f;
+        *den = s->val_D_factor + 1;
+    }
+}
+
+// Prints the best settings for one frequency
+void planner_query(int desired){
+    clock_settings *s = calculate_clock_settings(desired);
+    uint64_t num;
+    uint32_t den;
+
+    planner_exact(s, &num, &den);
+    double actual = (double) num / den;
+    double fcco = s->val_PLL0CON ?
+        (double) num / (s->val_N_factor + 1) : 0;
+    printf("%10d %14.3f %10.3f  %s CLKSRCSEL=%d N=%d M=%d D=%d PLL0CON=%d"
+        " FCCO=%.0f\n", desired, actual, (actual - desired) / desired * 1e6,
+        planner_source_names[s->val_CLKSRCSEL], s->val_CLKSRCSEL,
+        s->val_N_factor, s->val_M_factor, s->val_D_factor,
+        s->val_PLL0CON, fcco);
+}
+
+/**
+ * Orders clocks by frequency. Equal clocks are ordered by preference:
+ * without the PLL first, then lowest pll0clk, then CLKSRCSEL, N and M.
+ */
+int planner_compare(const void *pa, const void *pb){
+    const planner_clock *a = pa;
+    const planner_clock *b = pb;
+    uint64_t x = a->num * b->den;
+    uint64_t y = b->num * a->den;
+
+    if (x != y) return x < y ? -1 : 1;
+    if (a->use_pll != b->use_pll) return a->use_pll - b->use_pll;
+    if (a->fcco != b->fcco) return a->fcco < b->fcco ? -1 : 1;
+    if (a->src != b->src) return a->src - b->src;
+    if (a->N != b->N) return a->N - b->N;
+    return a->M - b->M;
+}
+
+/**
+ * Adds the clock num / den if it lies in [lo, hi]. Returns 0, or -1 if
+ * the table is full.
+ */
+int planner_add(planner_clock *clocks, int *count, uint64_t num,
+        uint32_t den, int lo, int hi, int src, int N, int M, int D,
+        int use_pll){
+    if (num < (uint64_t) lo * den || num > (uint64_t) hi * den) return 0;
+    if (*count >= PLANNER_MAX_CLOCKS) return -1;
+
+    planner_clock *c = &clocks[(*count)++];
+    c->num = num;
+    c->den = den;
+    c->fcco = use_pll ? (uint32_t) (num / (N+1)) : 0;
+    c->src = src;
+    c->N = N;
+    c->M = M;
+    c->D = D;
+    c->use_pll = use_pll;
+    return 0;
+}
+
+/**
+ * Lists every distinct cclk from lo to hi Hz that the sources, PLL0
+ * (with pll0clk in range) and the CPU divider can make, with the
+ * preferred settings for each and its offset from the nearest whole Hz.
+ */
+int planner_list(int lo, int hi){
+    planner_clock *clocks = malloc(PLANNER_MAX_CLOCKS * sizeof(planner_clock));
+    int count = 0;
+    int full = 0;
+
+    if (!clocks) return -1;
+    if (hi > CLOCK_SPEED_CCLK_MAX) hi = CLOCK_SPEED_CCLK_MAX;
+
+    for (int src=0; src<3; src++){
+        uint64_t step = 2 * (uint64_t) planner_sources[src];
+        for (int D = D_MIN; D <= D_MAX; D++){
+            full |= planner_add(clocks, &count, planner_sources[src], D+1,
+                lo, hi, src, 0, 0, D, 0);
+        }
+        for (int N = N_MIN; N <= N_MAX; N++){
+            for (int M = M_MIN; M <= M_MAX; M++){
+                uint64_t num = step * (M+1);
+                if (num < (uint64_t) CLOCK_SPEED_PLL0CLK_MIN * (N+1) ||
+                        num > (uint64_t) CLOCK_SPEED_PLL0CLK_MAX * (N+1)) continue;
+                for (int D = D_MIN; D <= D_MAX; D++){
+                    full |= planner_add(clocks, &count, num, (N+1) * (D+1),
+                        lo, hi, src, N, M, D, 1);
+                }
+            }
+        }
+    }
+    if (full){
+        fprintf(stderr, "More than %d settings, narrow the range\n",
+            PLANNER_MAX_CLOCKS);
+        free(clocks);
+        return -1;
+    }
+
+    qsort(clocks, count, sizeof(planner_clock), planner_compare);
+
+    int distinct = 0;
+    printf("%16s %10s  %s\n", "cclk", "error_ppm", "settings");
+    for (int i=0; i<count; i++){
+        const planner_clock *c = &clocks[i];
+        if (i && c->num * clocks[i-1].den == clocks[i-1].num * c->den) continue;
+
+        double cclk = (double) c->num / c->den;
+        uint64_t whole = (c->num + c->den / 2) / c->den;
+        distinct++;
+        printf("%16.3f %10.4f  %s CLKSRCSEL=%d N=%d M=%d D=%d PLL0CON=%d"
+            " FCCO=%u\n", cclk, (cclk - whole) / whole * 1e6,
+            planner_source_names[c->src], c->src, c->N, c->M, c->D,
+            c->use_pll, c->fcco);
+    }
+    fprintf(stderr, "%d distinct clocks from %d settings\n", distinct, count);
+    free(clocks);
+    return 0;
+}
+
+// Prints a header defining CLOCK_PRESET_<frequency> for each frequency
+void planner_header(int count, const int *frequencies){
+    printf("/**\n"
+        " * Clock settings presets, generated by clock_planner.c; do not edit.\n"
+        " * Regenerate with: clock_planner -g");
+    for (int i=0; i<count; i++) printf(" %d", frequencies[i]);
+    printf("\n */\n\n"
+        "#ifndef __CLOCK_PRESETS_h_\n"
+        "#define __CLOCK_PRESETS_h_\n\n"
+        "// The preset for a frequency, e.g. CLOCK_PRESET(120000000)\n"
+        "#define CLOCK_PRESET(f) CLOCK_PRESET_(f)\n"
+        "#define CLOCK_PRESET_(f) CLOCK_PRESET_ ## f\n");
+
+    for (int i=0; i<count; i++){
+        clock_settings *s = calculate_clock_settings(frequencies[i]);
+        uint64_t num;
+        uint32_t den;
+
+        planner_exact(s, &num, &den);
+        printf("\n// %d Hz: %.3f Hz from %s", frequencies[i],
+            (double) num / den, planner_source_names[s->val_CLKSRCSEL]);
+        if (s->val_PLL0CON){
+            printf(", FCCO %llu Hz",
+                (unsigned long long) (num / (s->val_N_factor + 1)));
+        }
+        printf("\n#define CLOCK_PRESET_%d { \\\n"
+            "    .frequency     = %d, \\\n"
+            "    .val_CLKSRCSEL = %d, \\\n"
+            "    .val_N_factor  = %d, \\\n"
+            "    .val_M_factor  = %d, \\\n"
+            "    .val_PLL0CON   = %d, \\\n"
+            "    .val_D_factor  = %d, \\\n"
+            "}\n", frequencies[i], s->frequency, s->val_CLKSRCSEL,
+            s->val_N_factor, s->val_M_factor, s->val_PLL0CON,
+            s->val_D_factor);
+    }
+    printf("\n#endif\n");
+}
+
+void planner_usage(void){
+    puts("Usage: clock_planner FREQ...       best settings for each frequency\n"
+         "       clock_planner -              frequencies from stdin\n"
+         "       clock_planner -l [MIN [MAX]] every achievable cclk in a range\n"
+         "       clock_planner -g FREQ...     header of CLOCK_PRESET_<freq>\n"
+         "Frequencies are in Hz, with an optional k or M suffix.");
+}
+
+int main(int argc, char *argv[]){
+    if (argc < 2){
+        planner_usage();
+        return 1;
+    }
+
+    if (strcmp(argv[1], "-l") == 0){
+        int lo = argc > 2 ? planner_parse(argv[2]) : 1;
+        int hi = argc > 3 ? planner_parse(argv[3]) : CLOCK_SPEED_CCLK_MAX;
+        if (!lo || !hi || lo > hi){
+            planner_usage();
+            return 1;
+        }
+        return planner_list(lo, hi) ? 1 : 0;
+    }
+
+    if (strcmp(argv[1], "-g") == 0){
+        int count = argc - 2;
+        int *frequencies = malloc((count + 1) * sizeof(int));
+        for (int i=0; i<count; i++){
+            frequencies[i] = planner_parse(argv[i+2]);
+            if (!frequencies[i]){
+                fprintf(stderr, "Not a frequency: %s\n", argv[i+2]);
+                return 1;
+            }
+        }
+        planner_header(count, frequencies);
+        free(frequencies);
+        return 0;
+    }
+
+    printf("%10s %14s %10s  %s\n", "desired", "actual", "error_ppm",
+        "settings");
+    if (strcmp(argv[1], "-") == 0){
+        char word[64];
+        while (scanf("%63s", word) == 1){
+            int f = planner_parse(word);
+            if (f) planner_query(f);
+            else fprintf(stderr, "Not a frequency: %s\n", word);
+        }
+        return 0;
+    }
+
+    for (int i=1; i<argc; i++){
+        int f = planner_parse(argv[i]);
+        if (f) planner_query(f);
+        else fprintf(stderr, "Not a frequency: %s\n", argv[i]);
+    }
+    return 0;
+}
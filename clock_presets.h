@@ -0,0 +1,33 @@
+/**
+ * Clock settings presets, generated by clock_planner.c; do not edit.
+ * Regenerate with: clock_planner -g 120000000 100000000
+ */
+
+#ifndef __CLOCK_PRESETS_h_
+#define __CLOCK_PRESETS_h_
+
+// The preset for a frequency, e.g. CLOCK_PRESET(120000000)
+#define CLOCK_PRESET(f) CLOCK_PRESET_(f)
+#define CLOCK_PRESET_(f) CLOCK_PRESET_ ## f
+
+// 120000000 Hz: 120000000.000 Hz from irc, FCCO 360000000 Hz
+#define CLOCK_PRESET_120000000 { \
+    .frequency     = 120000000, \
+    .val_CLKSRCSEL = 0, \
+    .val_N_factor  = 1, \
+    .val_M_factor  = 89, \
+    .val_PLL0CON   = 1, \
+    .val_D_factor  = 2, \
+}
+
+// 100000000 Hz: 100000000.000 Hz from irc, FCCO 300000000 Hz
+#define CLOCK_PRESET_100000000 { \
+    .frequency     = 100000000, \
+    .val_CLKSRCSEL = 0, \
+    .val_N_factor  = 1, \
+    .val_M_factor  = 74, \
+    .val_PLL0CON   = 1, \
+    .val_D_factor  = 2, \
+}
+
+#endif
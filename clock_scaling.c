@@ -0,0 +1,309 @@
+/*
+ ==============================================
+ Name        : clock_scaling.c
+ Author      :
+ Version     :
+ Description : Runtime switching of cclk between operating points. The
+             : timers, ADC and SSP ports registered here are replanned
+             : on every switch with the PCLKSEL divider they started
+             : with: a timer keeps its period and its place within it,
+             : and the time the switch took is counted into it, while
+             : the ADC and SSP keep their rates as near as the new clock
+             : allows. Operating points sharing PLL0's setup switch by
+             : the CPU divider alone, without waiting for a relock.
+ ==============================================
+ */
+
+#ifndef CLOCK_SCALING_ENABLED
+#define CLOCK_SCALING_ENABLED 0
+#endif
+
+#define CLOCK_SCALING_MAX_PERIPHERALS 4
+
+// Registered peripheral types
+#define CLOCK_SCALED_TIMER 0
+#define CLOCK_SCALED_ADC   1
+#define CLOCK_SCALED_SSP   2
+
+#define CLOCK_SCALING_SSP_BSY (1 << 4)  // SSP status: still shifting a frame
+
+typedef struct {
+    int type;               // CLOCK_SCALED_
+    int pclksel;            // PCLKSEL field value, kept at every point
+    void *regs;             // LPC_TIM_TypeDef, LPC_ADC_TypeDef or LPC_SSP_TypeDef
+    uint32_t num, den;      // Timer period of num/den seconds; or an ADC or
+                            // SSP rate in num
+    uint32_t missed;        // Timer periods that ended during switches
+    int error_ppm;          // Of the plan in use
+    int in_range;           // 0 if the plan in use missed its request
+} clock_scaled;
+
+typedef struct {
+    clock_scaled peripherals[CLOCK_SCALING_MAX_PERIPHERALS];
+    int num_peripherals;
+    int num_switches;
+    int num_relocks;        // Switches that went through apply_clock_settings
+    uint32_t last_ns;       // Time the timers stood still in the last switch
+    uint32_t max_ns;        // And the longest so far
+    int error;              // The last CLOCK_ERR_, or 0
+} clock_scaling_state;
+
+void clock_scaling_init(clock_scaling_state *s){
+    memset(s, 0, sizeof(clock_scaling_state));
+}
+
+/*
+ * Makes an operating point running from the same PLL0 setup as clock
+ * but with another CPU divider, so switching between the two needs no
+ * relock. Returns -1 if the divider would overclock the CPU.
+ */
+int clock_scaling_point(const clock_settings *clock, int cpu_divider,
+        clock_settings *point){
+    uint64_t pllclk = (uint64_t) clock->frequency * (clock->val_D_factor + 1);
+    uint64_t frequency = pllclk / (cpu_divider + 1);
+
+    if (cpu_divider < 0 || cpu_divider > D_MAX) return -1;
+    if (frequency > CLOCK_SPEED_CCLK_MAX) return -1;
+
+    *point = *clock;
+    point->val_D_factor = cpu_divider;
+    point->frequency = (int) frequency;
+    return 0;
+}
+
+static int clock_scaling_add(clock_scaling_state *s, int type, int pclksel,
+        void *regs, uint32_t num, uint32_t den, int error_ppm){
+    if (s->num_peripherals >= CLOCK_SCALING_MAX_PERIPHERALS) return -1;
+
+    clock_scaled *p = &s->peripherals[s->num_peripherals];
+    memset(p, 0, sizeof(clock_scaled));
+    p->type = type;
+    p->pclksel = pclksel;
+    p->regs = regs;
+    p->num = num;
+    p->den = den;
+    p->error_ppm = error_ppm;
+    p->in_range = 1;
+    return s->num_peripherals++;
+}
+
+/*
+ * Registers a timer already running plan, a period of num/den seconds.
+ * Returns its index, or -1 if the table is full.
+ */
+int clock_scaling_add_timer(clock_scaling_state *s, LPC_TIM_TypeDef *timer,
+        const timer_plan *plan, uint32_t num, uint32_t den){
+    return clock_scaling_add(s, CLOCK_SCALED_TIMER, plan->pclksel, timer,
+        num, den, plan->error_ppm);
+}
+
+/*
+ * Registers the ADC, burst converting as planned for rate.
+ */
+int clock_scaling_add_adc(clock_scaling_state *s, const adc_plan *plan,
+        uint32_t rate){
+    return clock_scaling_add(s, CLOCK_SCALED_ADC, plan->pclksel, LPC_ADC,
+        rate, 1, plan->error_ppm);
+}
+
+/*
+ * Registers an SSP port running as planned for rate.
+ */
+int clock_scaling_add_ssp(clock_scaling_state *s, LPC_SSP_TypeDef *ssp,
+        const ssp_plan *plan, uint32_t rate){
+    return clock_scaling_add(s, CLOCK_SCALED_SSP, plan->pclksel, ssp,
+        rate, 1, plan->error_ppm);
+}
+
+/*
+ * Returns the timer periods that ended unseen during switches since the
+ * last call, so a tick count can be kept whole.
+ */
+uint32_t clock_scaling_missed(clock_scaling_state *s, int index){
+    uint32_t missed = s->peripherals[index].missed;
+    s->peripherals[index].missed = 0;
+    return missed;
+}
+
+// Nanoseconds taken by cycles at cclk f
+static uint64_t clock_scaling_ns(uint32_t cycles, int f){
+    return ((uint64_t) cycles * 1000000000 + f / 2) / f;
+}
+
+/*
+ * Replans a stopped timer for the new clock and returns where it should
+ * restart, in pclk ticks since its last match: pos of every period had
+ * gone by when it stopped, so it takes up the same place in its new
+ * period, moved on by
+ * elapsed_ns if it was running. The rest of the time it stays stopped
+ * is added by clock_scaling_restart.
+ */
+static uint64_t clock_scaling_replan(clock_scaled *p, const clock_settings *clock,
+        timer_plan *plan, uint64_t pos, uint64_t period, uint64_t elapsed_ns,
+        int running){
+    p->in_range = timer_plan_fixed(clock, p->pclksel, p->num, p->den,
+        plan) == 0;
+    p->error_ppm = plan->error_ppm;
+
+    uint64_t ticks = (uint64_t) (plan->match + 1) * (plan->prescale + 1);
+    uint64_t at = (pos * ticks + period / 2) / period;
+    if (running){
+        // pclk is cclk/divider exactly, so count in cclk cycles
+        uint64_t cycles = (elapsed_ns * (uint32_t) clock->frequency +
+            500000000) / 1000000000;
+        at += (cycles + pclk_divider[p->pclksel] / 2) /
+            pclk_divider[p->pclksel];
+    }
+    return at;
+}
+
+/*
+ * Restarts a replanned timer at, plus the cycles since mark, ticks since
+ * its last match. Only cheap arithmetic is left between reading the
+ * cycle counter and starting it.
+ */
+static void clock_scaling_restart(clock_scaled *p, const timer_plan *plan,
+        uint64_t at, uint32_t mark, int running){
+    LPC_TIM_TypeDef *timer = p->regs;
+    uint64_t ticks = (uint64_t) (plan->match + 1) * (plan->prescale + 1);
+
+    timer->PR  = plan->prescale;
+    timer->MR0 = plan->match;
+    if (running){
+        int div = pclk_divider[p->pclksel];
+        at += (CLOCK_DWT_CYCCNT - mark + div / 2) / div;
+    }
+    while (at >= ticks){
+        at -= ticks;
+        p->missed++;
+    }
+    // The match comes as TC reaches MR0
+    at += (uint64_t) plan->match * (plan->prescale + 1);
+    if (at >= ticks) at -= ticks;
+    if (plan->prescale == 0){
+        timer->TC = (uint32_t) at;
+        timer->PC = 0;
+    } else {
+        timer->TC = (uint32_t) (at / (plan->prescale + 1));
+        timer->PC = (uint32_t) (at % (plan->prescale + 1));
+    }
+    if (running) timer->TCR = 1;
+}
+
+/*
+ * Replans an ADC or SSP port for the new clock. The SSP is let finish
+ * the frame it is shifting first.
+ */
+static void clock_scaling_port(clock_scaled *p, const clock_settings *clock){
+    if (p->type == CLOCK_SCALED_ADC){
+        LPC_ADC_TypeDef *adc = p->regs;
+        adc_plan plan;
+
+        p->in_range = adc_plan_fixed(clock, p->pclksel, p->num, &plan) == 0;
+        p->error_ppm = plan.error_ppm;
+        adc->ADCR = (adc->ADCR & ~(0xFF << 8)) | (plan.clkdiv << 8);
+    } else {
+        LPC_SSP_TypeDef *ssp = p->regs;
+        ssp_plan plan;
+
+        p->in_range = ssp_plan_rate(clock, p->pclksel, p->num, &plan) == 0;
+        p->error_ppm = plan.error_ppm;
+        while (ssp->SR & CLOCK_SCALING_SSP_BSY);
+        ssp->CPSR = plan.cpsdvsr;
+        ssp->CR0  = (ssp->CR0 & ~(0xFF << 8)) | (plan.scr << 8);
+    }
+}
+
+/*
+ * Switches cclk from clock, the settings in force, to point, leaving
+ * what was applied in clock, and replans every registered peripheral.
+ * The timers stop for the switch; the DWT cycle counter times it and
+ * they restart as far on as they would have been. Registered ports are
+ * replanned after the timers restart. Periods that ended in
+ * the meantime are added to their missed count, and their interrupts
+ * are lost.
+ *
+ * Call with interrupts disabled. Returns 0, or the CLOCK_ERR_ that left
+ * the CPU running from the IRC.
+ */
+int clock_scaling_switch(clock_scaling_state *s, clock_settings *clock,
+        const clock_settings *point){
+    uint64_t pos[CLOCK_SCALING_MAX_PERIPHERALS];
+    uint64_t period[CLOCK_SCALING_MAX_PERIPHERALS];
+    int running[CLOCK_SCALING_MAX_PERIPHERALS];
+    timer_plan plans[CLOCK_SCALING_MAX_PERIPHERALS];
+    int old_frequency = clock->frequency;
+    int n = s->num_peripherals;
+    uint64_t elapsed;
+    uint32_t mark;
+
+#ifdef CLOCK_DEMCR
+    CLOCK_DEMCR    |= 1 << 24;  // TRCENA
+    CLOCK_DWT_CTRL |= 1;        // CYCCNTENA
+#endif
+    mark = CLOCK_DWT_CYCCNT;
+    for (int i = 0; i < n; i++){
+        clock_scaled *p = &s->peripherals[i];
+        if (p->type != CLOCK_SCALED_TIMER) continue;
+
+        LPC_TIM_TypeDef *timer = p->regs;
+        running[i] = timer->TCR & 1;
+        timer->TCR = 0;
+        period[i] = (uint64_t) (timer->MR0 + 1) * (timer->PR + 1);
+        pos[i] = ((uint64_t) (timer->TC + 1) * (timer->PR + 1) + timer->PC) %
+            period[i];
+    }
+
+    int same_pll = clock->val_PLL0CON && point->val_PLL0CON &&
+        clock->val_CLKSRCSEL == point->val_CLKSRCSEL &&
+        clock->val_N_factor == point->val_N_factor &&
+        clock->val_M_factor == point->val_M_factor &&
+        (LPC_SC->PLL0STAT & CLOCK_PLL0_CONNECTED);
+
+    if (same_pll){
+        // PLL0 stays locked: set the flash access time for the faster
+        // of the two clocks around the change of divider
+        if (point->frequency > clock->frequency)
+            clock_set_flash_time(clock_flash_time(point->frequency));
+        uint32_t before = CLOCK_DWT_CYCCNT - mark;
+        LPC_SC->CCLKCFG = point->val_D_factor;
+        mark = CLOCK_DWT_CYCCNT;
+        elapsed = clock_scaling_ns(before, old_frequency);
+        if (point->frequency < clock->frequency)
+            clock_set_flash_time(clock_flash_time(point->frequency));
+        *clock = *point;
+        s->error = 0;
+    } else {
+        uint32_t before = CLOCK_DWT_CYCCNT - mark;
+        *clock = *point;
+        s->error = apply_clock_settings(clock);
+        mark = CLOCK_DWT_CYCCNT;
+        elapsed = clock_scaling_ns(before, old_frequency) +
+            global_clock_bringup.total_ns;
+        s->num_relocks++;
+    }
+
+    // Do the slow arithmetic for every timer before restarting any
+    for (int i = 0; i < n; i++){
+        clock_scaled *p = &s->peripherals[i];
+        if (p->type != CLOCK_SCALED_TIMER) continue;
+        pos[i] = clock_scaling_replan(p, clock, &plans[i], pos[i], period[i],
+            elapsed, running[i]);
+    }
+    for (int i = 0; i < n; i++){
+        clock_scaled *p = &s->peripherals[i];
+        if (p->type != CLOCK_SCALED_TIMER) continue;
+        clock_scaling_restart(p, &plans[i], pos[i], mark, running[i]);
+    }
+    s->last_ns = (uint32_t) (elapsed + clock_scaling_ns(CLOCK_DWT_CYCCNT -
+        mark, clock->frequency));
+
+    for (int i = 0; i < n; i++){
+        if (s->peripherals[i].type != CLOCK_SCALED_TIMER)
+            clock_scaling_port(&s->peripherals[i], clock);
+    }
+
+    if (s->last_ns > s->max_ns) s->max_ns = s->last_ns;
+    s->num_switches++;
+    return s->error;
+}
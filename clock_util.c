@@ -34,18 +34,67 @@ double calc_f_cclk(double f_pllclk, int D){
 
 clock_settings global_settings;
 
+/**
+ * Exact error of a candidate clock, kept as the fraction err / den Hz so
+ * no division or floating point is needed to compare candidates. den is
+ * 0 until a candidate has been found.
+ */
+typedef struct {
+    uint64_t err;
+    uint64_t den;
+    int CLOCK_SEL;
+    int N;
+    int M;
+    int D;
+    int use_pll;
+} clock_candidate;
+
+/**
+ * Keeps the candidate with cclk = num / den if it is strictly closer to
+ * the desired frequency than best, so earlier candidates win ties.
+ */
+static void clock_consider(clock_candidate *best, uint64_t num, uint64_t den,
+        int desired_frequency, int CLOCK_SEL, int N, int M, int D,
+        int use_pll){
+    uint64_t target = (uint64_t) desired_frequency * den;
+    uint64_t err = num > target ? num - target : target - num;
+
+    if (best->den && err * best->den >= best->err * den) return;
+    best->err = err;
+    best->den = den;
+    best->CLOCK_SEL = CLOCK_SEL;
+    best->N = N;
+    best->M = M;
+    best->D = D;
+    best->use_pll = use_pll;
+}
+
+/**
+ * Returns a * n / d rounded down without 64-bit division, which a
+ * Cortex-M3 does in software. n * d must be under 2^32.
+ */
+static uint32_t clock_mul_div(uint32_t a, uint32_t n, uint32_t d){
+    return (a / d) * n + (a % d) * n / d;
+}
+
 /**
  * Calculates clock settings to match a desired frequency.
+ *
+ * Exact divisions of a source are used without the PLL. Otherwise, for
+ * each D that puts the desired frequency in pll0clk's range, source and
+ * N, the M giving the closest cclk is solved for directly: only the two
+ * values either side of the exact solution, limited to the M range and
+ * to an in-range pll0clk, need checking. The search stops at an exact
+ * match. Sources divided down without the PLL are tried last.
  */
 clock_settings * calculate_clock_settings(int desired_frequency){
     int i=0;
     int CLOCK_SEL = -1;
     int D=0;
-    int D_SEL=0;
+    int D_LO=0;
+    int D_HI=0;
     int N=0;
-    int N_SEL=0;
-    int M=0;
-    int M_SEL=0;
+    int done=0;
         
     //clock_settings *settings = malloc(sizeof(clock_settings));
     clock_settings *settings = &global_settings;
@@ -77,122 +126,351 @@ clock_settings * calculate_clock_settings(int desired_frequency){
         return settings;
     }
     
-    settings->val_CLKSRCSEL = i;
-    
-    int f_pllclk;
+    // Dividers that put desired_frequency * (D+1) in pll0clk's range,
+    // or the nearest one if there are none. One more either side, as a
+    // pll0clk just inside the range can come nearest through them.
+    D_LO = (CLOCK_SPEED_PLL0CLK_MIN + desired_frequency - 1) /
+        desired_frequency - 2;
+    D_HI = CLOCK_SPEED_PLL0CLK_MAX / desired_frequency;
+    if (D_LO < D_MIN) D_LO = D_MIN;
+    if (D_HI > D_MAX) D_HI = D_MAX;
+    if (D_LO > D_MAX) D_LO = D_HI = D_MAX;
+    if (D_HI < D_MIN) D_LO = D_HI = D_MIN;
     
-    for (D = D_MIN; (D <= D_MAX) && (D_SEL == 0); D++){
-        f_pllclk = desired_frequency * (D+1);
-        if (f_pllclk >= CLOCK_SPEED_PLL0CLK_MIN &&
-                f_pllclk <= CLOCK_SPEED_PLL0CLK_MAX){
-            D_SEL = D;
+    // Range of M+1 allowed by M's limits and pll0clk's range for each
+    // source and N; these do not depend on D
+    int m_lo[3][N_MAX+1];
+    int m_hi[3][N_MAX+1];
+    for (i=0; i<3; i++){
+        for (N = N_MIN; N <= N_MAX; N++){
+            uint32_t step = 2 * clocks[i];  // pll0clk per M, times N+1
+            uint32_t lo = clock_mul_div(CLOCK_SPEED_PLL0CLK_MIN, N+1, step);
+            uint32_t hi = clock_mul_div(CLOCK_SPEED_PLL0CLK_MAX, N+1, step);
+            if ((CLOCK_SPEED_PLL0CLK_MIN % step) * (N+1) % step) lo++;
+            m_lo[i][N] = lo < M_MIN + 1 ? M_MIN + 1 : (int) lo;
+            m_hi[i][N] = hi > M_MAX + 1 ? M_MAX + 1 : (int) hi;
         }
     }
     
-    double least_error = DBL_MAX;
-    int best_frequency = 0;
+    clock_candidate best;
+    memset(&best, 0, sizeof(clock_candidate));
     
-    for (i=0; i<3; i++){
-        for (N = N_MIN; N <= N_MAX; N++){
-            for (M = M_MIN; M <= M_MAX; M++){
-                double freq = calc_f_pll0clk(N,M,clocks[i]);
-                freq = calc_f_cclk(freq, D_SEL);
-                double error = (freq-desired_frequency);
-                error = error*error;
-                if (error < least_error){
-                    least_error = error;
-                    CLOCK_SEL = i;
-                    N_SEL = N;
-                    M_SEL = M;
-                    best_frequency = (int) freq;
+    for (D = D_LO; (D <= D_HI) && !done; D++){
+        // pll0clk wanted, under 2^32 for any D in range
+        uint32_t fcco = (uint32_t) desired_frequency * (D+1);
+        for (i=0; (i<3) && !done; i++){
+            uint32_t step = 2 * clocks[i];
+            uint32_t fcco_q = fcco / step;
+            uint32_t fcco_r = fcco % step;
+            for (N = N_MIN; (N <= N_MAX) && !done; N++){
+                int lo = m_lo[i][N];
+                int hi = m_hi[i][N];
+                if (lo > hi) continue;
+                
+                // M+1 either side of the exact solution fcco * (N+1) / step,
+                // as in clock_mul_div
+                uint32_t q = fcco_q * (N+1) + fcco_r * (N+1) / step;
+                int m1 = q < (uint32_t) lo ? lo : q > (uint32_t) hi ? hi : (int) q;
+                int m2 = m1 < hi && (uint32_t) m1 <= q ? m1 + 1 : m1;
+                uint32_t den = (N+1) * (D+1);
+                
+                clock_consider(&best, (uint64_t) step * m1, den,
+                    desired_frequency, i, N, m1 - 1, D, 1);
+                if (m2 != m1){
+                    clock_consider(&best, (uint64_t) step * m2, den,
+                        desired_frequency, i, N, m2 - 1, D, 1);
                 }
+                done = (best.err == 0);
             }
         }
     }
     
-    settings->val_CLKSRCSEL = CLOCK_SEL;
-    settings->val_N_factor = N_SEL;
-    settings->val_M_factor = M_SEL;
-    settings->val_D_factor = D_SEL;
-    settings->frequency = best_frequency;
-    settings->val_PLL0CON = 1;
+    // A source divided down without the PLL may still be closer
+    for (i=0; (i<3) && !done; i++){
+        D_LO = clocks[i] / desired_frequency - 1;
+        for (D = D_LO; D <= D_LO + 1; D++){
+            if (D >= D_MIN && D <= D_MAX){
+                clock_consider(&best, clocks[i], D + 1, desired_frequency,
+                    i, 0, 0, D, 0);
+            }
+        }
+    }
+    
+    settings->val_CLKSRCSEL = best.CLOCK_SEL;
+    settings->val_N_factor = best.N;
+    settings->val_M_factor = best.M;
+    settings->val_D_factor = best.D;
+    settings->val_PLL0CON = best.use_pll;
+    if (best.use_pll){
+        settings->frequency = (int) (2 * (uint64_t) clocks[best.CLOCK_SEL] *
+            (best.M+1) / best.den);
+    } else {
+        settings->frequency = clocks[best.CLOCK_SEL] / (best.D+1);
+    }
     
     return settings;        
 }
 
+// Left out when built into the host tool clock_planner.c
+#ifndef CLOCK_UTIL_HOST
+
+// Bits of PLL0STAT and SCS
+#define CLOCK_PLL0_ENABLED   (1<<24)
+#define CLOCK_PLL0_CONNECTED (1<<25)
+#define CLOCK_PLL0_PLOCK     (1<<26)
+#define CLOCK_SCS_OSCEN      (1<<5)
+#define CLOCK_SCS_OSCSTAT    (1<<6)
+
+// FLASHCFG access time field, flash accesses take FLASHTIM+1 cycles
+#define CLOCK_FLASHTIM_SHIFT 12
+#define CLOCK_FLASHTIM_SAFE  5      // Safe at any cclk
+
+// Microseconds to wait for the main oscillator and for PLL0 to lock
+#ifndef CLOCK_OSC_TIMEOUT_US
+#define CLOCK_OSC_TIMEOUT_US   10000
+#endif
+#ifndef CLOCK_PLOCK_TIMEOUT_US
+#define CLOCK_PLOCK_TIMEOUT_US 10000
+#endif
+
+// Set to 1 to print the bring-up time at boot; failures always print
+#ifndef CLOCK_REPORT_ENABLED
+#define CLOCK_REPORT_ENABLED 0
+#endif
+
+#define CLOCK_ERR_OSC   -1  // Main oscillator did not start
+#define CLOCK_ERR_PLOCK -2  // PLL0 did not lock
+#define CLOCK_ERR_PLLC  -3  // PLL0 did not connect
+
+/**
+ * Time taken by the last apply_clock_settings, in microseconds.
+ */
+typedef struct {
+    uint32_t osc_us;    // Waiting for the main oscillator
+    uint32_t lock_us;   // Waiting for PLL0 to lock
+    uint32_t total_us;  // From disconnecting PLL0 to running at speed
+    uint32_t total_ns;  // The same in nanoseconds
+    int error;          // 0, or the CLOCK_ERR_ that stopped it
+} clock_bringup;
+
+clock_bringup global_clock_bringup;
+
+// Prints global_clock_bringup
+void clock_bringup_print(){
+    const clock_bringup *stats = &global_clock_bringup;
+
+    if (stats->error){
+        printf("Clock bring-up failed (%d), running from the IRC\n",
+            stats->error);
+    } else {
+        printf("Full speed after %u us (oscillator %u us, PLL lock %u us)\n",
+            (unsigned) stats->total_us, (unsigned) stats->osc_us,
+            (unsigned) stats->lock_us);
+    }
+}
+
+/**
+ * Returns the FLASHTIM value for a cclk: one more flash cycle per 20 MHz,
+ * up to 5 cycles at 120 MHz (on the 120 MHz parts), 6 above that.
+ */
+int clock_flash_time(int frequency){
+    int tim = (frequency - 1) / 20000000;
+
+    if (tim < 0) tim = 0;
+    if (tim > 4) tim = frequency <= CLOCK_SPEED_CCLK_MAX ? 4 : CLOCK_FLASHTIM_SAFE;
+    return tim;
+}
+
+// Sets FLASHCFG's access time; its low 12 bits must keep their value
+void clock_set_flash_time(int tim){
+    LPC_SC->FLASHCFG = (LPC_SC->FLASHCFG & 0xFFF) |
+        (tim << CLOCK_FLASHTIM_SHIFT);
+}
+
+/**
+ * Returns the nanoseconds since *mark at cclk f, and moves *mark on.
+ * Works in whole kHz of cclk, exact for every source but the RTC, to
+ * keep to 32-bit division.
+ */
+static uint32_t clock_lap(uint32_t *mark, int f){
+    uint32_t now = CLOCK_DWT_CYCCNT;
+    uint32_t cycles = now - *mark;
+    uint32_t khz = (uint32_t) f / 1000;
+    uint32_t ns = (cycles / khz) * 1000000 +
+        clock_mul_div(cycles % khz * 1000, 1000, khz);
+    *mark = now;
+    return ns;
+}
+
+// Cycles of cclk f in timeout_us, rounded up; work it out before a wait
+static uint32_t clock_timeout_cycles(int f, int timeout_us){
+    return (((uint32_t) f + 999999) / 1000000) * (uint32_t) timeout_us;
+}
+
+// Returns nonzero once timeout cycles have passed since mark
+static int clock_timed_out(uint32_t mark, uint32_t timeout){
+    return CLOCK_DWT_CYCCNT - mark > timeout;
+}
+
+/**
+ * Works out the cclk actually selected from the clock registers, so a
+ * bring-up can be timed from before it touches PLL0.
+ */
+int clock_current_frequency(){
+    const int clocks[4] = {
+        CLOCK_SPEED_IRC_OSC, CLOCK_SPEED_OSC_CLK, CLOCK_SPEED_RTC_CLK,
+        CLOCK_SPEED_IRC_OSC
+    };
+    uint32_t stat = LPC_SC->PLL0STAT;
+    uint64_t f = clocks[LPC_SC->CLKSRCSEL & 3];
+
+    if ((stat & (CLOCK_PLL0_ENABLED | CLOCK_PLL0_CONNECTED)) ==
+            (CLOCK_PLL0_ENABLED | CLOCK_PLL0_CONNECTED)){
+        f = f * 2 * ((stat & 0x7FFF) + 1) / (((stat >> 16) & 0xFF) + 1);
+    }
+    return (int) (f / ((LPC_SC->CCLKCFG & 0xFF) + 1));
+}
+
+/**
+ * Counts the time since *mark at f, the cclk that was running until a
+ * change to the clocks just made, and returns the cclk running now.
+ */
+static int clock_changed(uint32_t *mark, int f){
+    global_clock_bringup.total_ns += clock_lap(mark, f);
+    return clock_current_frequency();
+}
+
 // Enables control of time.
 void PLL0_feed_sequence(){
     LPC_SC->PLL0FEED = 0xAA;
     LPC_SC->PLL0FEED = 0x55;
 }
 
-// Utility function to apply system clock settings.
-// Use carefully to avoid bricking your LPC!
-void apply_clock_settings(clock_settings *settings){
+/**
+ * Stops a failed bring-up running straight from the IRC, and rewrites
+ * settings to match, so timing worked out from them stays right.
+ */
+static int clock_fail(clock_settings *settings, int error){
+    LPC_SC->PLL0CON = 0;
+    PLL0_feed_sequence();
+    LPC_SC->CLKSRCSEL = 0;
+    LPC_SC->CCLKCFG = 0;
+    clock_set_flash_time(clock_flash_time(CLOCK_SPEED_IRC_OSC));
+
+    settings->frequency = CLOCK_SPEED_IRC_OSC;
+    settings->val_CLKSRCSEL = 0;
+    settings->val_PLL0CON = 0;
+    settings->val_D_factor = 0;
+    global_clock_bringup.error = error;
+    return error;
+}
+
+/**
+ * Utility function to apply system clock settings, following the PLL0
+ * setup sequence in the user manual. Starts the main oscillator if it
+ * is selected, waits for PLOCK before connecting PLL0, and sets the
+ * flash access time for the new cclk. The waits are timed out with the
+ * DWT cycle counter, and the time taken, from the first change to the
+ * clocks, is left in global_clock_bringup.
+ *
+ * Returns 0, or a CLOCK_ERR_ code after falling back to the IRC.
+ * Use carefully to avoid bricking your LPC!
+ */
+int apply_clock_settings(clock_settings *settings){
+    clock_bringup *stats = &global_clock_bringup;
+    uint32_t mark;
+
+#ifdef CLOCK_DEMCR
+    CLOCK_DEMCR    |= 1 << 24;  // TRCENA
+    CLOCK_DWT_CTRL |= 1;        // CYCCNTENA
+#endif
+    mark = CLOCK_DWT_CYCCNT;
+    int f = clock_current_frequency();
+    memset(stats, 0, sizeof(clock_bringup));
+
+    // Slowest flash access until the new cclk is running
+    clock_set_flash_time(CLOCK_FLASHTIM_SAFE);
 
-    if(LPC_SC->PLL0STAT & (1<<25)) { // If PLL0 is connected 
+    if(LPC_SC->PLL0STAT & CLOCK_PLL0_CONNECTED) { // If PLL0 is connected 
         LPC_SC->PLL0CON &= ~(1<<1);  // Write disconnect flag 
         PLL0_feed_sequence();        // Commit changes
+        f = clock_changed(&mark, f);
     }
         
     LPC_SC->PLL0CON &= ~(1<<0);     // Write disable flag 
     PLL0_feed_sequence();           // Commit changes
 
-    // Change CPU Divider
-    // For some reason this address is not a member of LPC_SC ?!?
-    uint32_t *D_FACTOR_ADDRESS = (uint32_t *) 0x400FC104;
-    *D_FACTOR_ADDRESS = settings->val_D_factor;
+    // Run straight from the current source while changing over
+    LPC_SC->CCLKCFG = 0;
+    f = clock_changed(&mark, f);
+
+    // Start the main oscillator (1-20 MHz range) if it is needed
+    if (settings->val_CLKSRCSEL == 1 && !(LPC_SC->SCS & CLOCK_SCS_OSCSTAT)){
+        uint32_t timeout = clock_timeout_cycles(f, CLOCK_OSC_TIMEOUT_US);
+        LPC_SC->SCS = (LPC_SC->SCS & ~(1<<4)) | CLOCK_SCS_OSCEN;
+        while (!(LPC_SC->SCS & CLOCK_SCS_OSCSTAT)){
+            if (clock_timed_out(mark, timeout)){
+                return clock_fail(settings, CLOCK_ERR_OSC);
+            }
+        }
+        uint32_t ns = clock_lap(&mark, f);
+        stats->osc_us = ns / 1000;
+        stats->total_ns += ns;
+    }
     
-    LPC_SC->CLKSRCSEL &= ~(1|2);                  // Zero out clock selector
     LPC_SC->CLKSRCSEL = settings->val_CLKSRCSEL;  // Set clock selector  
-    PLL0_feed_sequence();                         // Commit changes
+    f = clock_changed(&mark, f);
     
-    if (!settings->val_PLL0CON) return;   // If PLL is not needed, we're done.
-            
-    // Get divider values
-    int bits_M = settings->val_M_factor;
-    int bits_N = settings->val_N_factor;
-    
-    // Shift N value to necessary bits
-    bits_N = bits_N << 23;
-    
-    // Zero out divider values
-    LPC_SC->PLL0CFG &= ~((1<<15) - 1);
-    LPC_SC->PLL0CFG &= ~(((1<<17) - 1) << 23);
+    // If PLL is not needed, we're done.
+    if (!settings->val_PLL0CON){
+        LPC_SC->CCLKCFG = settings->val_D_factor;
+        f = clock_changed(&mark, f);
+        clock_set_flash_time(clock_flash_time(settings->frequency));
+        stats->total_ns += clock_lap(&mark, f);
+        stats->total_us = stats->total_ns / 1000;
+        return 0;
+    }
     
-    // Write divider values
-    LPC_SC->PLL0CFG |= bits_M;
-    LPC_SC->PLL0CFG |= bits_N;
+    // Write divider values, M in bits 14:0 and N in bits 23:16
+    LPC_SC->PLL0CFG = settings->val_M_factor | (settings->val_N_factor << 16);
     PLL0_feed_sequence(); // Commit Changes
     
     // Enable PLL0
-    LPC_SC->PLL0CON |= 1;
+    LPC_SC->PLL0CON = 1;
     PLL0_feed_sequence(); 
     
-    // Wait 500 cycles. TODO: calculate correct wait time...
-    for (int i=0; i<500; i++);
-    LPC_SC->PLL0CON |= 2;      // Set PLL0 Connect Flag 
-    PLL0_feed_sequence();      // Commit Changes    
-}
-
-
-/* // Main function for use when compiled independently.
-int main(int argc, char *argv[]){
-    if (argc != 2){
-        puts("Please specify a frequency via command line.");
-        return 0;
+    // Wait for lock
+    uint32_t timeout = clock_timeout_cycles(f, CLOCK_PLOCK_TIMEOUT_US);
+    while (!(LPC_SC->PLL0STAT & CLOCK_PLL0_PLOCK)){
+        if (clock_timed_out(mark, timeout)){
+            return clock_fail(settings, CLOCK_ERR_PLOCK);
+        }
     }
+    uint32_t ns = clock_lap(&mark, f);
+    stats->lock_us = ns / 1000;
+    stats->total_ns += ns;
     
-    int desired_freq = atoi(argv[1]);
-    
-    clock_settings *settings = calculate_clock_settings(desired_freq);
+    // The CPU divider must be set before connecting
+    LPC_SC->CCLKCFG = settings->val_D_factor;
+    f = clock_changed(&mark, f);
+    timeout = clock_timeout_cycles(f, CLOCK_PLOCK_TIMEOUT_US);
+    LPC_SC->PLL0CON = 3;       // Set PLL0 Connect Flag 
+    PLL0_feed_sequence();      // Commit Changes    
     
-    printf("Closest frequency: %d\n", settings->frequency);
-    printf("Clock: %d\n", settings->val_CLKSRCSEL);
-    printf("N: %d\n", settings->val_N_factor);
-    printf("M: %d\n", settings->val_M_factor);
-    printf("PLL0CON: %d\n", settings->val_PLL0CON);
-    printf("D: %d\n", settings->val_D_factor);
+    while ((LPC_SC->PLL0STAT & (CLOCK_PLL0_ENABLED | CLOCK_PLL0_CONNECTED)) !=
+            (CLOCK_PLL0_ENABLED | CLOCK_PLL0_CONNECTED)){
+        if (clock_timed_out(mark, timeout)){
+            return clock_fail(settings, CLOCK_ERR_PLLC);
+        }
+    }
+    f = clock_changed(&mark, f);
     
+    clock_set_flash_time(clock_flash_time(settings->frequency));
+    stats->total_ns += clock_lap(&mark, f);
+    stats->total_us = stats->total_ns / 1000;
     return 0;
-}*/
+}
+
+#endif
+
+// For a command line version, see clock_planner.c.
@@ -6,10 +6,14 @@
  * Embedded Systems
  */
 
+#ifndef CLOCK_UTIL_H
+#define CLOCK_UTIL_H
+
 // Dependancies
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include <float.h>
 
@@ -63,6 +67,17 @@ double calc_f_pll0clk(int N, int M, int f_sysclk);
 double calc_f_cclk(double f_pllclk, int D);
 
 /**
- * Calculates optimal clock settings given a desired frequency.
+ * Calculates optimal clock settings given a desired frequency, using
+ * integer arithmetic only.
  */
 clock_settings * calculate_clock_settings(int desired_frequency);
+
+// DWT cycle counter, and on target the registers that enable it. Define
+// CLOCK_DWT_CYCCNT to count something else, as a host build does.
+#ifndef CLOCK_DWT_CYCCNT
+#define CLOCK_DEMCR      (*(volatile uint32_t *) 0xE000EDFC)
+#define CLOCK_DWT_CTRL   (*(volatile uint32_t *) 0xE0001000)
+#define CLOCK_DWT_CYCCNT (*(volatile uint32_t *) 0xE0001004)
+#endif
+
+#endif
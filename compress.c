@@ -0,0 +1,215 @@
+/*
+ ==============================================
+ Name        : compress.c
+ Author      :
+ Version     :
+ Description : Payload compression for the light link. A small-window
+             : LZSS coder replaces repeated strings with back references,
+             : and messages that are pure 7-bit ASCII send literals in
+             : seven bits instead of eight. The decoder runs one byte at
+             : a time with a fixed 256 byte history window.
+             :
+             : Stream format, packed least significant bit first:
+             :   8 bits  header, COMPRESS_HEADER_ASCII for 7-bit mode
+             :   8-bit mode tokens:
+             :     0 + literal (8 bits)
+             :     1 + offset-1 (8 bits) + length-3 (4 bits)
+             :   7-bit mode tokens:
+             :     literal (7 bits, never COMPRESS_ESCAPE)
+             :     COMPRESS_ESCAPE (7 bits) + offset-1 + length-3
+ ==============================================
+ */
+
+#include <string.h>
+
+// Set to 1 to compress the payload before transmission.
+// Transmitter and receiver must agree on this setting.
+#ifndef COMPRESS_ENABLED
+#define COMPRESS_ENABLED 0
+#endif
+
+#define COMPRESS_WINDOW       256  // History size, must be a power of two
+#define COMPRESS_OFFSET_BITS  8
+#define COMPRESS_LENGTH_BITS  4
+#define COMPRESS_MIN_MATCH    3
+#define COMPRESS_MAX_MATCH    (COMPRESS_MIN_MATCH + (1 << COMPRESS_LENGTH_BITS) - 1)
+
+#define COMPRESS_HEADER_ASCII 0x01
+#define COMPRESS_ESCAPE       0x7F // Starts a back reference in 7-bit mode
+
+// Most bytes compress_decoder_push() can produce from one input byte
+#define COMPRESS_MAX_OUTPUT   (2 * COMPRESS_MAX_MATCH)
+
+// Incremental decoder state, fed one compressed byte at a time
+typedef struct {
+    char window[COMPRESS_WINDOW];  // Most recent output, for back references
+    int  window_pos;               // Total bytes output so far
+    uint32_t bits;                 // Input bits not yet consumed
+    int  num_bits;
+    int  header_seen;
+    int  ascii;                    // 7-bit mode, from the header
+} compress_decoder;
+
+// Bit writer state used by the encoder
+typedef struct {
+    char *out;
+    int out_len;
+    int pos;                       // Bits written so far
+} compress_writer;
+
+int compress_write_bits(compress_writer *w, int value, int num_bits){
+    int i;
+
+    if ((w->pos + num_bits + 7) / 8 > w->out_len) return -1;
+    for (i = 0; i < num_bits; i++, w->pos++){
+        if (w->pos % 8 == 0) w->out[w->pos/8] = 0;
+        if ((value >> i) & 1){
+            w->out[w->pos/8] |= (char)(1 << (w->pos % 8));
+        }
+    }
+    return 0;
+}
+
+// Writes the prefix that starts a literal or a back reference
+int compress_write_prefix(compress_writer *w, int ascii, int match){
+    if (ascii){
+        return match ? compress_write_bits(w, COMPRESS_ESCAPE, 7) : 0;
+    }
+    return compress_write_bits(w, match, 1);
+}
+
+/*
+ * Compresses len bytes of data into out. Returns the number of bytes
+ * written, or -1 if out_len is too small.
+ */
+int compress_encode(const char *data, int len, char *out, int out_len){
+    compress_writer w;
+    int ascii = 1;
+    int i, pos;
+
+    w.out = out;
+    w.out_len = out_len;
+    w.pos = 0;
+
+    for (i = 0; i < len; i++){
+        if ((unsigned char) data[i] >= COMPRESS_ESCAPE){
+            ascii = 0;
+        }
+    }
+    if (compress_write_bits(&w, ascii ? COMPRESS_HEADER_ASCII : 0, 8)){
+        return -1;
+    }
+
+    pos = 0;
+    while (pos < len){
+        int best_len = 0;
+        int best_offset = 0;
+        int start = pos - COMPRESS_WINDOW;
+        int cand;
+
+        if (start < 0) start = 0;
+
+        // Greedy search for the longest match in the window
+        for (cand = pos - 1; cand >= start; cand--){
+            int n = 0;
+            while (n < COMPRESS_MAX_MATCH && pos + n < len &&
+                    data[cand + n] == data[pos + n]){
+                n++;
+            }
+            if (n > best_len){
+                best_len = n;
+                best_offset = pos - cand;
+                if (n == COMPRESS_MAX_MATCH) break;
+            }
+        }
+
+        if (best_len >= COMPRESS_MIN_MATCH){
+            if (compress_write_prefix(&w, ascii, 1) ||
+                compress_write_bits(&w, best_offset - 1, COMPRESS_OFFSET_BITS) ||
+                compress_write_bits(&w, best_len - COMPRESS_MIN_MATCH,
+                    COMPRESS_LENGTH_BITS)) return -1;
+            pos += best_len;
+        } else {
+            if (compress_write_prefix(&w, ascii, 0) ||
+                compress_write_bits(&w, (unsigned char) data[pos],
+                    ascii ? 7 : 8)) return -1;
+            pos++;
+        }
+    }
+    return (w.pos + 7) / 8;
+}
+
+void compress_decoder_init(compress_decoder *dec){
+    memset(dec, 0, sizeof(compress_decoder));
+}
+
+// Appends one byte to the output and the history window
+void compress_decoder_emit(compress_decoder *dec, char byte, char *out, int *num_out){
+    dec->window[dec->window_pos & (COMPRESS_WINDOW - 1)] = byte;
+    dec->window_pos++;
+    out[(*num_out)++] = byte;
+}
+
+/*
+ * Feeds one compressed byte to the decoder and writes any completed
+ * output bytes to out, which must hold COMPRESS_MAX_OUTPUT bytes.
+ * Returns the number of bytes written. Trailing padding bits decode
+ * as nothing until another full token arrives.
+ */
+int compress_decoder_push(compress_decoder *dec, char byte, char *out){
+    int num_out = 0;
+
+    if (!dec->header_seen){
+        dec->header_seen = 1;
+        dec->ascii = byte & COMPRESS_HEADER_ASCII;
+        return 0;
+    }
+
+    dec->bits |= ((uint32_t)(unsigned char) byte) << dec->num_bits;
+    dec->num_bits += 8;
+
+    while (dec->num_bits > 0){
+        int prefix, offset, length;
+
+        if (dec->ascii){
+            if (dec->num_bits < 7) break;
+            if ((dec->bits & 0x7F) != COMPRESS_ESCAPE){
+                compress_decoder_emit(dec, (char)(dec->bits & 0x7F),
+                    out, &num_out);
+                dec->bits >>= 7;
+                dec->num_bits -= 7;
+                continue;
+            }
+            prefix = 7;
+        } else {
+            if (!(dec->bits & 1)){
+                if (dec->num_bits < 9) break;
+                compress_decoder_emit(dec, (char)(dec->bits >> 1),
+                    out, &num_out);
+                dec->bits >>= 9;
+                dec->num_bits -= 9;
+                continue;
+            }
+            prefix = 1;
+        }
+
+        // Back reference
+        if (dec->num_bits < prefix + COMPRESS_OFFSET_BITS + COMPRESS_LENGTH_BITS){
+            break;
+        }
+        dec->bits >>= prefix;
+        offset = (dec->bits & ((1 << COMPRESS_OFFSET_BITS) - 1)) + 1;
+        dec->bits >>= COMPRESS_OFFSET_BITS;
+        length = (dec->bits & ((1 << COMPRESS_LENGTH_BITS) - 1)) + COMPRESS_MIN_MATCH;
+        dec->bits >>= COMPRESS_LENGTH_BITS;
+        dec->num_bits -= prefix + COMPRESS_OFFSET_BITS + COMPRESS_LENGTH_BITS;
+
+        // Ignore references to history we never received
+        if (offset > dec->window_pos) continue;
+        while (length-- > 0){
+            int from = (dec->window_pos - offset) & (COMPRESS_WINDOW - 1);
+            compress_decoder_emit(dec, dec->window[from], out, &num_out);
+        }
+    }
+    return num_out;
+}
@@ -0,0 +1,155 @@
+/*
+ ==============================================
+ Name        : fec.c
+ Author      :
+ Version     :
+ Description : Forward error correction for the light link. Each data
+             : nibble is sent as an extended Hamming(8,4) codeword, which
+             : corrects any single bit error and detects double errors.
+             : Codewords are grouped into blocks of eight and transposed
+             : before transmission, so a burst of up to eight consecutive
+             : bad bits only touches one bit of each codeword.
+ ==============================================
+ */
+
+#include <string.h>
+
+// Set to 1 to send the payload with error correction. The receivers in
+// src_receive and src_adc decode plain frames only, so it is off by
+// default. Transmitter and receiver must agree on this setting.
+#ifndef FEC_ENABLED
+#define FEC_ENABLED 0
+#endif
+
+// Interleaver block: eight codewords on the wire carry four data bytes
+#define FEC_BLOCK_BYTES 8
+#define FEC_DATA_BYTES  (FEC_BLOCK_BYTES/2)
+
+// Decode table flags
+#define FEC_CORRECTED     0x10
+#define FEC_UNCORRECTABLE 0x20
+
+// Codeword layout: bits 0-3 data, bits 4-6 Hamming parity, bit 7 overall parity
+const unsigned char fec_encode_table[16] = {
+    0x00, 0xB1, 0xD2, 0x63, 0xE4, 0x55, 0x36, 0x87,
+    0x78, 0xC9, 0xAA, 0x1B, 0x9C, 0x2D, 0x4E, 0xFF
+};
+
+// Received codeword -> data nibble, plus FEC_CORRECTED when a single bit
+// was repaired or FEC_UNCORRECTABLE when two bits were flipped.
+const unsigned char fec_decode_table[256] = {
+    0x00, 0x10, 0x10, 0x20, 0x10, 0x20, 0x20, 0x17,
+    0x10, 0x20, 0x20, 0x1B, 0x20, 0x1D, 0x1E, 0x20,
+    0x10, 0x20, 0x20, 0x1B, 0x20, 0x15, 0x16, 0x20,
+    0x20, 0x1B, 0x1B, 0x0B, 0x1C, 0x20, 0x20, 0x1B,
+    0x10, 0x20, 0x20, 0x13, 0x20, 0x1D, 0x16, 0x20,
+    0x20, 0x1D, 0x1A, 0x20, 0x1D, 0x0D, 0x20, 0x1D,
+    0x20, 0x11, 0x16, 0x20, 0x16, 0x20, 0x06, 0x16,
+    0x18, 0x20, 0x20, 0x1B, 0x20, 0x1D, 0x16, 0x20,
+    0x10, 0x20, 0x20, 0x13, 0x20, 0x15, 0x1E, 0x20,
+    0x20, 0x19, 0x1E, 0x20, 0x1E, 0x20, 0x0E, 0x1E,
+    0x20, 0x15, 0x12, 0x20, 0x15, 0x05, 0x20, 0x15,
+    0x18, 0x20, 0x20, 0x1B, 0x20, 0x15, 0x1E, 0x20,
+    0x20, 0x13, 0x13, 0x03, 0x14, 0x20, 0x20, 0x13,
+    0x18, 0x20, 0x20, 0x13, 0x20, 0x1D, 0x1E, 0x20,
+    0x18, 0x20, 0x20, 0x13, 0x20, 0x15, 0x16, 0x20,
+    0x08, 0x18, 0x18, 0x20, 0x18, 0x20, 0x20, 0x1F,
+    0x10, 0x20, 0x20, 0x17, 0x20, 0x17, 0x17, 0x07,
+    0x20, 0x19, 0x1A, 0x20, 0x1C, 0x20, 0x20, 0x17,
+    0x20, 0x11, 0x12, 0x20, 0x1C, 0x20, 0x20, 0x17,
+    0x1C, 0x20, 0x20, 0x1B, 0x0C, 0x1C, 0x1C, 0x20,
+    0x20, 0x11, 0x1A, 0x20, 0x14, 0x20, 0x20, 0x17,
+    0x1A, 0x20, 0x0A, 0x1A, 0x20, 0x1D, 0x1A, 0x20,
+    0x11, 0x01, 0x20, 0x11, 0x20, 0x11, 0x16, 0x20,
+    0x20, 0x11, 0x1A, 0x20, 0x1C, 0x20, 0x20, 0x1F,
+    0x20, 0x19, 0x12, 0x20, 0x14, 0x20, 0x20, 0x17,
+    0x19, 0x09, 0x20, 0x19, 0x20, 0x19, 0x1E, 0x20,
+    0x12, 0x20, 0x02, 0x12, 0x20, 0x15, 0x12, 0x20,
+    0x20, 0x19, 0x12, 0x20, 0x1C, 0x20, 0x20, 0x1F,
+    0x14, 0x20, 0x20, 0x13, 0x04, 0x14, 0x14, 0x20,
+    0x20, 0x19, 0x1A, 0x20, 0x14, 0x20, 0x20, 0x1F,
+    0x20, 0x11, 0x12, 0x20, 0x14, 0x20, 0x20, 0x1F,
+    0x18, 0x20, 0x20, 0x1F, 0x20, 0x1F, 0x1F, 0x0F
+};
+
+// Incremental decoder state, fed one received byte at a time
+typedef struct {
+    unsigned char block[FEC_BLOCK_BYTES];
+    int block_pos;
+    int num_corrected;       // Codewords repaired since init
+    int num_uncorrectable;   // Codewords with double errors since init
+} fec_decoder;
+
+/*
+ * Transposes an 8x8 bit matrix in place, so that bit i of byte j
+ * becomes bit j of byte i. The interleaver is its own inverse.
+ */
+void fec_transpose(unsigned char *block){
+    unsigned char out[FEC_BLOCK_BYTES];
+    int i, j;
+
+    memset(out, 0, FEC_BLOCK_BYTES);
+    for (j = 0; j < FEC_BLOCK_BYTES; j++){
+        for (i = 0; i < 8; i++){
+            if (block[j] & (1 << i)){
+                out[i] |= (unsigned char)(1 << j);
+            }
+        }
+    }
+    memcpy(block, out, FEC_BLOCK_BYTES);
+}
+
+/*
+ * Encodes len bytes of data into out, padding the last block with zero
+ * bytes. Returns the number of bytes written, or -1 if out_len is too
+ * small to hold the encoded message.
+ */
+int fec_encode(const char *data, int len, char *out, int out_len){
+    int blocks = (len + FEC_DATA_BYTES - 1) / FEC_DATA_BYTES;
+    int b, i;
+
+    if (blocks * FEC_BLOCK_BYTES > out_len) return -1;
+
+    for (b = 0; b < blocks; b++){
+        unsigned char *block = (unsigned char *) &out[b * FEC_BLOCK_BYTES];
+        for (i = 0; i < FEC_DATA_BYTES; i++){
+            int pos = b * FEC_DATA_BYTES + i;
+            unsigned char byte = (pos < len) ? (unsigned char) data[pos] : 0;
+            block[2*i]     = fec_encode_table[byte & 0x0F];
+            block[2*i + 1] = fec_encode_table[byte >> 4];
+        }
+        fec_transpose(block);
+    }
+    return blocks * FEC_BLOCK_BYTES;
+}
+
+void fec_decoder_init(fec_decoder *dec){
+    memset(dec, 0, sizeof(fec_decoder));
+}
+
+/*
+ * Feeds one received byte to the decoder. When the byte completes an
+ * interleaver block, the block is corrected, FEC_DATA_BYTES bytes are
+ * written to out, and FEC_DATA_BYTES is returned. Otherwise returns 0.
+ */
+int fec_decoder_push(fec_decoder *dec, char byte, char *out){
+    int i;
+
+    dec->block[dec->block_pos++] = (unsigned char) byte;
+    if (dec->block_pos < FEC_BLOCK_BYTES) return 0;
+    dec->block_pos = 0;
+
+    fec_transpose(dec->block);
+    for (i = 0; i < FEC_DATA_BYTES; i++){
+        unsigned char lo = fec_decode_table[dec->block[2*i]];
+        unsigned char hi = fec_decode_table[dec->block[2*i + 1]];
+
+        if (lo & FEC_CORRECTED)     dec->num_corrected++;
+        if (hi & FEC_CORRECTED)     dec->num_corrected++;
+        if (lo & FEC_UNCORRECTABLE) dec->num_uncorrectable++;
+        if (hi & FEC_UNCORRECTABLE) dec->num_uncorrectable++;
+
+        out[i] = (char)((lo & 0x0F) | ((hi & 0x0F) << 4));
+    }
+    return FEC_DATA_BYTES;
+}
@@ -0,0 +1,215 @@
+/*
+ ==============================================
+ Name        : framebuffer.c
+ Author      :
+ Version     :
+ Description : Double-buffered framebuffer for a chain of SN74HC164N
+             : shift registers, each driving one 8-LED column, and a text
+             : renderer that scrolls a message across the chain from a
+             : 5x7 font in flash. The main loop renders into the back
+             : buffer and asks for a swap; the timer ISR only shifts the
+             : front buffer out, and only when it has changed.
+ ==============================================
+ */
+
+#include <string.h>
+
+// Set to 1 to scroll received messages across a register chain
+#ifndef FRAMEBUFFER_ENABLED
+#define FRAMEBUFFER_ENABLED 0
+#endif
+
+// Registers in the chain; column 0 is the one wired to the LPC
+#ifndef FRAMEBUFFER_COLUMNS
+#define FRAMEBUFFER_COLUMNS 8
+#endif
+
+// Font glyph size, and the blank column between characters
+#define FONT_WIDTH   5
+#define FONT_SPACING 1
+#define FONT_FIRST   ' '
+#define FONT_LAST    '~'
+
+/*
+ * 5x7 font for printable ASCII, one byte per column, bit 0 at the top.
+ * Bit 0 of a column byte ends up on the register's QA output.
+ */
+const unsigned char framebuffer_font[FONT_LAST - FONT_FIRST + 1][FONT_WIDTH] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, // ' ' !
+    {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7F,0x14,0x7F,0x14}, // " #
+    {0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62}, // $ %
+    {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00}, // & '
+    {0x00,0x1C,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1C,0x00}, // ( )
+    {0x08,0x2A,0x1C,0x2A,0x08}, {0x08,0x08,0x3E,0x08,0x08}, // * +
+    {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08}, // , -
+    {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02}, // . /
+    {0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00}, // 0 1
+    {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4B,0x31}, // 2 3
+    {0x18,0x14,0x12,0x7F,0x10}, {0x27,0x45,0x45,0x45,0x39}, // 4 5
+    {0x3C,0x4A,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03}, // 6 7
+    {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1E}, // 8 9
+    {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00}, // : ;
+    {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14}, // < =
+    {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06}, // > ?
+    {0x32,0x49,0x79,0x41,0x3E}, {0x7E,0x11,0x11,0x11,0x7E}, // @ A
+    {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22}, // B C
+    {0x7F,0x41,0x41,0x22,0x1C}, {0x7F,0x49,0x49,0x49,0x41}, // D E
+    {0x7F,0x09,0x09,0x01,0x01}, {0x3E,0x41,0x41,0x51,0x32}, // F G
+    {0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00}, // H I
+    {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41}, // J K
+    {0x7F,0x40,0x40,0x40,0x40}, {0x7F,0x02,0x04,0x02,0x7F}, // L M
+    {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E}, // N O
+    {0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, // P Q
+    {0x7F,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31}, // R S
+    {0x01,0x01,0x7F,0x01,0x01}, {0x3F,0x40,0x40,0x40,0x3F}, // T U
+    {0x1F,0x20,0x40,0x20,0x1F}, {0x7F,0x20,0x18,0x20,0x7F}, // V W
+    {0x63,0x14,0x08,0x14,0x63}, {0x03,0x04,0x78,0x04,0x03}, // X Y
+    {0x61,0x51,0x49,0x45,0x43}, {0x00,0x00,0x7F,0x41,0x41}, // Z [
+    {0x02,0x04,0x08,0x10,0x20}, {0x41,0x41,0x7F,0x00,0x00}, // \ ]
+    {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40}, // ^ _
+    {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78}, // ` a
+    {0x7F,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20}, // b c
+    {0x38,0x44,0x44,0x48,0x7F}, {0x38,0x54,0x54,0x54,0x18}, // d e
+    {0x08,0x7E,0x09,0x01,0x02}, {0x08,0x14,0x54,0x54,0x3C}, // f g
+    {0x7F,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7D,0x40,0x00}, // h i
+    {0x20,0x40,0x44,0x3D,0x00}, {0x00,0x7F,0x10,0x28,0x44}, // j k
+    {0x00,0x41,0x7F,0x40,0x00}, {0x7C,0x04,0x18,0x04,0x78}, // l m
+    {0x7C,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38}, // n o
+    {0x7C,0x14,0x14,0x14,0x08}, {0x08,0x14,0x14,0x18,0x7C}, // p q
+    {0x7C,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20}, // r s
+    {0x04,0x3F,0x44,0x40,0x20}, {0x3C,0x40,0x40,0x20,0x7C}, // t u
+    {0x1C,0x20,0x40,0x20,0x1C}, {0x3C,0x40,0x30,0x40,0x3C}, // v w
+    {0x44,0x28,0x10,0x28,0x44}, {0x0C,0x50,0x50,0x50,0x3C}, // x y
+    {0x44,0x64,0x54,0x4C,0x44}, {0x00,0x08,0x36,0x41,0x00}, // z {
+    {0x00,0x00,0x7F,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00}, // | }
+    {0x08,0x04,0x08,0x10,0x08}                              // ~
+};
+
+typedef struct {
+    unsigned char buffers[2][FRAMEBUFFER_COLUMNS];
+    volatile int front;         // Buffer on display, swapped by the ISR
+    volatile int swap_pending;  // Back buffer is ready, set by the main loop
+    int shifting;               // ISR is part way through the front buffer
+    int shift_pos;              // Bytes sent by SSP, or bit-bang substeps
+    int num_frames_shown;
+} framebuffer;
+
+// Scrolls a message through the framebuffer one column at a time
+typedef struct {
+    const char *text;
+    int num_columns;            // Blank lead-in plus the rendered text
+    int offset;                 // First strip column on display
+    int interval;               // Ticks between scroll steps
+    int last_time;
+} text_scroller;
+
+void framebuffer_init(framebuffer *fb){
+    memset(fb, 0, sizeof(framebuffer));
+}
+
+/*
+ * Returns the buffer to render into. Only valid while no swap is
+ * pending; check framebuffer_ready first.
+ */
+unsigned char *framebuffer_back(framebuffer *fb){
+    return fb->buffers[fb->front ^ 1];
+}
+
+int framebuffer_ready(framebuffer *fb){
+    return !fb->swap_pending;
+}
+
+// Hands the back buffer to the ISR, which shows it after any frame in flight
+void framebuffer_swap(framebuffer *fb){
+    __DMB();
+    fb->swap_pending = 1;
+}
+
+/*
+ * Shifts the front buffer into the chain, column FRAMEBUFFER_COLUMNS - 1
+ * first so each byte lands in its own register. With an SSP port the
+ * whole frame is queued at once, otherwise one substep is bit-banged per
+ * call. Nothing is sent until a new frame is swapped in. Call from the
+ * timer ISR.
+ */
+void framebuffer_step(framebuffer *fb, SN74HC164N_state *sreg){
+    const unsigned char *front;
+
+    if (!fb->shifting){
+        if (!fb->swap_pending) return;
+        fb->front ^= 1;
+        fb->swap_pending = 0;
+        fb->shifting  = 1;
+        fb->shift_pos = 0;
+    }
+    front = fb->buffers[fb->front];
+
+    if (sreg->reg_ssp_data){
+        while (fb->shift_pos < FRAMEBUFFER_COLUMNS &&
+                (*sreg->reg_ssp_status & SN74HC164N_SSP_TNF)){
+            *sreg->reg_ssp_data = front[FRAMEBUFFER_COLUMNS - 1 - fb->shift_pos++];
+        }
+        if (fb->shift_pos < FRAMEBUFFER_COLUMNS) return;
+    } else {
+        int bit = fb->shift_pos / 4;
+        int column = FRAMEBUFFER_COLUMNS - 1 - bit / 8;
+        SN74HC164N_substep(sreg, fb->shift_pos % 4,
+            (front[column] >> (7 - bit % 8)) & 1);
+        if (++fb->shift_pos < FRAMEBUFFER_COLUMNS * 32) return;
+    }
+    fb->shifting = 0;
+    fb->num_frames_shown++;
+}
+
+// Returns the font column for strip column n of text, blank between glyphs
+unsigned char framebuffer_text_column(const char *text, int n){
+    int c = text[n / (FONT_WIDTH + FONT_SPACING)];
+    int x = n % (FONT_WIDTH + FONT_SPACING);
+
+    if (x >= FONT_WIDTH || c < FONT_FIRST || c > FONT_LAST) return 0;
+    return framebuffer_font[c - FONT_FIRST][x];
+}
+
+/*
+ * Renders the part of a scrolling strip starting at offset into buf. The
+ * strip is FRAMEBUFFER_COLUMNS blank columns, so the text enters from
+ * the far end of the chain, followed by the text itself.
+ */
+void framebuffer_render_text(unsigned char *buf, const char *text,
+        int num_columns, int offset){
+    int c;
+
+    for (c = 0; c < FRAMEBUFFER_COLUMNS; c++){
+        int n = (offset + c) % num_columns - FRAMEBUFFER_COLUMNS;
+        buf[c] = n < 0 ? 0 : framebuffer_text_column(text, n);
+    }
+}
+
+void text_scroller_start(text_scroller *scroller, const char *text,
+        int interval, int time){
+    scroller->text        = text;
+    scroller->num_columns = FRAMEBUFFER_COLUMNS +
+        strlen(text) * (FONT_WIDTH + FONT_SPACING);
+    scroller->offset      = 0;
+    scroller->interval    = interval;
+    scroller->last_time   = time - interval;
+}
+
+/*
+ * Renders and swaps in the next scroll position once interval ticks have
+ * passed and the back buffer is free. Call from the main loop. Returns 1
+ * if a frame was rendered.
+ */
+int text_scroller_step(text_scroller *scroller, framebuffer *fb, int time){
+    if (scroller->text == NULL) return 0;
+    if (time - scroller->last_time < scroller->interval) return 0;
+    if (!framebuffer_ready(fb)) return 0;
+
+    framebuffer_render_text(framebuffer_back(fb), scroller->text,
+        scroller->num_columns, scroller->offset);
+    framebuffer_swap(fb);
+
+    scroller->offset = (scroller->offset + 1) % scroller->num_columns;
+    scroller->last_time = time;
+    return 1;
+}
@@ -0,0 +1,171 @@
+/*
+ ==============================================
+ Name        : jitter.c
+ Author      :
+ Version     :
+ Description : Transmit timing self-measurement. The LED output is looped
+             : back into a timer capture input, which timestamps every
+             : edge in hardware. The capture ISR only queues timestamps;
+             : the main loop turns them into bit period statistics and a
+             : histogram of how far each edge landed from its ideal time.
+ ==============================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+// Capture timestamps waiting for the main loop, a power of two
+#define JITTER_EDGE_QUEUE_LEN 64
+
+// Histogram of edge error, centred on zero
+#define JITTER_HISTOGRAM_BINS 16
+
+// Edge timestamps from the capture ISR
+typedef struct {
+    uint32_t edges[JITTER_EDGE_QUEUE_LEN];
+    volatile uint32_t head;     // Written by the capture ISR only
+    volatile uint32_t tail;     // Written by the main loop only
+    volatile uint32_t num_dropped;
+} jitter_edge_queue;
+
+typedef struct {
+    uint32_t nominal;           // Ideal bit period, in capture ticks
+    int bin_width;              // Ticks of edge error per histogram bin
+
+    uint32_t last_edge;
+    uint32_t ideal_edge;        // Ideal time of the last edge
+    int have_last;
+
+    uint32_t num_edges;
+    uint32_t num_bits;          // Bit periods covered by the edges seen
+    uint32_t min_period;        // Shortest and longest single bit periods,
+    uint32_t max_period;        // from intervals that span one bit
+    uint64_t total_ticks;       // Sum of all edge intervals
+
+    // Edge error: each edge's offset from its ideal time, a whole number
+    // of bit periods after the first edge of its frame
+    int min_error;
+    int max_error;
+    uint32_t histogram[JITTER_HISTOGRAM_BINS];
+    uint32_t num_outliers;      // Errors beyond the histogram range
+} jitter_stats;
+
+void jitter_edge_queue_init(jitter_edge_queue *queue){
+    memset(queue, 0, sizeof(jitter_edge_queue));
+}
+
+// Records an edge timestamp. Call from the capture ISR.
+void jitter_edge_push(jitter_edge_queue *queue, uint32_t timestamp){
+    uint32_t head = queue->head;
+
+    if (head - queue->tail >= JITTER_EDGE_QUEUE_LEN){
+        queue->num_dropped++;
+        return;
+    }
+    queue->edges[head % JITTER_EDGE_QUEUE_LEN] = timestamp;
+    queue->head = head + 1;
+}
+
+// Takes the oldest timestamp. Returns 0 if none are waiting.
+int jitter_edge_pop(jitter_edge_queue *queue, uint32_t *timestamp){
+    uint32_t tail = queue->tail;
+
+    if (tail == queue->head) return 0;
+    *timestamp = queue->edges[tail % JITTER_EDGE_QUEUE_LEN];
+    queue->tail = tail + 1;
+    return 1;
+}
+
+void jitter_stats_init(jitter_stats *stats, uint32_t nominal, int bin_width){
+    memset(stats, 0, sizeof(jitter_stats));
+    stats->nominal    = nominal;
+    stats->bin_width  = bin_width > 0 ? bin_width : 1;
+    stats->min_period = 0xFFFFFFFF;
+}
+
+/*
+ * Adds one edge. The interval since the previous edge covers a whole
+ * number of bits (runs of equal bits have no edges between them), found
+ * by rounding to the nominal period. The ideal edge time moves on by the
+ * same whole number of periods from the last ideal time, so errors build
+ * up across a frame rather than cancel between neighbours; the first
+ * edge of each frame sets the ideal times for the rest. Timestamps may
+ * wrap around.
+ */
+void jitter_add_edge(jitter_stats *stats, uint32_t timestamp){
+    uint32_t interval, bits;
+    int error, bin;
+
+    stats->num_edges++;
+    if (!stats->have_last){
+        stats->have_last = 1;
+        stats->last_edge = stats->ideal_edge = timestamp;
+        return;
+    }
+    interval = timestamp - stats->last_edge;
+    stats->last_edge = timestamp;
+
+    // Gaps between frames are not bit periods; the next frame starts afresh
+    bits = (interval + stats->nominal / 2) / stats->nominal;
+    if (bits > 16){
+        stats->ideal_edge = timestamp;
+        return;
+    }
+    if (bits == 0) return;
+
+    stats->num_bits    += bits;
+    stats->total_ticks += interval;
+    if (bits == 1){
+        if (interval < stats->min_period) stats->min_period = interval;
+        if (interval > stats->max_period) stats->max_period = interval;
+    }
+
+    // Nearest ideal edge time after the last one
+    uint32_t offset = timestamp - stats->ideal_edge;
+    stats->ideal_edge += (offset + stats->nominal / 2) / stats->nominal *
+        stats->nominal;
+    error = (int)(timestamp - stats->ideal_edge);
+    if (error < stats->min_error) stats->min_error = error;
+    if (error > stats->max_error) stats->max_error = error;
+
+    // Bin 8 covers [0, bin_width), bin 7 covers [-bin_width, 0)
+    bin = error >= 0 ? error / stats->bin_width
+                     : -((-error - 1) / stats->bin_width) - 1;
+    bin += JITTER_HISTOGRAM_BINS / 2;
+    if (bin < 0 || bin >= JITTER_HISTOGRAM_BINS){
+        stats->num_outliers++;
+    } else {
+        stats->histogram[bin]++;
+    }
+}
+
+// Feeds every queued timestamp to the statistics. Call from the main loop.
+void jitter_drain(jitter_edge_queue *queue, jitter_stats *stats){
+    uint32_t timestamp;
+    while (jitter_edge_pop(queue, &timestamp)){
+        jitter_add_edge(stats, timestamp);
+    }
+}
+
+// Mean bit period in capture ticks, or 0 before any bit has been timed
+uint32_t jitter_mean_period(const jitter_stats *stats){
+    if (stats->num_bits == 0) return 0;
+    return (uint32_t)(stats->total_ticks / stats->num_bits);
+}
+
+void jitter_print(const jitter_stats *stats){
+    int i;
+
+    printf("edges %lu bits %lu period min %lu mean %lu max %lu ticks\n",
+        (unsigned long) stats->num_edges, (unsigned long) stats->num_bits,
+        (unsigned long) stats->min_period,
+        (unsigned long) jitter_mean_period(stats),
+        (unsigned long) stats->max_period);
+    printf("edge error %d to %d ticks, %lu outliers\n",
+        stats->min_error, stats->max_error,
+        (unsigned long) stats->num_outliers);
+    for (i = 0; i < JITTER_HISTOGRAM_BINS; i++){
+        printf("%6d: %lu\n", (i - JITTER_HISTOGRAM_BINS / 2) * stats->bin_width,
+            (unsigned long) stats->histogram[i]);
+    }
+}
@@ -0,0 +1,115 @@
+/*
+ ==============================================
+ Name        : linecode.c
+ Author      :
+ Version     :
+ Description : 4B5B/NRZI line coding for the light link. Each nibble is
+             : sent as a 5-bit symbol with at most three consecutive
+             : zeros, and NRZI turns every 1 into a level change, so the
+             : line toggles at least once every four bit periods. The
+             : receiver uses those edges to stay in phase for the whole
+             : frame at a cost of 25% extra bits (80% efficiency).
+ ==============================================
+ */
+
+#include <string.h>
+
+// Set to 1 to send the payload as 4B5B/NRZI instead of plain NRZ. The
+// receivers in src_receive and src_adc decode plain NRZ only, so it is
+// off by default. Transmitter and receiver must agree on this setting.
+#ifndef LINE_CODE_ENABLED
+#define LINE_CODE_ENABLED 0
+#endif
+
+#define LINE_CODE_SYMBOL_BITS 5
+#define LINE_CODE_INVALID     0xFF
+
+// Nibble -> 4B5B symbol, sent most significant bit first
+const unsigned char linecode_encode_table[16] = {
+    0x1E, 0x09, 0x14, 0x15, 0x0A, 0x0B, 0x0E, 0x0F,
+    0x12, 0x13, 0x16, 0x17, 0x1A, 0x1B, 0x1C, 0x1D
+};
+
+// 4B5B symbol -> nibble, or LINE_CODE_INVALID for unused symbols
+const unsigned char linecode_decode_table[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x01, 0x04, 0x05, 0xFF, 0xFF, 0x06, 0x07,
+    0xFF, 0xFF, 0x08, 0x09, 0x02, 0x03, 0x0A, 0x0B,
+    0xFF, 0xFF, 0x0C, 0x0D, 0x0E, 0x0F, 0x00, 0xFF
+};
+
+// Incremental decoder state, fed one sampled line level at a time
+typedef struct {
+    int level;          // Line level of the previous bit period
+    int symbol;         // Symbol bits collected so far
+    int symbol_bits;
+    int byte;           // Nibbles collected so far
+    int nibbles;
+    int num_invalid;    // Invalid symbols since init
+} linecode_decoder;
+
+/*
+ * Encodes len bytes into a packed stream of line levels, least
+ * significant bit of each output byte first. level is the line level
+ * preceding the payload. Returns the number of line bits written, or -1
+ * if out_len is too small.
+ */
+int linecode_encode(const char *data, int len, char *out, int out_len, int level){
+    int num_bits = len * 2 * LINE_CODE_SYMBOL_BITS;
+    int pos = 0;
+    int i, n, b;
+
+    if ((num_bits + 7) / 8 > out_len) return -1;
+    memset(out, 0, (num_bits + 7) / 8);
+
+    for (i = 0; i < len; i++){
+        for (n = 0; n < 2; n++){
+            int nibble = ((unsigned char) data[i] >> (4*n)) & 0x0F;
+            int symbol = linecode_encode_table[nibble];
+            for (b = LINE_CODE_SYMBOL_BITS - 1; b >= 0; b--){
+                if ((symbol >> b) & 1){
+                    level = !level;
+                }
+                if (level){
+                    out[pos/8] |= (char)(1 << (pos%8));
+                }
+                pos++;
+            }
+        }
+    }
+    return num_bits;
+}
+
+void linecode_decoder_init(linecode_decoder *dec, int level){
+    memset(dec, 0, sizeof(linecode_decoder));
+    dec->level = level;
+}
+
+/*
+ * Feeds one sampled line level to the decoder. Returns 1 and writes the
+ * byte to out once two symbols have been received, otherwise returns 0.
+ * Invalid symbols decode as zero nibbles and are counted.
+ */
+int linecode_decoder_push(linecode_decoder *dec, int level, char *out){
+    int nibble;
+
+    dec->symbol = (dec->symbol << 1) | (level != dec->level);
+    dec->level  = level;
+    if (++dec->symbol_bits < LINE_CODE_SYMBOL_BITS) return 0;
+
+    nibble = linecode_decode_table[dec->symbol];
+    if (nibble == LINE_CODE_INVALID){
+        dec->num_invalid++;
+        nibble = 0;
+    }
+    dec->symbol = 0;
+    dec->symbol_bits = 0;
+
+    dec->byte |= nibble << (4 * dec->nibbles);
+    if (++dec->nibbles < 2) return 0;
+
+    *out = (char) dec->byte;
+    dec->byte = 0;
+    dec->nibbles = 0;
+    return 1;
+}
@@ -24,8 +24,22 @@
 #include <math.h>
 
 #include "SN74HC164N.c" // Support for the SN74HC164N Shift Register
+#include "framebuffer.c" // Shift Register Chain Framebuffer
+#include "bcm.c"        // Shift Register Brightness Control
 #include "clock_util.c" // Clock Utility
+#include "clock_presets.h" // Clock Settings, generated by clock_planner.c
+#include "peripheral_clock.c" // Peripheral Clock and Timer Planner
+#include "clock_scaling.c" // Runtime Clock Scaling
+#include "clock_measure.c" // cclk Measurement Against the RTC
+#include "compress.c"   // Payload Compression
+#include "fec.c"        // Forward Error Correction
+#include "linecode.c"   // 4B5B Line Coding
+#include "pam4.c"       // PAM-4 Symbol Mapping
+#include "pwm_carrier.c" // PWM Carrier Modulation
 #include "receive.c"    // Receive Utility
+#include "transmit.c"   // Frame Transmitter, for acks on the return path
+#include "arq.c"        // Selective-Repeat ARQ
+#include "rate.c"       // Bit Rate Adaptation
 
 // Variable to store CRP value in. Will be placed automatically
 // by the linker when "Enable Code Read Protect" selected.
@@ -34,20 +48,132 @@ __CRP const unsigned int CRP_WORD = CRP_NO_CRP;
 
 // Pins 9, 8, and 7 will control the shift register.
 #define SREG_CLR   8
+#if SN74HC164N_SSP_ENABLED
+#define SREG_CLOCK 7  // SCK1
+#define SREG_A     9  // MOSI1
+#else
 #define SREG_CLOCK 9
 #define SREG_A     7
+#endif
+
+// The fixed driver must be built for the same port 0 pins
+#if SN74HC164N_FIXED_ENABLED && \
+    (SN74HC164N_FIXED_CLOCK != SREG_CLOCK || SN74HC164N_FIXED_A != SREG_A)
+#error "SN74HC164N_FIXED_CLOCK and SN74HC164N_FIXED_A must match SREG_CLOCK and SREG_A"
+#endif
+
+#define CPU_FREQUENCY 120000000 // Needs a CLOCK_PRESET in clock_presets.h
 
 #define UINPUT_RESET  0  // User input on pin 6
 #define SIGNAL_INPUT  6
+#define ACK_OUTPUT    10 // Return path LED for ARQ acks
+
+#define TICK_RATE 25000 // TIMER0 interrupts per second, planned for cclk
+#define ADC_SAMPLE_RATE 153846 // Least burst conversions per second, 10 MHz ADC clock
+#define SSP_BIT_RATE 7500000   // Most shift register bits per second over SSP1
+
+#define IDLE_DIVIDER 14              // CPU divider while idle: 24 MHz from the 120 MHz PLL
+#define IDLE_TICKS (TICK_RATE / 10)  // Idle ticks before slowing down, 0.1 s
+
+#define SCROLL_INTERVAL (TICK_RATE / 10) // Ticks per scrolled column, 0.1 s
+#define MESSAGE_HOLD (TICK_RATE / 2)     // Least ticks each ARQ message is shown
+#define UI_BRIGHTNESS (BCM_MAX_LEVEL / 4) // Level of lit outputs with BCM
+
+// rate.c keeps its bit periods to RATE_MIN_SAMPLES of these ticks
+#if RATE_RECEIVER_TICK_US * TICK_RATE != 1000000
+#error "RATE_RECEIVER_TICK_US must be the period of TICK_RATE"
+#endif
+
+#if BCM_ENABLED && (!SN74HC164N_SSP_ENABLED || FRAMEBUFFER_ENABLED)
+#error "BCM needs SN74HC164N_SSP_ENABLED and a single register"
+#endif
+
+// Set to 1 to print the shift register's busy ticks and updates once a
+// second, from the main loop
+#ifndef UI_REPORT_ENABLED
+#define UI_REPORT_ENABLED 0
+#endif
+
+// The carrier's PWM1 is not rescaled on a clock switch
+#if CLOCK_SCALING_ENABLED && PWM_CARRIER_ENABLED
+#error "CLOCK_SCALING_ENABLED cannot be used with PWM_CARRIER_ENABLED"
+#endif
 
 int state = 0;
-int systime = 0;
+volatile int systime = 0;   // Ticks, advanced by TIMER0_IRQHandler
 receive_state    sstate;
 SN74HC164N_state rstate;
+timer_plan       tick;  // TIMER0 at TICK_RATE
+
+#if BCM_ENABLED
+bcm_state bcm;
+#endif
+
+#if FRAMEBUFFER_ENABLED
+framebuffer   framebuf;
+text_scroller scroller;
+char display_text[RECEIVE_BUFFER_LEN]; // Message being scrolled
+#endif
+
+#if PAM4_ENABLED
+adc_plan adc;
+#endif
+
+#if CLOCK_SCALING_ENABLED
+clock_scaling_state scaling;
+clock_settings full_settings;  // The CPU_FREQUENCY preset
+clock_settings idle_settings;  // The same PLL0 setup at IDLE_DIVIDER
+int idle_since = 0;            // systime the link went quiet
+int scaled_tick;               // TIMER0's index in scaling
+#endif
+
+#if CLOCK_MEASURE_ENABLED
+clock_measure_state measure;
+int measurements_seen = 0;
+#endif
+
+#if UI_REPORT_ENABLED
+int ui_reported_at = 0;         // systime of the last report
+uint32_t ui_busy_seen = 0;      // rstate.busy_ticks then
+uint32_t ui_updates_seen = 0;   // rstate.num_updates then
+#endif
+
+#if ARQ_ENABLED
+transmit_state   ack_tstate;
+arq_receiver     arq;
+char arq_message[ARQ_MAX_PAYLOAD + 1]; // Payload on display
+int  arq_message_time = 0;             // systime it went on display
+// Payloads delivered in order, waiting for their turn on display
+char arq_inbox[ARQ_WINDOW][ARQ_MAX_PAYLOAD + 1];
+int  arq_inbox_head = 0;
+int  arq_inbox_tail = 0;
+char arq_ack[ARQ_ACK_LEN];
+rate_monitor     rmonitor;
+#endif
+
+#if PAM4_ENABLED
+void init_adc(){
+    // Power the ADC and route AD0.0 to P0[23]
+    LPC_SC->PCONP |= 1 << 12;
+    LPC_PINCON->PINSEL1 &= ~(3 << 14);
+    LPC_PINCON->PINSEL1 |=  (1 << 14);
+    
+    // Burst-convert channel 0 continuously, ADC clock planned for cclk
+    // with the divider chosen before bring-up
+    if (adc_plan_fixed(&global_settings, adc.pclksel, ADC_SAMPLE_RATE, &adc)){
+        printf("ADC rate %d out of range\n", ADC_SAMPLE_RATE);
+    }
+    LPC_ADC->ADCR = 1 | (adc.clkdiv << 8) | (1 << 16) | (1 << 21);
+}
+#endif
 
 void init_receive(){
+#if PAM4_ENABLED
+    receive_init(&sstate, (volatile uint32_t *) &LPC_ADC -> ADDR0, 0);
+#else
     LPC_GPIO0->FIODIR &= ~(1 << SIGNAL_INPUT);
     receive_init(&sstate, &LPC_GPIO0 -> FIOPIN, 1<<SIGNAL_INPUT);
+#endif
 }
 
 void drive_receive(){
@@ -58,6 +184,91 @@ int receive_done(){
     return sstate.state == SIGNAL_COMPLETE;
 }
 
+#if ARQ_ENABLED
+void init_arq(){
+#if PAM4_ENABLED
+    // Acks go out as PAM-4 on AOUT, P0[26]
+    LPC_PINCON->PINSEL1 &= ~(3 << 20);
+    LPC_PINCON->PINSEL1 |=  (2 << 20);
+    transmit_init(&ack_tstate, &LPC_DAC -> DACR, 0, 1);
+#elif PWM_CARRIER_ENABLED
+    // Acks gate a carrier on PWM1.1, P2[0], timed from the applied clock
+    if (pwm_carrier_calculate(&global_settings, PWM_CARRIER_PCLK_DIV,
+            PWM_CARRIER_FREQUENCY, &global_pwm_carrier))
+        printf("Carrier %d Hz out of range\n", PWM_CARRIER_FREQUENCY);
+    pwm_carrier_init(&global_pwm_carrier);
+    transmit_init(&ack_tstate, NULL, 0, 1);
+#else
+    LPC_GPIO0->FIODIR |= (1 << ACK_OUTPUT);
+    transmit_init(&ack_tstate, &LPC_GPIO0 -> FIOPIN, 1<<ACK_OUTPUT, 1);
+#endif
+    transmit_set_bit(&ack_tstate, 0);
+    
+    arq_receiver_init(&arq);
+    rate_monitor_init(&rmonitor);
+    arq_message[0] = '\0';
+    arq_inbox_head = arq_inbox_tail = 0;
+}
+
+// Grades the link from the decoder statistics of the frame just received
+int link_report(int frame_ok){
+    (void) frame_ok;
+#if RATE_ADAPT_ENABLED
+    int num_corrected = 0;
+#if FEC_ENABLED
+    num_corrected += sstate.fec.num_corrected;
+    if (sstate.fec.num_uncorrectable) frame_ok = 0;
+#endif
+#if LINE_CODE_ENABLED
+    if (sstate.linecode.num_invalid) frame_ok = 0;
+#endif
+    return rate_monitor_frame(&rmonitor, frame_ok, num_corrected,
+        sstate.max_phase_error, sstate.avg_pulse_time);
+#else
+    return RATE_REPORT_HOLD;
+#endif
+}
+
+// Puts the next delivered payload on display once the last one has been
+// shown for MESSAGE_HOLD ticks, or for a whole pass of the scroller
+void show_next_message(){
+    if (arq_inbox_tail == arq_inbox_head) return;
+    
+    int hold = MESSAGE_HOLD;
+#if FRAMEBUFFER_ENABLED
+    if (scroller.text) hold = scroller.num_columns * SCROLL_INTERVAL;
+#endif
+    if (arq_message[0] && systime - arq_message_time < hold) return;
+    
+    strcpy(arq_message, arq_inbox[arq_inbox_tail % ARQ_WINDOW]);
+    arq_inbox_tail++;
+    arq_message_time = systime;
+}
+
+// Hands each completed frame to ARQ, queues whatever is now in order for
+// display, and answers with an ack at the bit rate the frame arrived at.
+void drive_arq(){
+    show_next_message();
+    if (!receive_done() || transmit_busy(&ack_tstate)) return;
+    
+    int frame_ok = arq_receiver_accept(&arq, sstate.bit_buffer) > 0;
+    // A full inbox leaves the rest in the window, and out of the ack
+    while (arq_inbox_head - arq_inbox_tail < ARQ_WINDOW &&
+            arq_receiver_deliver(&arq,
+                arq_inbox[arq_inbox_head % ARQ_WINDOW]) >= 0){
+        arq_inbox_head++;
+    }
+    arq_receiver_ack(&arq, arq_ack, link_report(frame_ok));
+    
+    ack_tstate.ticks_per_bit = sstate.avg_pulse_time;
+    transmit_queue(&ack_tstate, arq_ack);
+    
+    NVIC_DisableIRQ(TIMER0_IRQn);
+    init_receive();
+    NVIC_EnableIRQ(TIMER0_IRQn);
+}
+#endif
+
 void init_ui(){
     
   
@@ -84,18 +295,60 @@ void init_ui(){
   rstate.mask_clock = (1 << SREG_CLOCK);
   rstate.mask_clear = (1 << SREG_CLR);
   rstate.mask_a     = (1 << SREG_A);
-  rstate.holdtime = 200;
+  // Re-shift once a second anyway; over SSP the display is stepped from
+  // the main loop, so there it is every TICK_RATE passes
+  rstate.refresh_interval = TICK_RATE;
+
+  // Release the active low clear; each value overwrites all 8 outputs
+  LPC_GPIO0 -> FIOPIN |= (1 << SREG_CLR);
+
+#if BCM_ENABLED
+  bcm_init(&bcm);
+#endif
+
+#if FRAMEBUFFER_ENABLED
+  // Start the chain from a blank frame
+  framebuffer_init(&framebuf);
+  memset(framebuffer_back(&framebuf), 0, FRAMEBUFFER_COLUMNS);
+  framebuffer_swap(&framebuf);
+  display_text[0] = '\0';
+#endif
+
+#if SN74HC164N_SSP_ENABLED
+  // SSP1 as an 8-bit SPI master at up to SSP_BIT_RATE from PCLK = cclk/4,
+  // 7.5 MHz at 120 MHz so a byte takes about a microsecond. Clear stays
+  // on GPIO.
+  LPC_SC->PCONP |= 1 << 10;
+  LPC_PINCON->PINSEL0 &= ~((3 << 14) | (3 << 18));
+  LPC_PINCON->PINSEL0 |=  (2 << 14) | (2 << 18);
+  ssp_plan ssp;
+  ssp_plan_rate(&global_settings, 0, SSP_BIT_RATE, &ssp);
+  LPC_SSP1->CR0  = 7 | (ssp.scr << 8);
+  LPC_SSP1->CPSR = ssp.cpsdvsr;
+  LPC_SSP1->CR1  = 1 << 1;
+#if CLOCK_SCALING_ENABLED
+  clock_scaling_add_ssp(&scaling, LPC_SSP1, &ssp, SSP_BIT_RATE);
+#endif
+  rstate.reg_ssp_data   = &LPC_SSP1->DR;
+  rstate.reg_ssp_status = (volatile uint32_t *) &LPC_SSP1->SR;
+#endif
 }
 
 int already_printed = 0;
 
 void drive_ui(){
 
+#if FRAMEBUFFER_ENABLED
+    // The main loop renders frames; only shift them out here
+    framebuffer_step(&framebuf, &rstate);
+    return;
+#endif
+
     // Calculate bits for shift register
-    rstate.bits = sstate.state;
+    int bits = sstate.state;
     
     if (receive_done()){
-        rstate.bits = (int)sstate.bit_buffer[0];
+        bits = (int)sstate.bit_buffer[0];
         if (!already_printed){
             //puts(sstate.bit_buffer);
             already_printed = 1;
@@ -103,22 +356,154 @@ void drive_ui(){
     } else {
         already_printed = 0;
     }
+    
+#if ARQ_ENABLED
+    // Frames are consumed as soon as they complete; show the last one
+    if (arq_message[0]){
+        bits = (int)arq_message[0];
+    }
+#endif
 
+#if BCM_ENABLED
+    // Lit outputs glow at UI_BRIGHTNESS; the timer ISR sends the planes
+    bcm_set_byte(&bcm, bits, UI_BRIGHTNESS);
+#else
     // Step the shift register
+    rstate.bits = bits;
     SN74HC164N_step(&rstate);
+#endif
+}
+
+#if UI_REPORT_ENABLED
+// Prints the ticks spent driving the shift register pins, and the values
+// shifted in, over the last second
+void report_ui(){
+    if (systime - ui_reported_at < TICK_RATE) return;
+    
+    __disable_irq();
+    uint32_t busy = rstate.busy_ticks, updates = rstate.num_updates;
+    int ticks = systime - ui_reported_at;
+    ui_reported_at = systime;
+    __enable_irq();
+    
+    printf("Display: %lu of %d ticks busy, %lu updates\n",
+        (unsigned long) (busy - ui_busy_seen), ticks,
+        (unsigned long) (updates - ui_updates_seen));
+    ui_busy_seen = busy;
+    ui_updates_seen = updates;
+}
+#endif
+
+#if FRAMEBUFFER_ENABLED
+// Scrolls the latest received message across the register chain
+void drive_display(){
+    const char *text = NULL;
+
+    if (receive_done()){
+        text = sstate.bit_buffer;
+    }
+#if ARQ_ENABLED
+    if (arq_message[0]){
+        text = arq_message;
+    }
+#endif
+
+    if (text && strcmp(text, display_text) != 0){
+        strncpy(display_text, text, RECEIVE_BUFFER_LEN - 1);
+        text_scroller_start(&scroller, display_text, SCROLL_INTERVAL, systime);
+    }
+    text_scroller_step(&scroller, &framebuf, systime);
+}
+#endif
+
+#if CLOCK_SCALING_ENABLED
+// Runs at full speed while the link is active and drops to idle_settings
+// once nothing has been heard or sent for IDLE_TICKS
+void drive_scaling(){
+    int idle = sstate.state == SIGNAL_WAITING ||
+        sstate.state == SIGNAL_COMPLETE;
+#if ARQ_ENABLED
+    idle = idle && !transmit_busy(&ack_tstate);
+#endif
+    if (!idle) idle_since = systime;
+    
+    const clock_settings *point = systime - idle_since >= IDLE_TICKS ?
+        &idle_settings : &full_settings;
+    if (point->frequency == global_settings.frequency) return;
+    
+    __disable_irq();
+    int error = clock_scaling_switch(&scaling, &global_settings, point);
+    systime += clock_scaling_missed(&scaling, scaled_tick);
+#if CLOCK_MEASURE_ENABLED
+    // Measure at the full-speed point only, so idle spells pause the
+    // window rather than restart it
+    if (point == &full_settings){
+        clock_measure_resume(&measure);
+    } else {
+        clock_measure_suspend(&measure);
+    }
+#endif
+    __enable_irq();
+    
+    if (error) clock_bringup_print();
+}
+#endif
+
+#if CLOCK_MEASURE_ENABLED
+// RTC interrupt handler, once an RTC second
+void RTC_IRQHandler(){
+    clock_measure_second(&measure, CLOCK_DWT_CYCCNT);
+    LPC_RTC->ILR = 1;
+}
+
+// Retunes the tick to the cclk measured against the RTC
+void drive_measure(){
+    // RTC_IRQHandler updates the measurement, so work from a copy
+    __disable_irq();
+    clock_measure_state seen = measure;
+    __enable_irq();
+    
+    if (seen.num_measurements == measurements_seen) return;
+    measurements_seen = seen.num_measurements;
+    
+    clock_settings corrected = global_settings;
+    int error = clock_measure_correct(&seen, &corrected);
+    if (error || CLOCK_REPORT_ENABLED){
+        printf("cclk %d Hz measured: %d ppm\n", seen.frequency,
+            seen.error_ppm);
+    }
+    if (error || corrected.frequency == global_settings.frequency) return;
+    
+#if CLOCK_SCALING_ENABLED
+    // The same PLL0 setup and divider, so this only replans
+    clock_measure_correct(&seen, &full_settings);
+    clock_measure_correct(&seen, &idle_settings);
+    __disable_irq();
+    clock_scaling_switch(&scaling, &global_settings, &corrected);
+    systime += clock_scaling_missed(&scaling, scaled_tick);
+    clock_measure_restart(&measure, full_settings.frequency);
+#else
+    global_settings = corrected;
+    timer_plan_fixed(&global_settings, tick.pclksel, 1, TICK_RATE, &tick);
+    __disable_irq();
+    timer_plan_retune(LPC_TIM0, &tick);
+    clock_measure_restart(&measure, global_settings.frequency);
+#endif
+    __enable_irq();
 }
+#endif
 
-void init_timer(int numcycles){
+void init_timer(const timer_plan *plan){
 
   // enable power on Tim0
   LPC_SC->PCONP |= (1<<1);
   
   // Set the PC on Tim0 to 1
   LPC_TIM0->PC = 1;
-  LPC_TIM0->TCR |= 1;
   
-  // Configure Tim0's counter and interrupt
-  LPC_TIM0->MR0 = (uint32_t) numcycles; 
+  // Configure Tim0's clock, counter and interrupt
+  timer_plan_apply(LPC_TIM0, plan);
+  LPC_TIM0->TCR |= 1;
   LPC_TIM0->MCR |= 1 | 2;
   LPC_TIM0->EMR |= 1 | (1<<5);
   
@@ -136,8 +521,24 @@ void TIMER0_IRQHandler() {
         // Drive receive
         drive_receive();
         
+#if ARQ_ENABLED
+        // Drive ack transmitter
+        transmit_step(&ack_tstate);
+#endif
+        
+#if !SN74HC164N_SSP_ENABLED
         // Drive UI
         drive_ui();        
+#endif
+
+#if BCM_ENABLED
+        // Show the next brightness bit plane when it is due
+        int plane;
+        if (bcm_step(&bcm, &plane)){
+            rstate.bits = plane;
+            SN74HC164N_update(&rstate);
+        }
+#endif
         
         // Reset interrupt TIM0-IR0
         LPC_TIM0->IR |= 1;
@@ -166,21 +567,112 @@ void EINT3_IRQHandler() {
     LPC_GPIOINT->IO0IntClr |= (1 << UINPUT_RESET);
 }
 
+// Chooses every peripheral's PCLKSEL divider for the clock about to be
+// applied. The dividers may only change while PLL0 is disconnected, so
+// this runs before apply_clock_settings and everything after it plans
+// with the dividers chosen here.
+void select_peripheral_clocks(){
+  // Corrections to the measured cclk want the finest ticks, so then
+  // TIMER0 runs from cclk
+#if CLOCK_MEASURE_ENABLED
+  tick.pclksel = 1;
+#else
+  timer_plan_rate(&global_settings, TICK_RATE, &tick);
+#endif
+  pclk_select(PCLK_TIMER0, tick.pclksel);
+#if PAM4_ENABLED
+  adc_plan_rate(&global_settings, ADC_SAMPLE_RATE, &adc);
+  pclk_select(PCLK_ADC, adc.pclksel);
+#endif
+#if SN74HC164N_SSP_ENABLED
+  pclk_select(PCLK_SSP1, 0);
+#endif
+#if ARQ_ENABLED && PWM_CARRIER_ENABLED && !PAM4_ENABLED
+  pclk_select(PCLK_PWM1, pwm_carrier_pclksel(PWM_CARRIER_PCLK_DIV));
+#endif
+}
+
 // Main method
 int main(void) {
   
   
-  // Calculate and apply clock settings
-  clock_settings *clkset = calculate_clock_settings(120000000);  
-  apply_clock_settings(clkset);
+  // Apply clock settings worked out ahead of time, so there is no
+  // search at boot
+  global_settings = (clock_settings) CLOCK_PRESET(CPU_FREQUENCY);
+  select_peripheral_clocks();
+  if (apply_clock_settings(&global_settings) || CLOCK_REPORT_ENABLED){
+      clock_bringup_print();
+  }
+  
+#if CLOCK_SCALING_ENABLED
+  clock_scaling_init(&scaling);
+  full_settings = global_settings;
+  if (clock_scaling_point(&full_settings, IDLE_DIVIDER, &idle_settings)){
+      idle_settings = full_settings;
+  }
+#endif
   
   init_ui();
+#if PAM4_ENABLED
+  init_adc();
+#endif
   init_receive();
-  init_timer(1199);
+#if ARQ_ENABLED
+  init_arq();
+#endif
+  
+  // Tick at TICK_RATE whatever cclk was applied
+  int tick_error = timer_plan_fixed(&global_settings, tick.pclksel, 1,
+      TICK_RATE, &tick);
+  if (tick_error || CLOCK_REPORT_ENABLED){
+      printf("Tick %d Hz: %lu Hz, %d ppm\n", TICK_RATE,
+          (unsigned long) tick.rate, tick.error_ppm);
+  }
+  init_timer(&tick);
+  
+#if CLOCK_SCALING_ENABLED
+  // TIMER0 keeps TICK_RATE through switches
+  scaled_tick = clock_scaling_add_timer(&scaling, LPC_TIM0, &tick, 1,
+      TICK_RATE);
+#if PAM4_ENABLED
+  clock_scaling_add_adc(&scaling, &adc, ADC_SAMPLE_RATE);
+#endif
+#endif
+
+#if CLOCK_MEASURE_ENABLED
+  clock_measure_init(&measure, global_settings.frequency,
+      CLOCK_MEASURE_SECONDS);
+  clock_measure_start();
+#endif
   
   // Main loop
   while(1){
     
+#if ARQ_ENABLED
+    drive_arq();
+#endif
+
+#if SN74HC164N_SSP_ENABLED
+    // An SSP update is one register write, so the display runs here
+    drive_ui();
+#endif
+
+#if FRAMEBUFFER_ENABLED
+    drive_display();
+#endif
+
+#if CLOCK_SCALING_ENABLED
+    drive_scaling();
+#endif
+
+#if CLOCK_MEASURE_ENABLED
+    drive_measure();
+#endif
+
+#if UI_REPORT_ENABLED
+    report_ui();
+#endif
+    
     // Hang out for a few cycles
     for (int i=0; i<200; i++);
     
@@ -3,7 +3,10 @@
  Name        : main.c
  Author      :
  Version     :
- Description : Blinking stuff.
+ Description : Blinking stuff. Two chasers run across a shift register,
+             : the second one dimmed, as a keyframe animation advanced
+             : by TIMER0 at FRAME_RATE frames per second. The core
+             : sleeps between frames.
  ==============================================
  */
 
@@ -17,13 +20,15 @@
 
 #include "main.h"
 
+#include "animation.c"  // Keyframe Animation
+
 // Variable to store CRP value in. Will be placed automatically
 // by the linker when "Enable Code Read Protect" selected.
 // See crp.h header for more information
 __CRP const unsigned int CRP_WORD = CRP_NO_CRP;
 
-uint32_t *PIN_CONTROL = (uint32_t *) 0x2009C000;
-uint32_t *PIN_VALUES  = (uint32_t *) 0x2009C014;
+volatile uint32_t *PIN_CONTROL = (uint32_t *) 0x2009C000;
+volatile uint32_t *PIN_VALUES  = (uint32_t *) 0x2009C014;
 
 #define SREG_CLR   9
 #define SREG_CLOCK 8
@@ -31,7 +36,29 @@ uint32_t *PIN_VALUES  = (uint32_t *) 0x2009C014;
 #define SREG_B     6
 
 #define CLK_CYCLE_WIDTH 12
-#define CLK_CYCLE_HOLD  10000
+
+#define FRAME_RATE 2000 // Frames per second, fast enough to hide dimming
+
+// TIMER0 PCLKSEL0 field value to peripheral clock divider
+const int timer_pclk_div[4] = {4, 1, 2, 8};
+
+// First chaser: one output lit, stepping up every half second
+const animation_keyframe chaser_keys[8] = {
+    {1 << 1, 1000}, {1 << 2, 1000}, {1 << 3, 1000}, {1 << 4, 1000},
+    {1 << 5, 1000}, {1 << 6, 1000}, {1 << 7, 1000}, {1 << 0, 1000},
+};
+
+// Second chaser: stepping down every 1.25 s
+const animation_keyframe chaser_2_keys[8] = {
+    {1 << 0, 2500}, {1 << 7, 2500}, {1 << 6, 2500}, {1 << 5, 2500},
+    {1 << 4, 2500}, {1 << 3, 2500}, {1 << 2, 2500}, {1 << 1, 2500},
+};
+
+const animation_track chaser   = {chaser_keys, 8, 0, 1};
+const animation_track chaser_2 = {chaser_2_keys, 8, 1, 3}; // 1/3 lit
+
+animation_state anim;
+volatile uint32_t frames_due = 0;   // Frames started by the timer
 
 //////// UTILITY FUNCTIONS ////////
 void delay(){
@@ -54,11 +81,45 @@ void gpio_set_pin(int pin, int val){
     }
 }
 
+// Shifts bits into the register, output 7 first, overwriting all 8
+void shift_out(int bits){
+    for (int i=7; i>=0; i--){
+        gpio_set_pin(SREG_CLOCK,0);
+        half_delay();
+        gpio_set_pin(SREG_B,(bits >> i) & 1);
+        gpio_set_pin(SREG_A,(bits >> i) & 1);
+        half_delay();
+        gpio_set_pin(SREG_CLOCK,1);
+        delay();
+    }
+    gpio_set_pin(SREG_CLOCK,0);
+}
+
+// Interrupts FRAME_RATE times a second, whatever the clock settings
+void init_timer(){
+    SystemCoreClockUpdate();
+    uint32_t pclk = SystemCoreClock /
+        timer_pclk_div[(LPC_SC->PCLKSEL0 >> 2) & 3];
+
+    LPC_SC->PCONP |= (1<<1);
+    LPC_TIM0->TCR = 2;
+    LPC_TIM0->PR  = 0;
+    LPC_TIM0->MR0 = pclk / FRAME_RATE - 1;
+    LPC_TIM0->MCR = 1 | 2;
+    LPC_TIM0->TCR = 1;
+    NVIC_EnableIRQ(TIMER0_IRQn);
+}
+
+void TIMER0_IRQHandler(){
+    if (LPC_TIM0->IR & 1){
+        frames_due++;
+        LPC_TIM0->IR = 1;
+    }
+}
+
 int main(void) {
 
-  int cycle = 0;
-  int current_pin = 0;
-  int current_pin_2 = 0;
+  uint32_t frames_shown = 0;
 
   gpio_enable_pin(SREG_CLOCK);
   gpio_enable_pin(SREG_CLR);
@@ -69,71 +130,30 @@ int main(void) {
   gpio_set_pin(SREG_CLR, 0);
   gpio_set_pin(SREG_A, 0);
   gpio_set_pin(SREG_B, 0);
-  
-  int bits[8];
-  bits[0] = 1;
-  bits[1] = 1;
-  bits[2] = 1;
-  bits[3] = 1;
-  bits[4] = 1;
-  bits[5] = 1;
-  bits[6] = 1;
-  bits[7] = 1;
+
+  // Release clear; each frame overwrites all 8 outputs
+  gpio_set_pin(SREG_CLR, 1);
+
+  animation_init(&anim);
+  animation_add_track(&anim, &chaser);
+  animation_add_track(&anim, &chaser_2);
+  init_timer();
   
   while(1){
 
-    if (cycle++ % 1000 == 0){
-        current_pin = (current_pin + 1) % 8;
-    }
-    
-    if (cycle % 2500 == 0){
-        current_pin_2 = current_pin_2 - 1;
-        if (current_pin_2 < 0) current_pin_2 = 7;
-    }
-  
-    for (int i=0; i<8; i++){
-        if (i == current_pin || i == current_pin_2){
-            bits[7-i] = 1;
-            if (i == current_pin_2){
-                if (cycle%3!=0){
-                    bits[7-i] = 0;
-                }
-            }
-        } else {
-            bits[7-i] = 0;
-        }
-    }
-      
-    // do pin I/O
-    gpio_set_pin(SREG_CLR,1);
-    gpio_set_pin(SREG_A,1);
-    gpio_set_pin(SREG_B,0);
-    gpio_set_pin(SREG_CLOCK, 1);
-    delay();
-    
-    for (int i=0; i<8; i++){
-        gpio_set_pin(SREG_CLOCK,0);
-        half_delay();
-        gpio_set_pin(SREG_B,bits[i]);
-        gpio_set_pin(SREG_A,bits[i]);
-        half_delay();
-        gpio_set_pin(SREG_CLOCK,1);
-        delay();
+    // Sleep until the timer starts a frame
+    __WFI();
+
+    // If shifting ever falls behind, skip frames rather than slow down
+    uint32_t due = frames_due;
+    if (due == frames_shown) continue;
+
+    int bits = 0;
+    while (frames_shown != due){
+        bits = animation_next(&anim);
+        frames_shown++;
     }
-    
-    // wait a while
-    gpio_set_pin(SREG_CLOCK,0);
-    for (int i=0; i<CLK_CYCLE_HOLD; i++);
-    
-    // clear register.
-    gpio_set_pin(SREG_CLOCK,0);
-    half_delay();
-    gpio_set_pin(SREG_CLR,0);
-    half_delay();
-    gpio_set_pin(SREG_CLOCK, 1);
-    half_delay();
-    gpio_set_pin(SREG_CLR,1);
-    delay();    
+    shift_out(bits);
   }
   
   return 0;
@@ -0,0 +1,119 @@
+/*
+ ==============================================
+ Name        : pam4.c
+ Author      :
+ Version     :
+ Description : PAM-4 symbol mapping for the light link. The transmitter
+             : drives LED intensity through the DAC at four levels, each
+             : carrying two Gray-coded payload bits. The receiver samples
+             : the photodiode with the ADC, learns the four levels from a
+             : training sequence sent after the frame flag, and slices
+             : each sample at the midpoints between them.
+ ==============================================
+ */
+
+#include <string.h>
+
+// Set to 1 to send two bits per symbol through the DAC/ADC.
+// Transmitter and receiver must agree on this setting.
+#ifndef PAM4_ENABLED
+#define PAM4_ENABLED 0
+#endif
+
+#define PAM4_LEVELS            4
+#define PAM4_TRAINING_SYMBOLS  16   // Cycles 0,1,2,3 four times
+
+// 12-bit ADC result; samples above half scale read as 1 before training
+#define PAM4_ADC_MAX           4095
+#define PAM4_BINARY_THRESHOLD  (PAM4_ADC_MAX/2)
+
+// 10-bit DAC value for each level
+const unsigned short pam4_dac_levels[PAM4_LEVELS] = {0, 341, 682, 1023};
+
+// Gray code: two payload bits -> level, and level -> two payload bits.
+// Neighbouring levels differ by one bit, so a slicing error near a
+// threshold costs a single bit that FEC can repair.
+const unsigned char pam4_gray[PAM4_LEVELS] = {0, 1, 3, 2};
+
+// Receive-side level calibration
+typedef struct {
+    int sum[PAM4_LEVELS];        // Training samples accumulated per level
+    int count[PAM4_LEVELS];
+    int num_trained;             // Training symbols seen so far
+    int threshold[PAM4_LEVELS-1];
+} pam4_slicer;
+
+// Level sent for the n-th symbol of the training sequence
+int pam4_training_level(int n){
+    return n % PAM4_LEVELS;
+}
+
+// DACR value that drives the LED at the given level
+uint32_t pam4_dac_value(int level){
+    return ((uint32_t) pam4_dac_levels[level]) << 6;
+}
+
+// Extracts the 12-bit conversion result from an ADC data register
+int pam4_adc_sample(uint32_t adc_data){
+    return (int)((adc_data >> 4) & PAM4_ADC_MAX);
+}
+
+/*
+ * Returns the level that carries the two payload bits starting at
+ * position in a packed, least significant bit first, bit stream.
+ * Bits past num_bits are sent as zero.
+ */
+int pam4_map_symbol(const char *bits, int position, int num_bits){
+    int symbol = 0;
+    int i;
+
+    for (i = 0; i < 2; i++){
+        int pos = position + i;
+        if (pos < num_bits && (bits[pos/8] & (1 << (pos%8)))){
+            symbol |= 1 << i;
+        }
+    }
+    return pam4_gray[symbol];
+}
+
+// Resets calibration to evenly spaced thresholds across the ADC range
+void pam4_slicer_init(pam4_slicer *slicer){
+    int i;
+
+    memset(slicer, 0, sizeof(pam4_slicer));
+    for (i = 0; i < PAM4_LEVELS-1; i++){
+        slicer->threshold[i] = (PAM4_ADC_MAX * (2*i + 1)) / (2*PAM4_LEVELS);
+    }
+}
+
+/*
+ * Records one training sample. Once the whole training sequence has been
+ * seen, places each threshold midway between the mean levels on either
+ * side of it. Returns 1 when calibration is complete.
+ */
+int pam4_train(pam4_slicer *slicer, int sample){
+    int level = pam4_training_level(slicer->num_trained);
+    int i;
+
+    slicer->sum[level] += sample;
+    slicer->count[level]++;
+    slicer->num_trained++;
+    if (slicer->num_trained < PAM4_TRAINING_SYMBOLS) return 0;
+
+    for (i = 0; i < PAM4_LEVELS-1; i++){
+        int lo = slicer->sum[i]   / slicer->count[i];
+        int hi = slicer->sum[i+1] / slicer->count[i+1];
+        slicer->threshold[i] = (lo + hi) / 2;
+    }
+    return 1;
+}
+
+// Returns the level (0-3) closest to an ADC sample
+int pam4_slice(pam4_slicer *slicer, int sample){
+    int level = 0;
+
+    while (level < PAM4_LEVELS-1 && sample > slicer->threshold[level]){
+        level++;
+    }
+    return level;
+}
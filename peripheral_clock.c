@@ -0,0 +1,320 @@
+/*
+ ==============================================
+ Name        : peripheral_clock.c
+ Author      :
+ Version     :
+ Description : Peripheral clock and timer period planner. Given the
+             : applied clock_settings, picks the PCLKSEL divider and the
+             : prescale and match values that come closest to a
+             : requested timer period or rate, or the ADC clock divider
+             : for a requested sample rate, and reports the rate
+             : actually produced and its error, so the periods survive
+             : a change of cclk.
+ ==============================================
+ */
+
+// Peripherals with a PCLKSEL field: the register in bit 5, the field's
+// bit offset below it
+#define PCLK_TIMER0  2
+#define PCLK_TIMER1  4
+#define PCLK_PWM1   12
+#define PCLK_SSP1   20
+#define PCLK_ADC    24
+#define PCLK_TIMER2 (32 | 12)
+#define PCLK_TIMER3 (32 | 14)
+
+// cclk divider for each PCLKSEL field value. Searches run in this order,
+// so ties go to the reset default of cclk/4.
+const int pclk_divider[4] = {4, 1, 2, 8};
+
+// The ADC clock may not exceed 13 MHz; a conversion takes 65 of them
+#define ADC_CLOCK_MAX 13000000
+#define ADC_CLOCKS_PER_SAMPLE 65
+
+// Timer plans further than this from the request are reported as failures
+#ifndef PCLK_MAX_ERROR_PPM
+#define PCLK_MAX_ERROR_PPM 1000
+#endif
+
+typedef struct {
+    int pclksel;            // PCLKSEL field value
+    uint32_t pclk;          // Timer peripheral clock
+    uint32_t prescale;      // PR: pclk ticks per timer count, less one
+    uint32_t match;         // MR0: timer counts per period, less one
+    uint32_t rate;          // Periods per second actually produced
+    int error_ppm;          // Actual period against the requested one
+} timer_plan;
+
+typedef struct {
+    int pclksel;            // PCLKSEL field value
+    uint32_t pclk;          // ADC peripheral clock
+    uint32_t clkdiv;        // ADCR CLKDIV: pclk ticks per ADC clock, less one
+    uint32_t adc_clock;     // ADC clock produced
+    uint32_t rate;          // Burst mode samples per second
+    int error_ppm;          // Actual sample period against the requested one,
+                            // never positive
+} adc_plan;
+
+typedef struct {
+    int pclksel;            // PCLKSEL field value
+    uint32_t pclk;          // SSP peripheral clock
+    uint32_t cpsdvsr;       // CPSR, even from 2 to 254
+    uint32_t scr;           // CR0 serial clock rate: bit clock divider, less one
+    uint32_t rate;          // Bits per second produced
+    int error_ppm;          // Actual bit period against the requested one,
+                            // never negative
+} ssp_plan;
+
+/*
+ * Parts per million by which got is off from want, rounded to nearest
+ * and saturated to fit an int.
+ */
+static int pclk_error_ppm(uint64_t got, uint64_t want){
+    uint64_t diff = got > want ? got - want : want - got;
+    int sign = got > want ? 1 : -1;
+
+    // Keep diff*1000000 within 64 bits
+    while (want >> 40){
+        want >>= 1;
+        diff >>= 1;
+    }
+    uint64_t ppm = diff / want * 1000000 +
+        ((diff % want) * 1000000 + want / 2) / want;
+    if (ppm > 0x7FFFFFFF) ppm = 0x7FFFFFFF;
+    return sign * (int) ppm;
+}
+
+/*
+ * Plans a timer period of num/den seconds with the PCLKSEL values first
+ * to last. Each divider in turn gets the smallest prescale that fits the
+ * period into a 32 bit match, then the nearest match, and the divider
+ * with the smallest error wins. Returns -1 if no divider gives a period
+ * of at least two ticks, or if the best plan, still filled in, is off by
+ * more than PCLK_MAX_ERROR_PPM.
+ */
+static int timer_plan_search(const clock_settings *clock, int first,
+        int last, uint32_t num, uint32_t den, timer_plan *plan){
+    int found = 0;
+    uint64_t best_err = 0;
+
+    if (num == 0 || den == 0 || clock->frequency <= 0) return -1;
+
+    // Everything below counts in 1/(div*den) pclk ticks, which is a
+    // unit common to all the dividers: the period is cclk*num of them
+    uint64_t want = (uint64_t) clock->frequency * num;
+
+    for (int sel = first; sel <= last; sel++){
+        uint64_t tick = (uint64_t) den * pclk_divider[sel];
+        uint64_t ticks = (want + tick / 2) / tick;
+        uint64_t prescale = (ticks + 0xFFFFFFFFull) >> 32;
+        if (prescale == 0) prescale = 1;
+
+        uint64_t step = tick * prescale;
+        uint64_t counts = (want + step / 2) / step;
+        if (counts > 0xFFFFFFFFull) counts = 0xFFFFFFFFull;
+        if (counts * prescale < 2) continue;
+
+        uint64_t got = counts * step;
+        uint64_t err = got > want ? got - want : want - got;
+        if (found && err >= best_err) continue;
+
+        found = 1;
+        best_err = err;
+        plan->pclksel = sel;
+        plan->pclk = (uint32_t) clock->frequency / pclk_divider[sel];
+        plan->prescale = (uint32_t) prescale - 1;
+        plan->match = (uint32_t) counts - 1;
+        plan->rate = (uint32_t) (((uint64_t) clock->frequency +
+            got / den / 2) / (got / den));
+        plan->error_ppm = pclk_error_ppm(got, want);
+    }
+    if (!found) return -1;
+    return abs(plan->error_ppm) > PCLK_MAX_ERROR_PPM ? -1 : 0;
+}
+
+/*
+ * Plans a timer period of num/den seconds with whichever divider gets
+ * closest.
+ */
+int timer_plan_period(const clock_settings *clock, uint32_t num,
+        uint32_t den, timer_plan *plan){
+    return timer_plan_search(clock, 0, 3, num, den, plan);
+}
+
+/*
+ * Plans a timer period of num/den seconds keeping the PCLKSEL value.
+ */
+int timer_plan_fixed(const clock_settings *clock, int pclksel, uint32_t num,
+        uint32_t den, timer_plan *plan){
+    return timer_plan_search(clock, pclksel & 3, pclksel & 3, num, den, plan);
+}
+
+/*
+ * Plans a timer that matches rate times a second.
+ */
+int timer_plan_rate(const clock_settings *clock, uint32_t rate,
+        timer_plan *plan){
+    return timer_plan_period(clock, 1, rate, plan);
+}
+
+/*
+ * Plans a timer that matches once every period_us microseconds.
+ */
+int timer_plan_period_us(const clock_settings *clock, uint32_t period_us,
+        timer_plan *plan){
+    return timer_plan_period(clock, period_us, 1000000, plan);
+}
+
+/*
+ * Plans the ADC clock for burst conversions at no less than the
+ * requested sample rate, and as close to it as the PCLKSEL values first
+ * to last allow, never running the ADC clock above ADC_CLOCK_MAX.
+ * Returns -1 if the rate is out of reach.
+ */
+static int adc_plan_search(const clock_settings *clock, int first, int last,
+        uint32_t rate, adc_plan *plan){
+    int found = 0;
+    uint64_t best_err = 0;
+
+    if (rate == 0 || clock->frequency <= 0) return -1;
+
+    // In 1/rate cclk ticks the requested sample period is cclk of them
+    uint64_t want = (uint32_t) clock->frequency;
+
+    for (int sel = first; sel <= last; sel++){
+        uint64_t step = (uint64_t) rate * ADC_CLOCKS_PER_SAMPLE *
+            pclk_divider[sel];
+        uint64_t limit = (uint64_t) ADC_CLOCK_MAX * pclk_divider[sel];
+        uint64_t div = want / step;
+        if (div > 256) div = 256;
+        if (div == 0 || div * limit < want) continue;
+
+        uint64_t got = div * step;
+        if (found && want - got >= best_err) continue;
+
+        found = 1;
+        best_err = want - got;
+        plan->pclksel = sel;
+        plan->pclk = (uint32_t) clock->frequency / pclk_divider[sel];
+        plan->clkdiv = (uint32_t) div - 1;
+        plan->adc_clock = plan->pclk / (uint32_t) div;
+        plan->rate = (uint32_t) ((want + got / rate / 2) / (got / rate));
+        plan->error_ppm = pclk_error_ppm(got, want);
+    }
+    return found ? 0 : -1;
+}
+
+/*
+ * Plans the ADC clock for burst conversions at no less than rate with
+ * whichever divider gets closest.
+ */
+int adc_plan_rate(const clock_settings *clock, uint32_t rate,
+        adc_plan *plan){
+    return adc_plan_search(clock, 0, 3, rate, plan);
+}
+
+/*
+ * Plans the ADC clock for burst conversions at no less than rate keeping
+ * the PCLKSEL value. If the rate is out of reach this still fills in the
+ * fastest ADC clock allowed, and returns -1.
+ */
+int adc_plan_fixed(const clock_settings *clock, int pclksel, uint32_t rate,
+        adc_plan *plan){
+    int sel = pclksel & 3;
+
+    if (adc_plan_search(clock, sel, sel, rate, plan) == 0) return 0;
+    if (rate == 0 || clock->frequency <= 0) return -1;
+
+    uint32_t pclk = (uint32_t) clock->frequency / pclk_divider[sel];
+    uint32_t div = (pclk + ADC_CLOCK_MAX - 1) / ADC_CLOCK_MAX;
+    if (div == 0) div = 1;
+    plan->pclksel = sel;
+    plan->pclk = pclk;
+    plan->clkdiv = div - 1;
+    plan->adc_clock = pclk / div;
+    plan->rate = plan->adc_clock / ADC_CLOCKS_PER_SAMPLE;
+    plan->error_ppm = pclk_error_ppm((uint64_t) div * ADC_CLOCKS_PER_SAMPLE *
+        pclk_divider[sel] * rate, (uint32_t) clock->frequency);
+    return -1;
+}
+
+/*
+ * Plans an SSP bit rate of pclk / (cpsdvsr * (scr + 1)), with cpsdvsr
+ * even from 2 to 254 and scr from 0 to 255, as close to rate as it gets
+ * without going over, keeping the PCLKSEL value. If the rate is too slow
+ * for the dividers this fills in the slowest rate, and returns -1.
+ */
+int ssp_plan_rate(const clock_settings *clock, int pclksel, uint32_t rate,
+        ssp_plan *plan){
+    int sel = pclksel & 3;
+    uint64_t best = 0;
+
+    if (rate == 0 || clock->frequency <= 0) return -1;
+
+    // The bit period is pclk ticks of div, cclk ticks of div*divider
+    uint64_t want = (uint32_t) clock->frequency;
+    uint64_t div_min = (want + (uint64_t) rate * pclk_divider[sel] - 1) /
+        ((uint64_t) rate * pclk_divider[sel]);
+
+    plan->pclksel = sel;
+    plan->pclk = (uint32_t) clock->frequency / pclk_divider[sel];
+    plan->cpsdvsr = 254;
+    plan->scr = 255;
+    for (int cpsdvsr = 2; cpsdvsr <= 254; cpsdvsr += 2){
+        // Smallest scr that does not exceed the requested rate
+        uint64_t scr = (div_min + cpsdvsr - 1) / cpsdvsr;
+        if (scr == 0) scr = 1;
+        if (scr > 256) continue;
+
+        uint64_t div = scr * cpsdvsr * pclk_divider[sel];
+        if (best && div >= best) continue;
+        best = div;
+        plan->cpsdvsr = cpsdvsr;
+        plan->scr = (uint32_t) scr - 1;
+    }
+
+    uint64_t div = (uint64_t) plan->cpsdvsr * (plan->scr + 1) *
+        pclk_divider[sel];
+    plan->rate = (uint32_t) (want / div);
+    plan->error_ppm = pclk_error_ppm(div * rate, want);
+    return best ? 0 : -1;
+}
+
+#ifndef CLOCK_UTIL_HOST
+/*
+ * Sets a peripheral's PCLKSEL field. The errata only allow this while
+ * PLL0 is disconnected, so choose every divider before
+ * apply_clock_settings and plan with it from then on.
+ */
+void pclk_select(int peripheral, int pclksel){
+    volatile uint32_t *reg = (peripheral & 32) ? &LPC_SC->PCLKSEL1 :
+        &LPC_SC->PCLKSEL0;
+    int shift = peripheral & 31;
+    *reg = (*reg & ~(3u << shift)) | ((uint32_t) (pclksel & 3) << shift);
+}
+
+/*
+ * Loads a planned period into a timer: the prescale and MR0. The plan
+ * must keep the divider pclk_select chose at startup. The match control
+ * bits are left to the caller.
+ */
+void timer_plan_apply(LPC_TIM_TypeDef *timer, const timer_plan *plan){
+    timer->PR  = plan->prescale;
+    timer->MR0 = plan->match;
+}
+
+/*
+ * Loads a plan with the same PCLKSEL value into a running timer, unless
+ * it already has it. The count is held inside the new period so the
+ * match is not overrun.
+ */
+void timer_plan_retune(LPC_TIM_TypeDef *timer, const timer_plan *plan){
+    if (timer->PR == plan->prescale && timer->MR0 == plan->match) return;
+    timer->TCR = 0;
+    timer->PR  = plan->prescale;
+    timer->MR0 = plan->match;
+    if (timer->PC > plan->prescale) timer->PC = plan->prescale;
+    if (timer->TC > plan->match) timer->TC = plan->match;
+    timer->TCR = 1;
+}
+#endif
@@ -0,0 +1,94 @@
+/*
+ ==============================================
+ Name        : pwm_carrier.c
+ Author      :
+ Version     :
+ Description : Carrier modulated on/off keying for the light transmitter.
+             : PWM1 runs a square wave carrier on PWM1.1 (P2[0]); a 1 bit
+             : gates the carrier on and a 0 bit holds the output low, so
+             : a receiver tuned to the carrier can reject ambient light.
+             : The match registers are worked out from clock_settings.
+ ==============================================
+ */
+
+#ifndef PWM_CARRIER_ENABLED
+#define PWM_CARRIER_ENABLED 0
+#endif
+
+// Carrier frequency in Hz
+#ifndef PWM_CARRIER_FREQUENCY
+#define PWM_CARRIER_FREQUENCY 38000
+#endif
+
+// PWM1 peripheral clock as a divider of cclk: 1, 2, 4 or 8
+#define PWM_CARRIER_PCLK_DIV 1
+
+// PCLKSEL0 field value for each divider, indexed by log2 of the divider
+const int pwm_pclk_select[4] = {1, 2, 0, 3};
+
+typedef struct {
+    uint32_t pclk;          // PWM1 peripheral clock
+    uint32_t mr0;           // Carrier period in pclk ticks, less one
+    uint32_t mr1;           // High time, half the period
+    uint32_t frequency;     // Carrier frequency actually produced
+} pwm_carrier_settings;
+
+pwm_carrier_settings global_pwm_carrier;
+
+/*
+ * Computes the PWM1 match values for a carrier of the requested
+ * frequency, rounding to the nearest whole period. Returns -1 if the
+ * carrier is too fast to produce a square wave from this clock.
+ */
+int pwm_carrier_calculate(const clock_settings *clock, int pclk_div,
+        uint32_t carrier, pwm_carrier_settings *pwm){
+    if (carrier == 0 || pclk_div <= 0) return -1;
+
+    // The counter resets on the tick after matching MR0
+    uint32_t period = (clock->frequency / pclk_div + carrier / 2) / carrier;
+    if (period < 2) return -1;
+
+    pwm->pclk = clock->frequency / pclk_div;
+    pwm->mr0  = period - 1;
+    pwm->mr1  = period / 2;
+    pwm->frequency = pwm->pclk / period;
+    return 0;
+}
+
+/*
+ * PCLKSEL field value for a PWM1 divider of 1, 2, 4 or 8. Select it
+ * before apply_clock_settings, while PLL0 is disconnected.
+ */
+int pwm_carrier_pclksel(int pclk_div){
+    int shift = 0;
+    while ((1 << shift) < pclk_div) shift++;
+    return pwm_pclk_select[shift & 3];
+}
+
+/*
+ * Starts PWM1 with the carrier gated off and routes PWM1.1 to P2[0].
+ * PWM1's divider must already be pwm_carrier_pclksel of the one pwm was
+ * calculated for.
+ */
+void pwm_carrier_init(const pwm_carrier_settings *pwm){
+    LPC_SC->PCONP |= 1 << 6;
+    LPC_PINCON->PINSEL4 = (LPC_PINCON->PINSEL4 & ~3) | 1;
+
+    LPC_PWM1->TCR = 2;          // Hold in reset while configuring
+    LPC_PWM1->PR  = 0;
+    LPC_PWM1->MR0 = pwm->mr0;
+    LPC_PWM1->MR1 = 0;          // A zero match keeps the output low
+    LPC_PWM1->MCR = 2;          // Reset on MR0
+    LPC_PWM1->LER = 3;
+    LPC_PWM1->PCR = 1 << 9;     // Single edge, PWM1.1 output enabled
+    LPC_PWM1->TCR = 1 | 8;      // Counter and PWM mode on
+}
+
+/*
+ * Gates the carrier. Takes effect at the start of the next carrier
+ * period, so every burst is made of whole carrier cycles.
+ */
+void pwm_carrier_set(const pwm_carrier_settings *pwm, int on){
+    LPC_PWM1->MR1 = on ? pwm->mr1 : 0;
+    LPC_PWM1->LER = 1 << 1;
+}
@@ -0,0 +1,129 @@
+/*
+ ==============================================
+ Name        : rate.c
+ Author      :
+ Version     :
+ Description : Closed-loop bit rate adaptation for the light link. The
+             : receiver grades every frame from its FEC corrections, bad
+             : line symbols and edge timing, and returns a step up, step
+             : down or hold request in the ARQ ack. The transmitter moves
+             : through rate_bit_periods accordingly, and falls back to the
+             : slowest rate after repeated missing acks. The receiver needs
+             : no rate table: it measures the bit period from each preamble.
+ ==============================================
+ */
+
+#include <string.h>
+
+// Set to 1 to let the transmitter change bit rate from receiver reports.
+// Needs ARQ_ENABLED for the return path.
+#ifndef RATE_ADAPT_ENABLED
+#define RATE_ADAPT_ENABLED 0
+#endif
+
+// Reports carried in the ack
+#define RATE_REPORT_HOLD 0
+#define RATE_REPORT_UP   1
+#define RATE_REPORT_DOWN 2
+
+// Clean frames in a row before asking for a faster rate
+#define RATE_UP_FRAMES       8
+// Corrected codewords in one frame that already count as a bad frame
+#define RATE_DOWN_CORRECTIONS 4
+// Missing acks in a row before falling back to the slowest rate
+#define RATE_MAX_FAILURES    3
+
+// The receiver samples once a tick, TICK_RATE in main.c, and needs this
+// many samples per bit
+#define RATE_RECEIVER_TICK_US 40
+#define RATE_MIN_SAMPLES      8
+#define RATE_FASTEST_US (RATE_MIN_SAMPLES * RATE_RECEIVER_TICK_US)
+
+// Supported bit periods in microseconds, slowest (safest) first
+#define RATE_NUM_RATES 7
+const int rate_bit_periods[RATE_NUM_RATES] = {
+    48000, 24000, 9600, 4800, 2400, 960, RATE_FASTEST_US
+};
+
+// Receiver-side frame grading
+typedef struct {
+    int clean_frames;   // Consecutive frames with no sign of stress
+} rate_monitor;
+
+// Transmitter-side rate selection
+typedef struct {
+    int index;          // Current entry of rate_bit_periods
+    int failures;       // Consecutive missing acks
+    int num_changes;
+    int num_fallbacks;
+} rate_controller;
+
+void rate_monitor_init(rate_monitor *m){
+    memset(m, 0, sizeof(rate_monitor));
+}
+
+/*
+ * Grades one received frame and returns the report for its ack. A frame
+ * is bad if it failed its checks, needed many corrections, or its edges
+ * strayed more than a quarter bit from where the receiver expected
+ * them. It is clean if nothing was corrected and edges stayed within an
+ * eighth of a bit.
+ */
+int rate_monitor_frame(rate_monitor *m, int frame_ok, int num_corrected,
+        int max_phase_error, int bit_period){
+
+    if (!frame_ok || num_corrected >= RATE_DOWN_CORRECTIONS ||
+            max_phase_error * 4 > bit_period){
+        m->clean_frames = 0;
+        return RATE_REPORT_DOWN;
+    }
+
+    if (num_corrected > 0 || max_phase_error * 8 > bit_period){
+        m->clean_frames = 0;
+        return RATE_REPORT_HOLD;
+    }
+
+    if (++m->clean_frames >= RATE_UP_FRAMES){
+        m->clean_frames = 0;
+        return RATE_REPORT_UP;
+    }
+    return RATE_REPORT_HOLD;
+}
+
+void rate_controller_init(rate_controller *c){
+    memset(c, 0, sizeof(rate_controller));
+}
+
+int rate_bit_period(rate_controller *c){
+    return rate_bit_periods[c->index];
+}
+
+/*
+ * Applies a report from an ack. Returns 1 if the bit period changed.
+ */
+int rate_controller_report(rate_controller *c, int report){
+    int index = c->index;
+
+    c->failures = 0;
+    if (report == RATE_REPORT_UP && index < RATE_NUM_RATES - 1) index++;
+    if (report == RATE_REPORT_DOWN && index > 0) index--;
+    if (index == c->index) return 0;
+
+    c->index = index;
+    c->num_changes++;
+    return 1;
+}
+
+/*
+ * Records a frame that was never acknowledged. Returns 1 if this forced
+ * a fall back to the slowest rate.
+ */
+int rate_controller_timeout(rate_controller *c){
+    if (++c->failures < RATE_MAX_FAILURES || c->index == 0) return 0;
+
+    c->failures = 0;
+    c->index = 0;
+    c->num_changes++;
+    c->num_fallbacks++;
+    return 1;
+}
@@ -16,6 +16,7 @@
 #define SIGNAL_AWAIT_FRAME 4
 #define SIGNAL_RECEIVING   5
 #define SIGNAL_COMPLETE    6
+#define SIGNAL_TRAINING    7  // PAM-4 level calibration after the frame flag
 
 // Message begin/end flags (TODO: IMPLEMENT)
 #define FRAME_FLAG_BEGIN   15
@@ -25,6 +26,15 @@
 // Input buffer length
 #define RECEIVE_BUFFER_LEN 100
 
+// Set to 1 to re-centre the sample point on every payload edge. Line
+// coding guarantees an edge at least every four bits, so it follows
+// LINE_CODE_ENABLED; plain NRZ keeps sampling at the period measured
+// from the preamble, as it always has. Edge phase errors are measured
+// either way.
+#ifndef RECEIVE_RECENTRE_ENABLED
+#define RECEIVE_RECENTRE_ENABLED LINE_CODE_ENABLED
+#endif
+
 // Receive state definition
 typedef struct {
 
@@ -48,12 +58,49 @@ typedef struct {
     
     volatile uint32_t *input_source; // Input source register pointer
     int input_mask;                  // Mask to use when reading input source
+    
+    int line_level;                  // Last confirmed payload input level
+    int edge_pending;                // New level seen, not yet confirmed
+    int systime_edge;                // Time the pending level first appeared
+    int max_phase_error;             // Largest edge offset from a bit boundary
+    
+#if PAM4_ENABLED
+    pam4_slicer pam4;                // Learned PAM-4 slicing thresholds
+#endif
+#if LINE_CODE_ENABLED
+    linecode_decoder linecode;       // Recovers bytes from 4B5B symbols
+#endif
+#if FEC_ENABLED
+    fec_decoder fec;                 // Deinterleaves and corrects payload
+#endif
+#if COMPRESS_ENABLED
+    compress_decoder compress;       // Expands the compressed payload
+#endif
         
 } receive_state;
 
 // Define a global receive buffer
 char global_receive_bits[RECEIVE_BUFFER_LEN];
 
+// Reads the input as a two-level signal
+int receive_read_bit(receive_state *state){
+#if PAM4_ENABLED
+    return pam4_adc_sample(*state->input_source) > PAM4_BINARY_THRESHOLD;
+#else
+    int bit = *state->input_source & state->input_mask;
+    return bit && bit;
+#endif
+}
+
+// Reads the input as a payload level: 0/1, or 0-3 in PAM-4 mode
+int receive_read_level(receive_state *state){
+#if PAM4_ENABLED
+    return pam4_slice(&state->pam4, pam4_adc_sample(*state->input_source));
+#else
+    return receive_read_bit(state);
+#endif
+}
+
 // Function to initialize a receive state - sets variables to initial values
 void receive_init( receive_state *state, volatile uint32_t *source, int mask){
     
@@ -79,6 +126,21 @@ void receive_init( receive_state *state, volatile uint32_t *source, int mask){
     
     state->input_source = source;
     state->input_mask   = mask;
+    
+    state->line_level   = 0;
+    state->edge_pending = 0;
+    state->systime_edge = 0;
+    state->max_phase_error = 0;
+    
+#if PAM4_ENABLED
+    pam4_slicer_init(&state->pam4);
+#endif
+#if FEC_ENABLED
+    fec_decoder_init(&state->fec);
+#endif
+#if COMPRESS_ENABLED
+    compress_decoder_init(&state->compress);
+#endif
 }
 
 void receive_match_flags(receive_state *state, int bit){
@@ -93,8 +155,18 @@ void receive_match_flags(receive_state *state, int bit){
     
         state->last_eight_bits = 0;
         state->last_eight_bits_pos = 0;
+        state->line_level = bit;
+        state->edge_pending = 0;
+        
+#if LINE_CODE_ENABLED
+        linecode_decoder_init(&state->linecode, bit);
+#endif
 
+#if PAM4_ENABLED
+        state->state = SIGNAL_TRAINING;
+#else
         state->state = SIGNAL_RECEIVING;
+#endif
         return;
     }
 }
@@ -135,10 +207,63 @@ void receive_sync_clock(receive_state *state, int systime, int bit){
     }
 }
 
+// Stores a decoded payload byte, completing the frame on a null byte
+// or when the buffer is full.
+void receive_store_byte(receive_state *state, char byte){
+
+    if (state->state != SIGNAL_RECEIVING) return;
+    
+    state->bit_buffer[state->bit_buffer_pos] = byte;
+    state->bit_buffer_pos++;
+    
+    if (state->bit_buffer_pos >= state->bit_buffer_len){
+        state->bit_buffer_pos--;
+        state->bit_buffer[state->bit_buffer_pos] = '\0';
+        state->state = SIGNAL_COMPLETE;
+    }
+    
+    if ((int) byte == 0){
+        state->bit_buffer[state->bit_buffer_pos] = '\0';
+        state->state = SIGNAL_COMPLETE;
+    }
+}
+
+// Expands one error-corrected payload byte and stores the result
+void receive_store_payload(receive_state *state, char byte){
+#if COMPRESS_ENABLED
+    char expanded[COMPRESS_MAX_OUTPUT];
+    int num_expanded = compress_decoder_push(&state->compress, byte, expanded);
+    for (int i = 0; i < num_expanded; i++){
+        receive_store_byte(state, expanded[i]);
+    }
+#else
+    receive_store_byte(state, byte);
+#endif
+}
+
+// Passes one received payload byte through the enabled decoding stages
+void receive_process_byte(receive_state *state, char byte){
+#if FEC_ENABLED
+    char decoded[FEC_DATA_BYTES];
+    int num_decoded = fec_decoder_push(&state->fec, byte, decoded);
+    for (int i = 0; i < num_decoded; i++){
+        receive_store_payload(state, decoded[i]);
+    }
+#else
+    receive_store_payload(state, byte);
+#endif
+}
+
 void receive_process_bit(receive_state *state, int bit){
     
     if (state->state != SIGNAL_RECEIVING) return;
     
+#if LINE_CODE_ENABLED
+    char byte;
+    if (linecode_decoder_push(&state->linecode, bit, &byte)){
+        receive_process_byte(state, byte);
+    }
+#else
     int bitmask = 1   << state->last_eight_bits_pos;
     int bitval  = bit << state->last_eight_bits_pos;
     
@@ -150,22 +275,10 @@ void receive_process_bit(receive_state *state, int bit){
     if (state->last_eight_bits_pos >= 8){
     
         state->last_eight_bits_pos = 0;
-        state->bit_buffer[state->bit_buffer_pos] = state->last_eight_bits;        
-        state->bit_buffer_pos++;
-        
-        if (state->bit_buffer_pos >= state->bit_buffer_len){
-            state->bit_buffer_pos--;
-            state->bit_buffer[state->bit_buffer_pos] = '\0';
-            state->state = SIGNAL_COMPLETE;
-        }
-        
-        if ((int) state->last_eight_bits == 0){
-            state->bit_buffer[state->bit_buffer_pos] = '\0';
-            state->state = SIGNAL_COMPLETE;
-        }
-        
+        receive_process_byte(state, state->last_eight_bits);
         state->last_eight_bits = 0;
     }
+#endif
     
     state->last_bit = bit;
 }
@@ -174,15 +287,14 @@ void receive_process_bit(receive_state *state, int bit){
 
 // Function to drive the receive functionality
 void receive_step(receive_state *state, int systime){
-    int bit;
+    int bit, level;
     switch(state->state){
     
         case SIGNAL_DEFAULT:
             break;
     
         case SIGNAL_WAITING:
-            bit = *state->input_source & state->input_mask;
-            bit = bit && bit;
+            bit = receive_read_bit(state);
             if (bit != state->last_bit){
                 state->systime_prev_pulse = systime;
                 state->last_bit = bit;
@@ -192,15 +304,13 @@ void receive_step(receive_state *state, int systime){
             break;
         
         case SIGNAL_CLOCK_SYNC:
-            bit = *state->input_source & state->input_mask;
-            bit = bit && bit;
+            bit = receive_read_bit(state);
             
             receive_sync_clock(state, systime, bit);
             break;
         
         case SIGNAL_AWAIT_FRAME:
-            bit = *state->input_source & state->input_mask;
-            bit = bit && bit;
+            bit = receive_read_bit(state);
             
             // if we aren't at the sample point, return
             if (systime < state->systime_next_sample){
@@ -211,9 +321,52 @@ void receive_step(receive_state *state, int systime){
             receive_match_flags(state, bit);
             break;
                         
+#if PAM4_ENABLED
+        case SIGNAL_TRAINING:
+        
+            // if we aren't at the sample point, return
+            if (systime < state->systime_next_sample){
+                return;
+            }
+            
+            state->systime_next_sample += state->avg_pulse_time;
+            if (pam4_train(&state->pam4, 
+                    pam4_adc_sample(*state->input_source))){
+                state->line_level = 
+                    pam4_training_level(PAM4_TRAINING_SYMBOLS - 1);
+                state->state = SIGNAL_RECEIVING;
+            }
+            break;
+#endif
+                        
         case SIGNAL_RECEIVING:
-            bit = *state->input_source & state->input_mask;
-            bit = bit && bit;
+            level = receive_read_level(state);
+            
+            // Re-centre the sample point on payload edges so the
+            // receiver stays in phase with a drifting transmitter clock.
+            // A new level must hold for two ticks to count as an edge,
+            // so single-tick noise does not move the sample point.
+            // Without re-centring the edges are only measured.
+            if (level == state->line_level){
+                state->edge_pending = 0;
+            } else if (!state->edge_pending){
+                state->edge_pending = 1;
+                state->systime_edge = systime;
+            } else {
+                int phase_error = state->systime_edge - 
+                    (state->systime_next_sample - (state->avg_pulse_time/2));
+                if (phase_error < 0) phase_error = -phase_error;
+                if (phase_error > state->max_phase_error){
+                    state->max_phase_error = phase_error;
+                }
+                
+                state->edge_pending = 0;
+                state->line_level = level;
+#if RECEIVE_RECENTRE_ENABLED
+                state->systime_next_sample = state->systime_edge + 
+                    (state->avg_pulse_time/2);
+#endif
+            }
         
             // if we aren't at the sample point, return
             if (systime < state->systime_next_sample){
@@ -221,7 +374,13 @@ void receive_step(receive_state *state, int systime){
             }
             
             state->systime_next_sample += state->avg_pulse_time;
-            receive_process_bit(state, bit);
+#if PAM4_ENABLED
+            bit = pam4_gray[level];
+            receive_process_bit(state, bit & 1);
+            receive_process_bit(state, (bit >> 1) & 1);
+#else
+            receive_process_bit(state, level);
+#endif
             break;
             
         case SIGNAL_COMPLETE:  
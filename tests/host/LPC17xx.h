@@ -0,0 +1,194 @@
+/*
+ ==============================================
+ Name        : LPC17xx.h
+ Author      :
+ Version     :
+ Description : Host stand-in for the CMSIS device header. Each register
+             : block is plain memory that a test can set and inspect,
+             : with the fields the firmware uses at their real offsets,
+             : and the core intrinsics do nothing.
+ ==============================================
+ */
+
+#ifndef LPC17XX_HOST_H
+#define LPC17XX_HOST_H
+
+#include <stdint.h>
+
+#define __IO volatile
+#define __I  volatile
+#define __O  volatile
+
+typedef enum {
+    TIMER0_IRQn, TIMER1_IRQn, TIMER2_IRQn, TIMER3_IRQn, EINT3_IRQn,
+    SSP0_IRQn, SSP1_IRQn, DMA_IRQn, PWM1_IRQn, ADC_IRQn, RTC_IRQn
+} IRQn_Type;
+
+static inline void NVIC_EnableIRQ(IRQn_Type irq){ (void) irq; }
+static inline void NVIC_DisableIRQ(IRQn_Type irq){ (void) irq; }
+static inline void NVIC_SetPriority(IRQn_Type irq, uint32_t priority){
+    (void) irq;
+    (void) priority;
+}
+static inline void __disable_irq(void){}
+static inline void __enable_irq(void){}
+static inline void __DMB(void){}
+static inline void __WFI(void){}
+
+// A 32-bit register that can also be reached a byte at a time
+#define HOST_REG_BYTES(name) \
+    union { \
+        __IO uint32_t name; \
+        struct { __IO uint8_t name##0, name##1, name##2, name##3; }; \
+    }
+
+typedef struct {
+    HOST_REG_BYTES(FIODIR);
+    uint32_t RESERVED0[3];
+    HOST_REG_BYTES(FIOMASK);
+    HOST_REG_BYTES(FIOPIN);
+    HOST_REG_BYTES(FIOSET);
+    HOST_REG_BYTES(FIOCLR);
+} LPC_GPIO_TypeDef;
+
+typedef struct {
+    __IO uint32_t IR, TCR, TC, PR, PC, MCR, MR0, MR1, MR2, MR3, CCR;
+    __I  uint32_t CR0, CR1;
+    uint32_t RESERVED0[2];
+    __IO uint32_t EMR;
+    uint32_t RESERVED1[12];
+    __IO uint32_t CTCR;
+} LPC_TIM_TypeDef;
+
+typedef struct {
+    __IO uint32_t FLASHCFG;
+    uint32_t RESERVED0[31];
+    __IO uint32_t PLL0CON, PLL0CFG;
+    __I  uint32_t PLL0STAT;
+    __O  uint32_t PLL0FEED;
+    uint32_t RESERVED1[4];
+    __IO uint32_t PLL1CON, PLL1CFG;
+    __I  uint32_t PLL1STAT;
+    __O  uint32_t PLL1FEED;
+    uint32_t RESERVED2[4];
+    __IO uint32_t PCON, PCONP;
+    uint32_t RESERVED3[15];
+    __IO uint32_t CCLKCFG, USBCLKCFG, CLKSRCSEL;
+    uint32_t RESERVED4[12];
+    __IO uint32_t EXTINT, RESERVED5, EXTMODE, EXTPOLAR;
+    uint32_t RESERVED6[12];
+    __IO uint32_t RSID;
+    uint32_t RESERVED7[7];
+    __IO uint32_t SCS, IRCTRIM, PCLKSEL0, PCLKSEL1;
+    uint32_t RESERVED8[4];
+    __IO uint32_t USBIntSt, DMAREQSEL, CLKOUTCFG;
+} LPC_SC_TypeDef;
+
+typedef struct {
+    __I  uint32_t IntStatus;
+    __I  uint32_t IO0IntStatR, IO0IntStatF;
+    __O  uint32_t IO0IntClr;
+    __IO uint32_t IO0IntEnR, IO0IntEnF;
+    uint32_t RESERVED0[3];
+    __I  uint32_t IO2IntStatR, IO2IntStatF;
+    __O  uint32_t IO2IntClr;
+    __IO uint32_t IO2IntEnR, IO2IntEnF;
+} LPC_GPIOINT_TypeDef;
+
+typedef struct {
+    __IO uint32_t ADCR, ADGDR;
+    uint32_t RESERVED0;
+    __IO uint32_t ADINTEN;
+    __I  uint32_t ADDR0, ADDR1, ADDR2, ADDR3, ADDR4, ADDR5, ADDR6, ADDR7;
+    __I  uint32_t ADSTAT;
+    __IO uint32_t ADTRM;
+} LPC_ADC_TypeDef;
+
+typedef struct {
+    __IO uint32_t DACR, DACCTRL, DACCNTVAL;
+} LPC_DAC_TypeDef;
+
+typedef struct {
+    __IO uint32_t PINSEL0, PINSEL1, PINSEL2, PINSEL3, PINSEL4, PINSEL5;
+    __IO uint32_t PINSEL6, PINSEL7, PINSEL8, PINSEL9, PINSEL10;
+    uint32_t RESERVED0[5];
+    __IO uint32_t PINMODE0, PINMODE1, PINMODE2, PINMODE3, PINMODE4;
+    __IO uint32_t PINMODE5, PINMODE6, PINMODE7, PINMODE8, PINMODE9;
+    __IO uint32_t PINMODE_OD0, PINMODE_OD1, PINMODE_OD2, PINMODE_OD3;
+    __IO uint32_t PINMODE_OD4, I2CPADCFG;
+} LPC_PINCON_TypeDef;
+
+typedef struct {
+    __IO uint32_t CR0, CR1, DR;
+    __I  uint32_t SR;
+    __IO uint32_t CPSR, IMSC, RIS, MIS, ICR, DMACR;
+} LPC_SSP_TypeDef;
+
+typedef struct {
+    __IO uint32_t IR, TCR, TC, PR, PC, MCR, MR0, MR1, MR2, MR3, CCR;
+    __I  uint32_t CR0, CR1, CR2, CR3;
+    uint32_t RESERVED0;
+    __IO uint32_t MR4, MR5, MR6, PCR, LER;
+    uint32_t RESERVED1[7];
+    __IO uint32_t CTCR;
+} LPC_PWM_TypeDef;
+
+typedef struct {
+    __I  uint32_t DMACIntStat, DMACIntTCStat;
+    __O  uint32_t DMACIntTCClear;
+    __I  uint32_t DMACIntErrStat;
+    __O  uint32_t DMACIntErrClr;
+    __I  uint32_t DMACRawIntTCStat, DMACRawIntErrStat, DMACEnbldChns;
+    __IO uint32_t DMACSoftBReq, DMACSoftSReq, DMACSoftLBReq, DMACSoftLSReq;
+    __IO uint32_t DMACConfig, DMACSync;
+} LPC_GPDMA_TypeDef;
+
+typedef struct {
+    __IO uint32_t DMACCSrcAddr, DMACCDestAddr, DMACCLLI, DMACCControl;
+    __IO uint32_t DMACCConfig;
+} LPC_GPDMACH_TypeDef;
+
+typedef struct {
+    __IO uint32_t ILR;
+    uint32_t RESERVED0;
+    __IO uint32_t CCR, CIIR, AMR;
+    __I  uint32_t CTIME0, CTIME1, CTIME2;
+    __IO uint32_t SEC, MIN, HOUR, DOM, DOW, DOY, MONTH, YEAR, CALIBRATION;
+} LPC_RTC_TypeDef;
+
+// One of each register block per test; most tests use only a few
+#define HOST_BLOCK static __attribute__((unused))
+HOST_BLOCK LPC_GPIO_TypeDef    host_gpio0, host_gpio1, host_gpio2;
+HOST_BLOCK LPC_TIM_TypeDef     host_tim0, host_tim1, host_tim2, host_tim3;
+HOST_BLOCK LPC_SC_TypeDef      host_sc;
+HOST_BLOCK LPC_GPIOINT_TypeDef host_gpioint;
+HOST_BLOCK LPC_ADC_TypeDef     host_adc;
+HOST_BLOCK LPC_DAC_TypeDef     host_dac;
+HOST_BLOCK LPC_PINCON_TypeDef  host_pincon;
+HOST_BLOCK LPC_SSP_TypeDef     host_ssp0, host_ssp1;
+HOST_BLOCK LPC_PWM_TypeDef     host_pwm1;
+HOST_BLOCK LPC_GPDMA_TypeDef   host_gpdma;
+HOST_BLOCK LPC_GPDMACH_TypeDef host_gpdmach0, host_gpdmach1;
+HOST_BLOCK LPC_RTC_TypeDef     host_rtc;
+
+#define LPC_GPIO0    (&host_gpio0)
+#define LPC_GPIO1    (&host_gpio1)
+#define LPC_GPIO2    (&host_gpio2)
+#define LPC_TIM0     (&host_tim0)
+#define LPC_TIM1     (&host_tim1)
+#define LPC_TIM2     (&host_tim2)
+#define LPC_TIM3     (&host_tim3)
+#define LPC_SC       (&host_sc)
+#define LPC_GPIOINT  (&host_gpioint)
+#define LPC_ADC      (&host_adc)
+#define LPC_DAC      (&host_dac)
+#define LPC_PINCON   (&host_pincon)
+#define LPC_SSP0     (&host_ssp0)
+#define LPC_SSP1     (&host_ssp1)
+#define LPC_PWM1     (&host_pwm1)
+#define LPC_GPDMA    (&host_gpdma)
+#define LPC_GPDMACH0 (&host_gpdmach0)
+#define LPC_GPDMACH1 (&host_gpdmach1)
+#define LPC_RTC      (&host_rtc)
+
+#endif
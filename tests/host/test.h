@@ -0,0 +1,57 @@
+/*
+ ==============================================
+ Name        : test.h
+ Author      :
+ Version     :
+ Description : Minimal checks for the host tests. CHECK reports the
+             : failing expression and carries on; test_done prints the
+             : summary and gives the exit status. test_cycles times the
+             : benchmarks.
+ ==============================================
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static int test_checks;
+static int test_failures;
+
+#define CHECK(cond) do { \
+    test_checks++; \
+    if (!(cond)){ \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+// Prints the result and returns main's exit status
+static int test_done(const char *name){
+    printf("%s: %d checks, %d failed\n", name, test_checks, test_failures);
+    return test_failures ? 1 : 0;
+}
+
+// Small deterministic generator, so every run sees the same cases
+static uint32_t test_rand_state = 1;
+
+static inline uint32_t test_rand(void){
+    test_rand_state = test_rand_state * 1103515245u + 12345u;
+    return test_rand_state >> 8;
+}
+
+// Host cycle counter for the benchmarks: the time stamp counter on x86,
+// otherwise nanoseconds of processor time
+static inline uint64_t test_cycles(void){
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#endif
@@ -0,0 +1,221 @@
+/*
+ ==============================================
+ Name        : test_SN74HC164N.c
+ Author      :
+ Version     :
+ Description : Host test for SN74HC164N.c: a model of the register on the
+             : GPIO pins must end up holding every value bit-banged into
+             : it, the same value the SSP port would shift in, and only
+             : changed values or due refreshes are sent. Prints the GPIO
+             : writes per second against the old shift-and-clear loop
+             : for a static value and for changing ones.
+ ==============================================
+ */
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "SN74HC164N.c"
+
+#define PIN_A     7
+#define PIN_CLEAR 8
+#define PIN_CLOCK 9
+
+// The register: A shifts into QA on a rising clock, clear low empties it
+typedef struct {
+    uint8_t q;
+    int clock;
+    int num_clocks;
+} shift_register;
+
+static void shift_register_update(shift_register *reg, uint32_t pins){
+    int clock = (pins >> PIN_CLOCK) & 1;
+
+    if (!((pins >> PIN_CLEAR) & 1)){
+        reg->q = 0;
+    } else if (clock && !reg->clock){
+        reg->q = (uint8_t) ((reg->q << 1) | ((pins >> PIN_A) & 1));
+        reg->num_clocks++;
+    }
+    reg->clock = clock;
+}
+
+// The register after an 8-bit SSP frame, sent most significant bit first
+static uint8_t ssp_shift(uint8_t q, uint32_t frame){
+    for (int b = 7; b >= 0; b--) q = (uint8_t) ((q << 1) | ((frame >> b) & 1));
+    return q;
+}
+
+static void init_gpio(SN74HC164N_state *state, volatile uint32_t *pins){
+    SN74HC164N_init(state);
+    state->reg_clock  = state->reg_clear = state->reg_a = pins;
+    state->mask_clock = 1 << PIN_CLOCK;
+    state->mask_clear = 1 << PIN_CLEAR;
+    state->mask_a     = 1 << PIN_A;
+}
+
+static void init_ssp(SN74HC164N_state *state, volatile uint32_t *dr,
+        volatile uint32_t *sr){
+    SN74HC164N_init(state);
+    state->reg_ssp_data   = dr;
+    state->reg_ssp_status = sr;
+}
+
+// Both ways of driving the register leave the same bits in it
+static void test_bit_order(void){
+    int mismatches = 0;
+
+    for (int v = 0; v < 256; v++){
+        SN74HC164N_state gpio, ssp;
+        shift_register reg = {0xA5, 0, 0};
+        volatile uint32_t pins = 1 << PIN_CLEAR;
+        volatile uint32_t dr = 0, sr = SN74HC164N_SSP_TNF;
+
+        init_gpio(&gpio, &pins);
+        gpio.bits = v;
+        for (int t = 0; t < 40; t++){
+            SN74HC164N_step(&gpio);
+            shift_register_update(&reg, pins);
+        }
+
+        init_ssp(&ssp, &dr, &sr);
+        ssp.bits = v;
+        SN74HC164N_step(&ssp);
+
+        if (reg.q != v || ssp_shift(0xA5, dr) != v || reg.num_clocks != 8){
+            mismatches++;
+        }
+        CHECK(gpio.num_updates == 1 && gpio.busy_ticks == 32);
+    }
+    CHECK(mismatches == 0);
+}
+
+// An unchanged value is not shifted again until a refresh is due
+static void test_changes_only(void){
+    SN74HC164N_state state;
+    volatile uint32_t pins = 1 << PIN_CLEAR;
+    volatile uint32_t dr = 0, sr = SN74HC164N_SSP_TNF;
+    int sends = 0;
+
+    init_gpio(&state, &pins);
+    for (int t = 0; t < 10000; t++){
+        state.bits = t / 1000;
+        SN74HC164N_step(&state);
+    }
+    CHECK(state.num_updates == 10);
+    CHECK(state.busy_ticks == 10 * 32);
+
+    // The refresh counts idle steps, the last of which starts the shift
+    state.refresh_interval = 100;
+    state.idle_ticks = 0;
+    for (int t = 0; t < 10 * (100 + 31); t++) SN74HC164N_step(&state);
+    CHECK(state.num_updates == 10 + 10);
+
+    init_ssp(&state, &dr, &sr);
+    for (int t = 0; t < 10000; t++){
+        state.bits = t / 1000;
+        sends += SN74HC164N_update(&state);
+    }
+    CHECK(sends == 10);
+
+    // A full FIFO defers the value to a later update
+    sr = 0;
+    state.bits = 99;
+    CHECK(SN74HC164N_update(&state) == 0);
+    sr = SN74HC164N_SSP_TNF;
+    CHECK(SN74HC164N_update(&state) == 1 && dr == 99);
+}
+
+// Clearing leaves the clear input released and a zero to compare against
+static void test_clear(void){
+    SN74HC164N_state state;
+    volatile uint32_t pins = 1 << PIN_CLEAR;
+
+    init_gpio(&state, &pins);
+    state.bits = 0;
+    state.sent = 0x3C;
+    SN74HC164N_clear(&state);
+    CHECK(state.sent == 0 && (pins & (1 << PIN_CLEAR)));
+    SN74HC164N_step(&state);
+    CHECK(state.step == 0 && state.busy_ticks == 0);
+}
+
+#define TICK_RATE 25000     // main.c's TIMER0 rate, one step per tick
+
+/*
+ * The step as it was before values were only shifted on a change: shift
+ * all 8 bits, hold for holdtime ticks, pulse clear, and start over.
+ * Counts its GPIO writes.
+ */
+typedef struct {
+    int step;
+    int bits;
+    int holdtime;
+    int num_writes;
+} legacy_state;
+
+static void legacy_step(legacy_state *state){
+    if (state->step <= 31 && state->step % 4 != 3) state->num_writes++;
+    if (state->step >= state->holdtime){
+        int clearstep = state->step - state->holdtime;
+        if (clearstep >= 1 && clearstep <= 4) state->num_writes++;
+        if (clearstep > 5) state->step = -1;
+    }
+    state->step++;
+}
+
+// Steps state once, returning the GPIO writes that took: one for each
+// of the first three substeps of a bit, none for the spare one
+static int gpio_writes(SN74HC164N_state *state){
+    int substep = state->step % 4;
+    uint32_t busy = state->busy_ticks;
+
+    SN74HC164N_step(state);
+    return state->busy_ticks != busy && substep != 3;
+}
+
+/*
+ * A second of ticks with the value changing changes_per_second times,
+ * through the old loop with main.c's former holdtime of 200 and the
+ * change-driven step with its once a second refresh.
+ */
+static void writes_per_second(const char *name, int changes_per_second){
+    SN74HC164N_state state;
+    legacy_state old = {0, 0, 200, 0};
+    volatile uint32_t pins = 1 << PIN_CLEAR;
+    int writes = 0;
+
+    init_gpio(&state, &pins);
+    state.refresh_interval = TICK_RATE;
+    // Already showing the first value
+    state.sent = 0;
+    for (int t = 0; t < TICK_RATE; t++){
+        int bits = changes_per_second ?
+            (t / (TICK_RATE / changes_per_second)) & 0xFF : 0;
+        old.bits = state.bits = bits;
+        legacy_step(&old);
+        writes += gpio_writes(&state);
+    }
+    // Finish a shift the second ended in
+    while (state.step != 0) writes += gpio_writes(&state);
+
+    printf("%-20s %11d %10d %10lu %8lu\n", name, old.num_writes, writes,
+        (unsigned long) state.busy_ticks, (unsigned long) state.num_updates);
+    CHECK(writes == 24 * (int) state.num_updates);
+    CHECK(state.num_updates <= (uint32_t) changes_per_second + 1);
+    CHECK(writes < old.num_writes);
+}
+
+static void test_writes_per_second(void){
+    printf("value                old writes new writes busy ticks  updates\n");
+    writes_per_second("static", 0);
+    writes_per_second("changing 10/s", 10);
+    writes_per_second("changing 100/s", 100);
+}
+
+int main(void){
+    test_bit_order();
+    test_changes_only();
+    test_clear();
+    test_writes_per_second();
+    return test_done("test_SN74HC164N");
+}
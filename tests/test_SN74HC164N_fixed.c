@@ -0,0 +1,109 @@
+/*
+ ==============================================
+ Name        : test_SN74HC164N_fixed.c
+ Author      :
+ Version     :
+ Description : Host test for SN74HC164N.c with SN74HC164N_FIXED_ENABLED:
+             : the FIOSET and FIOCLR stores of the fixed-pin schedule must
+             : shift every value into a model of the register, on its
+             : own and through SN74HC164N_substep, and refresh_interval
+             : must still apply.
+ ==============================================
+ */
+
+#define SN74HC164N_FIXED_ENABLED 1
+#define SN74HC164N_FIXED_REFRESH 100
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "SN74HC164N.c"
+
+#define CLOCK_MASK (1 << SN74HC164N_FIXED_CLOCK)
+#define A_MASK     (1 << SN74HC164N_FIXED_A)
+
+typedef struct {
+    uint32_t pins;
+    uint8_t q;
+    int num_stores;
+} fixed_pins;
+
+// Applies the stores since the last call, then clocks the register
+static void settle(fixed_pins *p){
+    uint32_t before = p->pins;
+
+    p->num_stores += (LPC_GPIO0->FIOSET != 0) + (LPC_GPIO0->FIOCLR != 0);
+    p->pins |= LPC_GPIO0->FIOSET;
+    p->pins &= ~LPC_GPIO0->FIOCLR;
+    LPC_GPIO0->FIOSET = 0;
+    LPC_GPIO0->FIOCLR = 0;
+    if ((p->pins & CLOCK_MASK) && !(before & CLOCK_MASK)){
+        p->q = (uint8_t) ((p->q << 1) | ((p->pins & A_MASK) != 0));
+    }
+}
+
+static void test_values(void){
+    SN74HC164N_state state;
+    fixed_pins p = {0, 0, 0};
+    int mismatches = 0;
+
+    SN74HC164N_init(&state);
+    CHECK(state.refresh_interval == SN74HC164N_FIXED_REFRESH);
+    for (int v = 0; v < 256; v++){
+        state.bits = v ^ 0x5A;
+        for (int t = 0; t < 40; t++){
+            SN74HC164N_step(&state);
+            settle(&p);
+        }
+        if (p.q != (v ^ 0x5A)) mismatches++;
+    }
+    CHECK(mismatches == 0);
+    CHECK(state.num_updates == 256);
+
+    // At most one store per substep
+    CHECK(p.num_stores <= 256 * 32);
+}
+
+static void test_refresh(void){
+    SN74HC164N_state state;
+    fixed_pins p = {0, 0, 0};
+
+    SN74HC164N_init(&state);
+    state.bits = 0x81;
+    for (int t = 0; t < 32; t++){
+        SN74HC164N_step(&state);
+        settle(&p);
+    }
+    CHECK(state.num_updates == 1 && p.q == 0x81);
+
+    // A refresh every refresh_interval idle steps, the last starting it
+    for (int t = 0; t < 10 * (SN74HC164N_FIXED_REFRESH + 31); t++){
+        SN74HC164N_step(&state);
+        settle(&p);
+    }
+    CHECK(state.num_updates == 1 + 10 && p.q == 0x81);
+
+    state.refresh_interval = 0;
+    for (int t = 0; t < 1000; t++) SN74HC164N_step(&state);
+    CHECK(state.num_updates == 1 + 10);
+}
+
+// Callers that shift their own bits, like framebuffer.c, get the same pins
+static void test_substep(void){
+    SN74HC164N_state state;
+    fixed_pins p = {0, 0, 0};
+    int value = 0xC3;
+
+    SN74HC164N_init(&state);
+    for (int n = 0; n < 32; n++){
+        SN74HC164N_substep(&state, n % 4, (value >> (7 - n / 4)) & 1);
+        settle(&p);
+    }
+    CHECK(p.q == value);
+}
+
+int main(void){
+    test_values();
+    test_refresh();
+    test_substep();
+    return test_done("test_SN74HC164N_fixed");
+}
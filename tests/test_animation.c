@@ -0,0 +1,141 @@
+/*
+ ==============================================
+ Name        : test_animation.c
+ Author      :
+ Version     :
+ Description : Host test for animation.c: keyframe timing and looping,
+             : winding a track to its phase, dimming and layering, and
+             : the two chasers of main_shift_reg_1.c matching the frames
+             : its old busy loop drew.
+ ==============================================
+ */
+
+#include "test.h"
+#include "animation.c"
+
+static const animation_keyframe blink_keys[3] = {
+    {0x01, 2}, {0x00, 0}, {0x02, 3}
+};
+
+static void test_keyframes(void){
+    const animation_track blink = {blink_keys, 3, 0, 1};
+    const unsigned char want[10] = {1, 1, 2, 2, 2, 1, 1, 2, 2, 2};
+    animation_state anim;
+
+    animation_init(&anim);
+    CHECK(animation_add_track(&anim, &blink) == 0);
+    for (int f = 0; f < 10; f++) CHECK(animation_next(&anim) == want[f]);
+    CHECK(anim.frame == 10);
+}
+
+// A track added at phase p shows what one at phase 0 shows p frames on
+static void test_phase(void){
+    const animation_keyframe keys[4] = {{0x01, 3}, {0x02, 1}, {0x04, 0},
+        {0x08, 4}};
+    unsigned char want[40];
+    animation_state anim;
+
+    animation_track track = {keys, 4, 0, 1};
+    animation_init(&anim);
+    animation_add_track(&anim, &track);
+    for (int f = 0; f < 40; f++) want[f] = animation_next(&anim);
+
+    for (int phase = 1; phase < 20; phase++){
+        int mismatches = 0;
+        track.phase = phase;
+        animation_init(&anim);
+        animation_add_track(&anim, &track);
+        for (int f = 0; f + phase < 40; f++){
+            if (animation_next(&anim) != want[f + phase]) mismatches++;
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+// A dimmed track is lit one frame in dim_period and blanks what is below
+static void test_dim_and_layers(void){
+    const animation_keyframe base_keys[1] = {{0xFF, 1}};
+    const animation_keyframe dim_keys[1] = {{0x0F, 1}};
+    const animation_track base = {base_keys, 1, 0, 1};
+    const animation_track dim = {dim_keys, 1, 0, 3};
+    animation_state anim;
+
+    animation_init(&anim);
+    animation_add_track(&anim, &base);
+    animation_add_track(&anim, &dim);
+    for (int f = 0; f < 12; f++){
+        CHECK(animation_next(&anim) == (f % 3 == 0 ? 0xFF : 0xF0));
+    }
+}
+
+static void test_add_track(void){
+    const animation_keyframe empty_keys[1] = {{0x01, 0}};
+    const animation_track empty = {empty_keys, 1, 0, 1};
+    const animation_track none = {blink_keys, 0, 0, 1};
+    const animation_track undimmable = {blink_keys, 3, 0, 0};
+    const animation_track blink = {blink_keys, 3, 0, 1};
+    animation_state anim;
+
+    animation_init(&anim);
+    CHECK(animation_add_track(&anim, &empty) == -1);
+    CHECK(animation_add_track(&anim, &none) == -1);
+    CHECK(animation_add_track(&anim, &undimmable) == -1);
+    for (int i = 0; i < ANIMATION_MAX_TRACKS; i++){
+        CHECK(animation_add_track(&anim, &blink) == 0);
+    }
+    CHECK(animation_add_track(&anim, &blink) == -1);
+    CHECK(anim.num_tracks == ANIMATION_MAX_TRACKS);
+}
+
+// The tables main_shift_reg_1.c animates
+static const animation_keyframe chaser_keys[8] = {
+    {1 << 1, 1000}, {1 << 2, 1000}, {1 << 3, 1000}, {1 << 4, 1000},
+    {1 << 5, 1000}, {1 << 6, 1000}, {1 << 7, 1000}, {1 << 0, 1000},
+};
+static const animation_keyframe chaser_2_keys[8] = {
+    {1 << 0, 2500}, {1 << 7, 2500}, {1 << 6, 2500}, {1 << 5, 2500},
+    {1 << 4, 2500}, {1 << 3, 2500}, {1 << 2, 2500}, {1 << 1, 2500},
+};
+
+/*
+ * The frame the old busy loop drew on its n-th pass: one chaser moving
+ * up every 1000 passes, and one moving down every 2500, lit on every
+ * third pass only, and blanking the first where they meet.
+ */
+static unsigned char busy_loop_frame(int n){
+    int cycle = n + 1;
+    int up = (n / 1000 + 1) % 8;
+    int down = (8 - cycle / 2500 % 8) % 8;
+    unsigned char bits = 1 << up;
+
+    if (cycle % 3 == 0) bits |= 1 << down;
+    else bits &= ~(1 << down);
+    return bits;
+}
+
+// Frames before both chasers and the dimming are back where they started
+#define CHASER_FRAMES 120000
+
+static void test_chasers(void){
+    const animation_track chaser   = {chaser_keys, 8, 0, 1};
+    const animation_track chaser_2 = {chaser_2_keys, 8, 1, 3};
+    animation_state anim;
+    int mismatches = 0;
+
+    animation_init(&anim);
+    CHECK(animation_add_track(&anim, &chaser) == 0);
+    CHECK(animation_add_track(&anim, &chaser_2) == 0);
+    for (int n = 0; n < CHASER_FRAMES; n++){
+        if (animation_next(&anim) != busy_loop_frame(n)) mismatches++;
+    }
+    CHECK(mismatches == 0);
+}
+
+int main(void){
+    test_keyframes();
+    test_phase();
+    test_dim_and_layers();
+    test_add_track();
+    test_chasers();
+    return test_done("test_animation");
+}
@@ -0,0 +1,181 @@
+/*
+ ==============================================
+ Name        : test_arq.c
+ Author      :
+ Version     :
+ Description : Host test for arq.c: a simulated forward link and return
+             : ack link, each busy for a frame time and dropping frames
+             : at random. Every message must arrive once and in order,
+             : a lost frame is resent on the bitmap rather than on
+             : timeout, and the window keeps the forward link busy.
+             : Prints goodput and delivery latency for each window size
+             : at several loss rates.
+ ==============================================
+ */
+
+#include <stdlib.h>
+#include "test.h"
+#include "arq.c"
+
+#define NUM_MESSAGES 500
+#define FRAME_TICKS  400    // Data frame on the forward link
+#define ACK_TICKS    120    // Ack frame on the return link
+#define DELAY_TICKS  50     // Propagation and processing, each way
+#define FLIGHT_SLOTS 4      // Frames on the forward link at once
+
+typedef struct {
+    int ticks;              // Until every message was delivered
+    int in_order;           // Every message arrived once, in order
+    int num_retransmits;
+    int num_timeouts;
+    double mean_latency;    // Ticks from queued to delivered
+    int max_latency;
+} link_result;
+
+// Drops a frame with probability loss (0-1000 per mille)
+static int lost(int loss){
+    return (int) (test_rand() % 1000) < loss;
+}
+
+/*
+ * Sends NUM_MESSAGES messages with at most window frames in flight.
+ * Each link carries one frame at a time; frames and acks are dropped
+ * at the given rates, and corrupted instead when corrupt is set.
+ */
+static link_result run_link(int window, int data_loss, int ack_loss,
+        int corrupt){
+    arq_sender s;
+    arq_receiver r;
+    link_result res = {0, 1, 0, 0, 0, 0};
+    static int queued_at[NUM_MESSAGES];
+    double total_latency = 0;
+    char frame[ARQ_FRAME_LEN], in_flight[FLIGHT_SLOTS][ARQ_FRAME_LEN];
+    char ack[ARQ_ACK_LEN], out[ARQ_MAX_PAYLOAD + 1];
+    int arrives[FLIGHT_SLOTS];
+    int queued = 0, delivered = 0, head = 0, tail = 0;
+    int forward_free = 0;
+    int ack_free = 0, ack_arrives = -1, ack_due = 0;
+    int t;
+
+    arq_sender_init(&s, 2 * (FRAME_TICKS + ACK_TICKS + 2 * DELAY_TICKS));
+    arq_receiver_init(&r);
+    for (t = 0; delivered < NUM_MESSAGES && t < 10000000; t++){
+        while (queued < NUM_MESSAGES && arq_sender_pending(&s) < window){
+            queued_at[queued] = t;
+            int len = sprintf(frame, "msg%d", queued++);
+            arq_sender_queue(&s, frame, len);
+        }
+
+        // Forward link: one frame at a time, lost or corrupted on the way
+        if (t >= forward_free && arq_sender_next(&s, t, frame) >= 0){
+            forward_free = t + FRAME_TICKS;
+            int drop = lost(data_loss);
+            if (drop && corrupt) frame[1] ^= 0x04;
+            if (!drop || corrupt){
+                strcpy(in_flight[tail % FLIGHT_SLOTS], frame);
+                arrives[tail++ % FLIGHT_SLOTS] = t + FRAME_TICKS + DELAY_TICKS;
+            }
+        }
+        if (head != tail && t >= arrives[head % FLIGHT_SLOTS]){
+            if (arq_receiver_accept(&r, in_flight[head++ % FLIGHT_SLOTS]) > 0){
+                while (arq_receiver_deliver(&r, out) >= 0){
+                    if (atoi(out + 3) != delivered) res.in_order = 0;
+                    int latency = t - queued_at[delivered++];
+                    total_latency += latency;
+                    if (latency > res.max_latency) res.max_latency = latency;
+                }
+            }
+            ack_due = 1;
+        }
+
+        // Return link: the newest ack replaces one not yet started
+        if (ack_due && t >= ack_free && ack_arrives < 0){
+            arq_receiver_ack(&r, ack, 0);
+            ack_due = 0;
+            ack_free = t + ACK_TICKS;
+            if (!lost(ack_loss)) ack_arrives = t + ACK_TICKS + DELAY_TICKS;
+        }
+        if (ack_arrives >= 0 && t >= ack_arrives){
+            ack_arrives = -1;
+            arq_sender_ack(&s, ack);
+        }
+    }
+    res.ticks = t;
+    res.num_retransmits = s.num_retransmits;
+    res.num_timeouts = s.num_timeouts;
+    if (delivered > 0) res.mean_latency = total_latency / delivered;
+    return res;
+}
+
+// Ticks the messages would take back to back on a perfect link
+#define IDEAL_TICKS (NUM_MESSAGES * FRAME_TICKS)
+
+static void test_lossless(void){
+    link_result stop_and_wait = run_link(1, 0, 0, 0);
+    link_result windowed = run_link(ARQ_WINDOW, 0, 0, 0);
+
+    CHECK(stop_and_wait.in_order && windowed.in_order);
+    CHECK(windowed.num_retransmits == 0);
+    // Stop-and-wait idles for the ack round trip after every frame
+    CHECK(stop_and_wait.ticks > IDEAL_TICKS * 3 / 2);
+    CHECK(windowed.ticks < IDEAL_TICKS * 21 / 20);
+}
+
+// With acks intact, every lost data frame is resent on the bitmap
+static void test_selective_repeat(void){
+    link_result res = run_link(ARQ_WINDOW, 100, 0, 0);
+
+    CHECK(res.in_order);
+    CHECK(res.num_retransmits > 0);
+    CHECK(res.num_timeouts < res.num_retransmits / 4);
+}
+
+/*
+ * Every window size at each loss rate, on both links. With the full
+ * window, goodput stays close to the share of frames that get through.
+ */
+static void test_lossy(void){
+    const int losses[] = {0, 50, 100, 200, 300};
+
+    printf("window  loss  goodput  mean latency  max latency  resent\n");
+    for (int window = 1; window <= ARQ_WINDOW; window++){
+        for (int i = 0; i < 5; i++){
+            link_result res = run_link(window, losses[i], losses[i], 0);
+            double goodput = (double) IDEAL_TICKS / res.ticks;
+            printf("%6d  %3d%%  %6.0f%%  %12.0f  %11d  %6d\n", window,
+                losses[i] / 10, goodput * 100, res.mean_latency,
+                res.max_latency, res.num_retransmits);
+            CHECK(res.in_order);
+            CHECK(res.max_latency >= FRAME_TICKS + DELAY_TICKS);
+            if (window == ARQ_WINDOW){
+                CHECK(goodput > (1000 - losses[i]) / 1000.0 - 0.2);
+            }
+        }
+    }
+}
+
+static void test_corrupted(void){
+    arq_receiver r;
+    link_result res = run_link(ARQ_WINDOW, 200, 0, 1);
+    char frame[ARQ_FRAME_LEN];
+
+    CHECK(res.in_order);
+
+    arq_receiver_init(&r);
+    strcpy(frame, "@abc");
+    frame[4] = (char) (ARQ_HEADER_BASE + (arq_crc8(frame, 4) >> 4));
+    frame[5] = (char) (ARQ_HEADER_BASE + (arq_crc8(frame, 4) & 0x0F));
+    frame[6] = '\0';
+    CHECK(arq_receiver_accept(&r, frame) == 1);
+    frame[2] ^= 1;
+    CHECK(arq_receiver_accept(&r, frame) == -1);
+    CHECK(r.num_rejected == 1);
+}
+
+int main(void){
+    test_lossless();
+    test_selective_repeat();
+    test_lossy();
+    test_corrupted();
+    return test_done("test_arq");
+}
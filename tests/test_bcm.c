@@ -0,0 +1,131 @@
+/*
+ ==============================================
+ Name        : test_bcm.c
+ Author      :
+ Version     :
+ Description : Host test for bcm.c: over one cycle every output is lit
+             : for exactly its level in ticks, planes come BCM_BITS to a
+             : cycle, and a level changed mid-cycle only takes effect at
+             : the next one.
+ ==============================================
+ */
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "SN74HC164N.c"
+#include "bcm.c"
+
+// Steps until the next step starts a new cycle
+static void align(bcm_state *bcm){
+    int bits;
+    while (!(bcm->plane == BCM_BITS - 1 && bcm->ticks_left <= 1)){
+        bcm_step(bcm, &bits);
+    }
+}
+
+// Ticks each output is lit over the next cycle
+static void run_cycle(bcm_state *bcm, int *lit, int *shown){
+    for (int i = 0; i < BCM_OUTPUTS; i++) lit[i] = 0;
+    for (int t = 0; t < BCM_CYCLE_TICKS; t++){
+        bcm_step(bcm, shown);
+        for (int i = 0; i < BCM_OUTPUTS; i++) lit[i] += (*shown >> i) & 1;
+    }
+}
+
+static void test_duty(void){
+    bcm_state bcm;
+    int levels[BCM_OUTPUTS], lit[BCM_OUTPUTS], shown = 0;
+    int mismatches = 0;
+
+    bcm_init(&bcm);
+    for (int trial = 0; trial < 200; trial++){
+        for (int i = 0; i < BCM_OUTPUTS; i++){
+            levels[i] = trial <= BCM_MAX_LEVEL ? (trial + i) % (BCM_MAX_LEVEL + 1)
+                                               : test_rand() % (BCM_MAX_LEVEL + 1);
+            bcm_set_level(&bcm, i, levels[i]);
+        }
+        align(&bcm);
+        run_cycle(&bcm, lit, &shown);
+        for (int i = 0; i < BCM_OUTPUTS; i++){
+            if (lit[i] != levels[i]) mismatches++;
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+static void test_levels(void){
+    bcm_state bcm;
+
+    bcm_init(&bcm);
+    bcm_set_level(&bcm, 0, BCM_MAX_LEVEL + 10);
+    bcm_set_level(&bcm, 1, -3);
+    CHECK(bcm.levels[0] == BCM_MAX_LEVEL && bcm.levels[1] == 0);
+
+    bcm_set_byte(&bcm, 0xA5, 9);
+    for (int i = 0; i < BCM_OUTPUTS; i++){
+        CHECK(bcm.levels[i] == ((0xA5 >> i) & 1 ? 9 : 0));
+    }
+}
+
+// BCM_BITS register updates per cycle, however the levels are set
+static void test_planes(void){
+    bcm_state bcm;
+    SN74HC164N_state sreg;
+    volatile uint32_t dr = 0, sr = SN74HC164N_SSP_TNF;
+    int bits;
+
+    bcm_init(&bcm);
+    SN74HC164N_init(&sreg);
+    sreg.reg_ssp_data   = &dr;
+    sreg.reg_ssp_status = &sr;
+    for (int i = 0; i < BCM_OUTPUTS; i++){
+        bcm_set_level(&bcm, i, (i * 37 + 5) % (BCM_MAX_LEVEL + 1));
+    }
+    for (int t = 0; t < 100 * BCM_CYCLE_TICKS; t++){
+        if (bcm_step(&bcm, &bits)){
+            sreg.bits = bits;
+            SN74HC164N_update(&sreg);
+        }
+    }
+    CHECK(bcm.num_planes == 100 * BCM_BITS);
+    CHECK(sreg.num_updates <= bcm.num_planes);
+
+    // Equal planes are not shifted again
+    bcm_init(&bcm);
+    SN74HC164N_init(&sreg);
+    sreg.reg_ssp_data   = &dr;
+    sreg.reg_ssp_status = &sr;
+    bcm_set_byte(&bcm, 0xA5, BCM_MAX_LEVEL);
+    for (int t = 0; t < 100 * BCM_CYCLE_TICKS; t++){
+        if (bcm_step(&bcm, &bits)){
+            sreg.bits = bits;
+            SN74HC164N_update(&sreg);
+        }
+    }
+    CHECK(sreg.num_updates == 1 && dr == 0xA5);
+}
+
+static void test_mid_cycle_change(void){
+    bcm_state bcm;
+    int lit[BCM_OUTPUTS], shown = 0, on = 0;
+
+    bcm_init(&bcm);
+    bcm_set_level(&bcm, 0, 1);
+    align(&bcm);
+    for (int t = 0; t < BCM_CYCLE_TICKS; t++){
+        if (t == BCM_CYCLE_TICKS / 2) bcm_set_level(&bcm, 0, BCM_MAX_LEVEL);
+        bcm_step(&bcm, &shown);
+        on += shown & 1;
+    }
+    CHECK(on == 1);
+    run_cycle(&bcm, lit, &shown);
+    CHECK(lit[0] == BCM_MAX_LEVEL);
+}
+
+int main(void){
+    test_duty();
+    test_levels();
+    test_planes();
+    test_mid_cycle_change();
+    return test_done("test_bcm");
+}
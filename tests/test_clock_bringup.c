@@ -0,0 +1,322 @@
+/*
+ ==============================================
+ Name        : test_clock_bringup.c
+ Author      :
+ Version     :
+ Description : Host test for apply_clock_settings against a simulated SC
+             : register block. The block sits on its own page with no
+             : access rights, so every register access traps; the model
+             : then updates PLL0STAT and SCS from simulated time, latches
+             : PLL0CON and PLL0CFG on a feed, and counts any step that
+             : breaks the user manual's rules: flash too fast for cclk,
+             : connecting before lock, PLL0CFG changed while enabled, or
+             : the clock source changed while connected.
+             :
+             : x86-64 Linux only; built at -O0 so each register access is
+             : a separate load or store.
+ ==============================================
+ */
+
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include "LPC17xx.h"
+#include "test.h"
+
+static LPC_SC_TypeDef *sim_sc;
+#undef LPC_SC
+#define LPC_SC sim_sc
+
+// Each read of the cycle counter costs a few cycles of simulated time
+static uint32_t sim_cycles;
+static void sim_advance(int cycles);
+#define CLOCK_DWT_CYCCNT (sim_advance(3), sim_cycles)
+
+#include "clock_util.c"
+
+#define SIM_PAGE 4096
+#define FLASHCFG_LOW_BITS 0x03A     // Reset value, to be left alone
+
+static const int sim_sources[4] = {
+    CLOCK_SPEED_IRC_OSC, CLOCK_SPEED_OSC_CLK, CLOCK_SPEED_RTC_CLK,
+    CLOCK_SPEED_IRC_OSC
+};
+
+// Hardware the registers stand for
+static struct {
+    uint32_t pll0con;           // PLL0CON and PLL0CFG as of the last feed
+    uint32_t pll0cfg;
+    int feed_started;           // 0xAA written, 0x55 next
+    double now_us;
+    double pll_enabled_us;      // When PLL0 was enabled, or -1
+    double osc_enabled_us;      // When the oscillator was started, or -1
+    double lock_us;             // Time PLL0 takes to lock
+    double osc_us;              // Time the oscillator takes to start
+    int never_lock;
+    int never_osc;
+    int violations;
+    uint32_t access_offset;     // Register being accessed, and how
+    int access_write;
+} sim;
+
+static int sim_locked(void){
+    return (sim_sc->PLL0STAT & CLOCK_PLL0_PLOCK) != 0;
+}
+
+static double sim_cclk(void){
+    double f = sim_sources[sim_sc->CLKSRCSEL & 3];
+
+    if ((sim.pll0con & 3) == 3 && sim_locked()){
+        f = 2.0 * ((sim.pll0cfg & 0x7FFF) + 1) * f /
+            (((sim.pll0cfg >> 16) & 0xFF) + 1);
+    }
+    return f / ((sim_sc->CCLKCFG & 0xFF) + 1);
+}
+
+static void sim_advance(int cycles){
+    sim_cycles += cycles;
+    sim.now_us += cycles / sim_cclk() * 1e6;
+}
+
+// Status bits follow the latched control bits and the time since enabling
+static void sim_update_status(void){
+    uint32_t stat = (sim.pll0cfg & 0x00FF7FFF) | ((sim.pll0con & 3) << 24);
+    uint32_t scs = sim_sc->SCS & ~CLOCK_SCS_OSCSTAT;
+
+    if ((sim.pll0con & 1) && !sim.never_lock && sim.pll_enabled_us >= 0 &&
+            sim.now_us - sim.pll_enabled_us >= sim.lock_us){
+        stat |= CLOCK_PLL0_PLOCK;
+    }
+    if ((scs & CLOCK_SCS_OSCEN) && !sim.never_osc && sim.osc_enabled_us >= 0 &&
+            sim.now_us - sim.osc_enabled_us >= sim.osc_us){
+        scs |= CLOCK_SCS_OSCSTAT;
+    }
+    sim_sc->PLL0STAT = stat;
+    sim_sc->SCS = scs;
+}
+
+// Flash cycles needed at cclk f, per the user manual's table
+static int sim_flash_time(double f){
+    if (f <= 20e6) return 0;
+    if (f <= 40e6) return 1;
+    if (f <= 60e6) return 2;
+    if (f <= 80e6) return 3;
+    if (f <= 120e6) return 4;
+    return 5;
+}
+
+static void sim_check(void){
+    double f = sim_cclk();
+
+    if ((int) ((sim_sc->FLASHCFG >> CLOCK_FLASHTIM_SHIFT) & 0xF) <
+            sim_flash_time(f)) sim.violations++;
+    if (f > CLOCK_SPEED_CCLK_MAX + 1) sim.violations++;
+    if ((sim.pll0con & 3) == 3 && !sim_locked()) sim.violations++;
+}
+
+static void sim_write(uint32_t offset, uint32_t value){
+    if (offset == offsetof(LPC_SC_TypeDef, PLL0FEED)){
+        if (value == 0xAA){
+            sim.feed_started = 1;
+        } else if (value == 0x55 && sim.feed_started){
+            uint32_t con = sim_sc->PLL0CON & 3, cfg = sim_sc->PLL0CFG;
+            if (cfg != sim.pll0cfg && (sim.pll0con & 1)) sim.violations++;
+            if ((con & 2) && !sim_locked()) sim.violations++;
+            if ((con & 1) && !(sim.pll0con & 1)) sim.pll_enabled_us = sim.now_us;
+            if (!(con & 1)) sim.pll_enabled_us = -1;
+            sim.pll0con = con;
+            sim.pll0cfg = cfg;
+            sim.feed_started = 0;
+        } else {
+            sim.feed_started = 0;
+        }
+        sim_sc->PLL0FEED = 0;
+        return;
+    }
+    sim.feed_started = 0;
+    if (offset == offsetof(LPC_SC_TypeDef, CLKSRCSEL) && (sim.pll0con & 2)){
+        sim.violations++;
+    }
+    if (offset == offsetof(LPC_SC_TypeDef, SCS) && (value & CLOCK_SCS_OSCEN) &&
+            sim.osc_enabled_us < 0){
+        sim.osc_enabled_us = sim.now_us;
+    }
+    if (offset == offsetof(LPC_SC_TypeDef, FLASHCFG) &&
+            (value & 0xFFF) != FLASHCFG_LOW_BITS){
+        sim.violations++;
+    }
+}
+
+// An access to the block: open it up and single-step the instruction
+static void sim_fault(int sig, siginfo_t *info, void *context){
+    ucontext_t *uc = context;
+    (void) sig;
+
+    sim.access_offset = (uint32_t) ((char *) info->si_addr - (char *) sim_sc);
+    sim.access_write = (uc->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+    mprotect(sim_sc, SIM_PAGE, PROT_READ | PROT_WRITE);
+    sim_advance(4);
+    sim_update_status();
+    uc->uc_mcontext.gregs[REG_EFL] |= 0x100;
+}
+
+// The access is done: let the hardware react, then close the block again
+static void sim_step(int sig, siginfo_t *info, void *context){
+    ucontext_t *uc = context;
+    (void) sig;
+    (void) info;
+
+    uc->uc_mcontext.gregs[REG_EFL] &= ~0x100;
+    if (sim.access_write){
+        sim_write(sim.access_offset,
+            *(uint32_t *) ((char *) sim_sc + sim.access_offset));
+    }
+    sim_update_status();
+    sim_check();
+    mprotect(sim_sc, SIM_PAGE, PROT_NONE);
+}
+
+// From reset, or as left by an earlier bring-up to 120 MHz from the IRC
+static void sim_reset(int from_pll){
+    mprotect(sim_sc, SIM_PAGE, PROT_READ | PROT_WRITE);
+    memset(sim_sc, 0, SIM_PAGE);
+    memset(&sim, 0, sizeof(sim));
+    sim.pll_enabled_us = sim.osc_enabled_us = -1;
+    sim.lock_us = 300;
+    sim.osc_us  = 1500;
+    sim_sc->FLASHCFG = FLASHCFG_LOW_BITS | (5 << CLOCK_FLASHTIM_SHIFT);
+    if (from_pll){
+        sim.pll0con = 3;
+        sim.pll0cfg = 89 | (1 << 16);
+        sim.pll_enabled_us = 0;
+        sim.now_us = 1e6;
+        sim_sc->FLASHCFG = FLASHCFG_LOW_BITS | (4 << CLOCK_FLASHTIM_SHIFT);
+        sim_sc->PLL0CON = sim.pll0con;
+        sim_sc->PLL0CFG = sim.pll0cfg;
+        sim_sc->CCLKCFG = 2;
+    }
+    sim_update_status();
+    mprotect(sim_sc, SIM_PAGE, PROT_NONE);
+}
+
+// Runs apply_clock_settings from the state sim_reset left
+static int sim_apply(clock_settings *settings, int from_pll){
+    double start;
+    int ret;
+
+    sim_reset(from_pll);
+    start = sim.now_us;
+    ret = apply_clock_settings(settings);
+    mprotect(sim_sc, SIM_PAGE, PROT_READ | PROT_WRITE);
+    CHECK(sim.violations == 0);
+
+    // The reported time is the simulated time, to within the few cycles
+    // each reading of the counter takes
+    if (ret == 0){
+        double took = (sim.now_us - start) * 1000;
+        CHECK(global_clock_bringup.total_ns < took * 1.05);
+        CHECK(global_clock_bringup.total_ns > took * 0.95);
+    }
+    return ret;
+}
+
+// Running at the settings' frequency, PLL0 latched as asked
+static int running(const clock_settings *s){
+    int tim = (sim_sc->FLASHCFG >> CLOCK_FLASHTIM_SHIFT) & 0xF;
+    double f = sim_cclk();
+
+    if (f < s->frequency - 1 || f > s->frequency + 1) return 0;
+    if (tim != clock_flash_time(s->frequency)) return 0;
+    if (!s->val_PLL0CON) return (sim.pll0con & 3) == 0;
+    return sim.pll0con == 3 &&
+        (int) ((sim.pll0cfg >> 16) & 0xFF) == s->val_N_factor &&
+        (int) (sim.pll0cfg & 0x7FFF) == s->val_M_factor;
+}
+
+// A failed bring-up is left on the IRC, and says so
+static int on_irc(const clock_settings *s){
+    return sim_cclk() == CLOCK_SPEED_IRC_OSC && sim_sc->CLKSRCSEL == 0 &&
+        s->frequency == CLOCK_SPEED_IRC_OSC && (sim.pll0con & 3) == 0;
+}
+
+// Each frequency from reset and from a PLL already running
+static void test_frequencies(void){
+    const int frequencies[] = {120000000, 100000000, 72000000, 48000000,
+        25000000, 12000000, 4000000, 1000000};
+
+    for (int i = 0; i < 8; i++){
+        for (int from_pll = 0; from_pll < 2; from_pll++){
+            clock_settings s = *calculate_clock_settings(frequencies[i]);
+            CHECK(sim_apply(&s, from_pll) == 0);
+            CHECK(running(&s));
+            if (s.val_PLL0CON){
+                CHECK(global_clock_bringup.lock_us >= 300);
+                CHECK(global_clock_bringup.lock_us <= 320);
+            }
+        }
+    }
+}
+
+// 120 MHz from the 12 MHz main oscillator, which must start first
+static void test_main_oscillator(void){
+    const clock_settings osc = {
+        .frequency = 120000000, .val_CLKSRCSEL = 1, .val_N_factor = 0,
+        .val_M_factor = 14, .val_PLL0CON = 1, .val_D_factor = 2
+    };
+    clock_settings s;
+
+    for (int from_pll = 0; from_pll < 2; from_pll++){
+        s = osc;
+        CHECK(sim_apply(&s, from_pll) == 0);
+        CHECK(running(&s));
+        CHECK(global_clock_bringup.osc_us >= 1500);
+        CHECK(global_clock_bringup.osc_us < 1510);
+    }
+}
+
+// A bring-up that cannot finish falls back to the IRC
+static void test_fallback(void){
+    const clock_settings osc = {
+        .frequency = 120000000, .val_CLKSRCSEL = 1, .val_N_factor = 0,
+        .val_M_factor = 14, .val_PLL0CON = 1, .val_D_factor = 2
+    };
+    clock_settings s;
+
+    s = osc;
+    sim_reset(0);
+    sim.never_osc = 1;
+    mprotect(sim_sc, SIM_PAGE, PROT_NONE);
+    CHECK(apply_clock_settings(&s) == CLOCK_ERR_OSC);
+    mprotect(sim_sc, SIM_PAGE, PROT_READ | PROT_WRITE);
+    CHECK(sim.violations == 0 && on_irc(&s));
+    CHECK(global_clock_bringup.error == CLOCK_ERR_OSC);
+
+    s = *calculate_clock_settings(120000000);
+    sim_reset(0);
+    sim.never_lock = 1;
+    mprotect(sim_sc, SIM_PAGE, PROT_NONE);
+    CHECK(apply_clock_settings(&s) == CLOCK_ERR_PLOCK);
+    mprotect(sim_sc, SIM_PAGE, PROT_READ | PROT_WRITE);
+    CHECK(sim.violations == 0 && on_irc(&s));
+    CHECK(global_clock_bringup.error == CLOCK_ERR_PLOCK);
+}
+
+int main(void){
+    struct sigaction sa;
+
+    sim_sc = mmap(NULL, SIM_PAGE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_flags = SA_SIGINFO;
+    sa.sa_sigaction = sim_fault;
+    sigaction(SIGSEGV, &sa, NULL);
+    sa.sa_sigaction = sim_step;
+    sigaction(SIGTRAP, &sa, NULL);
+
+    test_frequencies();
+    test_main_oscillator();
+    test_fallback();
+    return test_done("test_clock_bringup");
+}
@@ -0,0 +1,160 @@
+/*
+ ==============================================
+ Name        : test_clock_measure.c
+ Author      :
+ Version     :
+ Description : Host test for clock_measure.c: cclk off from nominal by
+             : up to 4%, timed against an RTC crystal up to 20 ppm off,
+             : with the interrupt taking a varying number of cycles to
+             : read the counter. The measured error, the rejection of
+             : faults and the timer tick replanned from the corrected
+             : settings are checked, then counter wraps, restarts and a
+             : suspended window.
+ ==============================================
+ */
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "clock_util.c"
+#include "peripheral_clock.c"
+#include "clock_measure.c"
+
+#define TICK_RATE 25000
+
+/*
+ * Feeds a window of RTC seconds from cclk nominal*(1 + cclk_ppm) and a
+ * second of 1 + rtc_ppm, read between 12 and 312 cycles after each.
+ */
+static void measure(clock_measure_state *m, int nominal, double cclk_ppm,
+        double rtc_ppm){
+    double f = nominal * (1 + cclk_ppm / 1e6), second = 1 + rtc_ppm / 1e6;
+    double t = 0.3;
+    uint64_t start = test_rand();
+    int done = 0;
+
+    clock_measure_init(m, nominal, CLOCK_MEASURE_SECONDS);
+    for (int k = 0; k <= CLOCK_MEASURE_SECONDS && !done; k++){
+        uint32_t now = (uint32_t) (start + (uint64_t) (t * f) + 12 +
+            test_rand() % 300);
+        done = clock_measure_second(m, now);
+        t += second;
+    }
+    CHECK(done && m->num_measurements == 1);
+}
+
+// Each nominal cclk, off by errors up to 40000 ppm, which is a fault
+static void test_measure(void){
+    const double errors[] = {-10000, -5000, -1234.5, -37, 0, 12.3, 800, 9999,
+        25000, 40000};
+    const int nominals[] = {120000000, 100000000, 24000000, 4000000};
+
+    for (int n = 0; n < 4; n++){
+        for (int e = 0; e < 10; e++){
+            int nominal = nominals[n];
+            double rtc_ppm = (double) (test_rand() % 41) - 20;
+            clock_measure_state m;
+            measure(&m, nominal, errors[e], rtc_ppm);
+
+            // cclk as counted in RTC seconds
+            double f = nominal * (1 + errors[e] / 1e6) * (1 + rtc_ppm / 1e6);
+            double want = (f / nominal - 1) * 1e6;
+            clock_settings clock = {.frequency = nominal};
+            int ret = clock_measure_correct(&m, &clock);
+            CHECK((ret != 0) == (fabs(want) > CLOCK_MEASURE_MAX_PPM));
+            if (ret != 0){
+                CHECK(clock.frequency == nominal);
+                continue;
+            }
+            // The read jitter, spread over the window, and rounding
+            CHECK(fabs(m.error_ppm - want) <= 1.5 + 300e6 /
+                ((double) nominal * CLOCK_MEASURE_SECONDS));
+
+            // The tick planned from the corrected settings is as close as
+            // the timer's resolution allows
+            clock_settings nominal_clock = {.frequency = nominal};
+            timer_plan before, after;
+            timer_plan_fixed(&nominal_clock, 1, 1, TICK_RATE, &before);
+            timer_plan_fixed(&clock, before.pclksel, 1, TICK_RATE, &after);
+            double ppm = ((after.match + 1.0) * (after.prescale + 1) *
+                pclk_divider[after.pclksel] / f * TICK_RATE - 1) * 1e6;
+            double resolution = (double) pclk_divider[before.pclksel] *
+                TICK_RATE / nominal * 1e6;
+            CHECK(fabs(ppm) <= resolution / 2 + 1);
+        }
+    }
+}
+
+// A window longer than the 32 bit counter lasts at 120 MHz
+static void test_wrap(void){
+    clock_measure_state m;
+    uint64_t count = 4000000000u;
+    int ret = 0;
+
+    clock_measure_init(&m, 120000000, 60);
+    for (int k = 0; k <= 60; k++){
+        ret = clock_measure_second(&m, (uint32_t) count);
+        count += 120000000;
+    }
+    CHECK(ret == 1 && m.frequency == 120000000 && m.error_ppm == 0);
+}
+
+// A restart drops the part of the window already counted
+static void test_restart(void){
+    clock_measure_state m;
+    uint32_t count = 1;
+
+    clock_measure_init(&m, 120000000, 2);
+    clock_measure_second(&m, 0);
+    clock_measure_second(&m, 60000000);
+    clock_measure_restart(&m, 24000000);
+    for (int k = 0; k < 3; k++){
+        clock_measure_second(&m, count);
+        count += 24000000;
+    }
+    CHECK(m.num_measurements == 1 && m.frequency == 24000000);
+    CHECK(m.error_ppm == 0);
+}
+
+// Seconds at another clock, and the one it changed in, are not counted
+static void test_suspend(void){
+    clock_measure_state m;
+    uint32_t count = 0;
+
+    clock_measure_init(&m, 100000000, 4);
+    for (int k = 0; k < 3; k++){
+        CHECK(clock_measure_second(&m, count) == 0);
+        count += 100000000;
+    }
+    clock_measure_suspend(&m);
+    count += 30000000;
+    for (int k = 0; k < 2; k++){
+        CHECK(clock_measure_second(&m, count) == 0);
+        count += 20000000;
+    }
+    clock_measure_resume(&m);
+    count += 55000000;
+    CHECK(clock_measure_second(&m, count) == 0);
+    count += 100000000;
+    CHECK(clock_measure_second(&m, count) == 0);
+    count += 100000000;
+    CHECK(clock_measure_second(&m, count) == 1);
+    CHECK(m.frequency == 100000000 && m.error_ppm == 0);
+}
+
+// The RTC runs with the once a second interrupt, and alarms off
+static void test_start(void){
+    LPC_RTC->CCR = 2;
+    LPC_SC->PCONP = 0;
+    clock_measure_start();
+    CHECK(LPC_SC->PCONP == 1 << 9);
+    CHECK(LPC_RTC->CCR == 1 && LPC_RTC->CIIR == 1 && LPC_RTC->AMR == 0xFF);
+}
+
+int main(void){
+    test_measure();
+    test_wrap();
+    test_restart();
+    test_suspend();
+    test_start();
+    return test_done("test_clock_measure");
+}
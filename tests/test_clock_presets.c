@@ -0,0 +1,34 @@
+/*
+ ==============================================
+ Name        : test_clock_presets.c
+ Author      :
+ Version     :
+ Description : Host test for clock_presets.h: each generated preset must
+             : still be what calculate_clock_settings gives for its
+             : frequency, so a change to the search cannot leave the
+             : boot presets stale.
+ ==============================================
+ */
+
+#define CLOCK_UTIL_HOST
+
+#include "test.h"
+#include "clock_util.c"
+#include "clock_presets.h"
+
+static void check_preset(clock_settings preset, int frequency){
+    clock_settings *s = calculate_clock_settings(frequency);
+
+    CHECK(preset.frequency == s->frequency);
+    CHECK(preset.val_CLKSRCSEL == s->val_CLKSRCSEL);
+    CHECK(preset.val_N_factor == s->val_N_factor);
+    CHECK(preset.val_M_factor == s->val_M_factor);
+    CHECK(preset.val_PLL0CON == s->val_PLL0CON);
+    CHECK(preset.val_D_factor == s->val_D_factor);
+}
+
+int main(void){
+    check_preset((clock_settings) CLOCK_PRESET(120000000), 120000000);
+    check_preset((clock_settings) CLOCK_PRESET(100000000), 100000000);
+    return test_done("test_clock_presets");
+}
@@ -0,0 +1,219 @@
+/*
+ ==============================================
+ Name        : test_clock_scaling.c
+ Author      :
+ Version     :
+ Description : Host test for clock_scaling.c: two thousand switches
+             : between 120 MHz, a divider-only low point and a 100 MHz
+             : point that needs a relock, with a 25 kHz tick on TIMER0,
+             : the ADC and SSP1 registered. Simulated time moves on a few
+             : cycles at every read of the cycle counter and while the
+             : main loop sleeps, the timer counts at its pclk, and PLL0
+             : locks 300 us after it is enabled. After every switch the
+             : cclk, the flash time and each replanned peripheral are
+             : checked, and the tick count, with the missed periods,
+             : must have kept simulated time through the switch.
+ ==============================================
+ */
+
+#include "LPC17xx.h"
+#include "test.h"
+
+static uint32_t sim_cyccnt(void);
+#define CLOCK_DWT_CYCCNT sim_cyccnt()
+
+#include "clock_util.c"
+#include "clock_presets.h"
+#include "peripheral_clock.c"
+#include "clock_scaling.c"
+
+#define SWITCHES   2000
+#define TICK_RATE  25000
+#define TICK_NS    (1000000000 / TICK_RATE)
+#define ADC_RATE   153846
+#define SSP_RATE   7500000
+#define LOCK_NS    300000.0
+
+static const int sim_sources[4] = {
+    CLOCK_SPEED_IRC_OSC, CLOCK_SPEED_OSC_CLK, CLOCK_SPEED_RTC_CLK,
+    CLOCK_SPEED_IRC_OSC
+};
+
+static struct {
+    uint32_t cycles;
+    double now_ns;
+    double enabled_ns;      // When PLL0 was enabled, or -1
+    uint64_t timer_cycles;  // cclk cycles not yet a TIMER0 pclk tick
+    uint64_t matches;       // TIMER0 MR0 matches so far
+    int violations;
+} sim;
+
+static int sim_locked(void){
+    return (LPC_SC->PLL0STAT & CLOCK_PLL0_PLOCK) != 0;
+}
+
+static double sim_cclk(void){
+    double f = sim_sources[LPC_SC->CLKSRCSEL & 3];
+    uint32_t cfg = LPC_SC->PLL0CFG;
+
+    if ((LPC_SC->PLL0CON & 3) == 3 && sim_locked()){
+        f = 2.0 * ((cfg & 0x7FFF) + 1) * f / (((cfg >> 16) & 0xFF) + 1);
+    }
+    return f / ((LPC_SC->CCLKCFG & 0xFF) + 1);
+}
+
+// Counts TIMER0 on by cycles of cclk, resetting on MR0
+static void sim_timer(uint64_t cycles){
+    LPC_TIM_TypeDef *t = LPC_TIM0;
+    uint64_t div = pclk_divider[(LPC_SC->PCLKSEL0 >> PCLK_TIMER0) & 3];
+
+    if (!(t->TCR & 1)) return;
+    sim.timer_cycles += cycles;
+    uint64_t ticks = sim.timer_cycles / div;
+    sim.timer_cycles %= div;
+
+    uint64_t step = t->PR + 1, period = (t->MR0 + 1) * step;
+    uint64_t pos = t->TC * step + t->PC, match = t->MR0 * step;
+    uint64_t end = pos + ticks;
+    uint64_t before = pos >= match ? (pos - match) / period + 1 : 0;
+    uint64_t after = end >= match ? (end - match) / period + 1 : 0;
+    sim.matches += after - before;
+    end %= period;
+    t->TC = (uint32_t) (end / step);
+    t->PC = (uint32_t) (end % step);
+}
+
+// PLL0STAT from PLL0CON and PLL0CFG, and the flash time for cclk
+static void sim_update(void){
+    uint32_t con = LPC_SC->PLL0CON & 3;
+    uint32_t stat = (LPC_SC->PLL0CFG & 0x00FF7FFF) | (con << 24);
+    double f = sim_cclk();
+    int tim = (LPC_SC->FLASHCFG >> CLOCK_FLASHTIM_SHIFT) & 0xF;
+
+    if (!(con & 1)) sim.enabled_ns = -1;
+    else if (sim.enabled_ns < 0) sim.enabled_ns = sim.now_ns;
+    if ((con & 1) && sim.now_ns - sim.enabled_ns >= LOCK_NS){
+        stat |= CLOCK_PLL0_PLOCK;
+    }
+    LPC_SC->PLL0STAT = stat;
+
+    if (tim < clock_flash_time((int) f)) sim.violations++;
+    if (f > CLOCK_SPEED_CCLK_MAX + 1) sim.violations++;
+    if (con == 3 && !sim_locked()) sim.violations++;
+}
+
+static void sim_advance(uint64_t cycles){
+    double f = sim_cclk();
+
+    sim.cycles += (uint32_t) cycles;
+    sim.now_ns += cycles * 1e9 / f;
+    sim_timer(cycles);
+    sim_update();
+}
+
+static uint32_t sim_cyccnt(void){
+    sim_advance(3);
+    return sim.cycles;
+}
+
+// Time by the tick count: whole periods, and the way into this one
+static double tick_ns(uint64_t missed){
+    LPC_TIM_TypeDef *t = LPC_TIM0;
+    uint64_t step = t->PR + 1, period = (t->MR0 + 1) * step;
+    uint64_t pos = t->TC * step + t->PC, match = t->MR0 * step;
+    double since = (double) ((pos + period - match) % period) / period;
+
+    return (sim.matches + missed + since) * TICK_NS;
+}
+
+// Running at 120 MHz from the preset, with PLL0 long since locked
+static void sim_reset(const clock_settings *clock){
+    memset(&sim, 0, sizeof(sim));
+    sim.now_ns = 1e9;
+    sim.enabled_ns = 0;
+    LPC_SC->CLKSRCSEL = clock->val_CLKSRCSEL;
+    LPC_SC->PLL0CFG = clock->val_M_factor | (clock->val_N_factor << 16);
+    LPC_SC->PLL0CON = 3;
+    LPC_SC->CCLKCFG = clock->val_D_factor;
+    clock_set_flash_time(clock_flash_time(clock->frequency));
+    sim_update();
+}
+
+static void test_switches(void){
+    clock_settings clock = CLOCK_PRESET(120000000);
+    clock_settings full = clock, other = CLOCK_PRESET(100000000), low;
+    clock_scaling_state s;
+    timer_plan tick, expect_tick;
+    adc_plan adc, expect_adc;
+    ssp_plan ssp, expect_ssp;
+    uint64_t missed = 0;
+    int relocks = 0;
+
+    CHECK(clock_scaling_point(&full, 14, &low) == 0);
+    CHECK(low.frequency == full.frequency * 3 / 15);
+    sim_reset(&clock);
+
+    CHECK(timer_plan_rate(&clock, TICK_RATE, &tick) == 0);
+    CHECK(adc_plan_rate(&clock, ADC_RATE, &adc) == 0);
+    CHECK(ssp_plan_rate(&clock, 0, SSP_RATE, &ssp) == 0);
+    pclk_select(PCLK_TIMER0, tick.pclksel);
+    pclk_select(PCLK_ADC, adc.pclksel);
+    pclk_select(PCLK_SSP1, ssp.pclksel);
+    timer_plan_apply(LPC_TIM0, &tick);
+    LPC_TIM0->TC = LPC_TIM0->PC = 0;
+    LPC_TIM0->TCR = 1;
+    LPC_ADC->ADCR = 1 | (adc.clkdiv << 8) | (1 << 16) | (1 << 21);
+    LPC_SSP1->CR0 = 7 | (ssp.scr << 8);
+    LPC_SSP1->CPSR = ssp.cpsdvsr;
+
+    clock_scaling_init(&s);
+    CHECK(clock_scaling_add_timer(&s, LPC_TIM0, &tick, 1, TICK_RATE) == 0);
+    CHECK(clock_scaling_add_adc(&s, &adc, ADC_RATE) == 1);
+    CHECK(clock_scaling_add_ssp(&s, LPC_SSP1, &ssp, SSP_RATE) == 2);
+    double drift = tick_ns(0) - sim.now_ns;
+
+    for (int k = 0; k < SWITCHES; k++){
+        // Asleep in the main loop for 0.5 to 20.5 ms
+        sim_advance((uint64_t) (sim_cclk() * (0.0005 + 0.02 *
+            (test_rand() % 1000) / 1000)) + test_rand() % 97);
+
+        // Between 120 MHz and the low point, relocking to 100 MHz and back
+        // every tenth switch
+        const clock_settings *point = &full;
+        if (k % 10 == 9){
+            if (clock.val_M_factor == full.val_M_factor) point = &other;
+        } else if (clock.val_M_factor == full.val_M_factor &&
+                clock.frequency == full.frequency){
+            point = &low;
+        }
+        relocks += point->val_M_factor != clock.val_M_factor;
+        CHECK(clock_scaling_switch(&s, &clock, point) == 0);
+        CHECK(s.num_relocks == relocks);
+        missed += clock_scaling_missed(&s, 0);
+
+        CHECK(clock.frequency == point->frequency);
+        CHECK(fabs(sim_cclk() - clock.frequency) <= 1);
+        timer_plan_fixed(&clock, tick.pclksel, 1, TICK_RATE, &expect_tick);
+        CHECK(LPC_TIM0->PR == expect_tick.prescale);
+        CHECK(LPC_TIM0->MR0 == expect_tick.match && LPC_TIM0->TCR == 1);
+        adc_plan_fixed(&clock, adc.pclksel, ADC_RATE, &expect_adc);
+        CHECK(((LPC_ADC->ADCR >> 8) & 0xFF) == expect_adc.clkdiv);
+        ssp_plan_rate(&clock, ssp.pclksel, SSP_RATE, &expect_ssp);
+        CHECK(LPC_SSP1->CPSR == expect_ssp.cpsdvsr);
+        CHECK(((LPC_SSP1->CR0 >> 8) & 0xFF) == expect_ssp.scr);
+
+        // Off by no more than the few cycles around the change of clock
+        // that cannot be told apart, far short of a lost or doubled tick
+        double err = tick_ns(missed) - sim.now_ns;
+        CHECK(fabs(err - drift) < 3000);
+        drift = err;
+    }
+    CHECK(sim.violations == 0);
+    // The last switch went out to 100 MHz, not back
+    CHECK(s.num_switches == SWITCHES && relocks == SWITCHES / 5 - 1);
+}
+
+int main(void){
+    test_switches();
+    return test_done("test_clock_scaling");
+}
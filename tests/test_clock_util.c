@@ -0,0 +1,255 @@
+/*
+ ==============================================
+ Name        : test_clock_util.c
+ Author      :
+ Version     :
+ Description : Host test for calculate_clock_settings: every result is a
+             : valid register setting whose frequency field is what it
+             : produces, and no source, N, M and D come closer to the
+             : target than the one chosen, at every 1 kHz step from 1 MHz
+             : to the fastest cclk. Then a timing of the search against
+             : the floating point one it replaced.
+ ==============================================
+ */
+
+#define CLOCK_UTIL_HOST
+
+#include <time.h>
+#include "test.h"
+#include "clock_util.c"
+
+static const int sources[3] = {
+    CLOCK_SPEED_IRC_OSC, CLOCK_SPEED_OSC_CLK, CLOCK_SPEED_RTC_CLK
+};
+
+// cclk of a setting as the fraction num / den
+static void settings_clock(const clock_settings *s, uint64_t *num,
+        uint64_t *den){
+    int source = sources[s->val_CLKSRCSEL];
+
+    if (s->val_PLL0CON){
+        *num = 2ull * source * (s->val_M_factor + 1);
+        *den = (uint64_t) (s->val_N_factor + 1) * (s->val_D_factor + 1);
+    } else {
+        *num = source;
+        *den = s->val_D_factor + 1;
+    }
+}
+
+static int valid(const clock_settings *s){
+    if (s->val_CLKSRCSEL < 0 || s->val_CLKSRCSEL > 2) return 0;
+    if (s->val_D_factor < D_MIN || s->val_D_factor > D_MAX) return 0;
+    if (!s->val_PLL0CON) return 1;
+
+    uint64_t n1 = s->val_N_factor + 1;
+    uint64_t num = 2ull * sources[s->val_CLKSRCSEL] * (s->val_M_factor + 1);
+    return s->val_N_factor >= N_MIN && s->val_N_factor <= N_MAX &&
+        s->val_M_factor >= M_MIN && s->val_M_factor <= M_MAX &&
+        num >= CLOCK_SPEED_PLL0CLK_MIN * n1 &&
+        num <= CLOCK_SPEED_PLL0CLK_MAX * n1;
+}
+
+// Error of the best of every valid setting, as the fraction *err / *den
+static void brute_force(int f, uint64_t *err, uint64_t *den){
+    uint64_t best = ~0ull, best_den = 1;
+
+    for (int i = 0; i < 3; i++){
+        for (int N = N_MIN; N <= N_MAX; N++){
+            for (int M = M_MIN; M <= M_MAX; M++){
+                uint64_t num = 2ull * sources[i] * (M + 1);
+                if (num < (uint64_t) CLOCK_SPEED_PLL0CLK_MIN * (N + 1) ||
+                    num > (uint64_t) CLOCK_SPEED_PLL0CLK_MAX * (N + 1)) continue;
+                for (int D = D_MIN; D <= D_MAX; D++){
+                    uint64_t d = (uint64_t) (N + 1) * (D + 1);
+                    uint64_t t = (uint64_t) f * d;
+                    uint64_t e = num > t ? num - t : t - num;
+                    if (e * best_den < best * d){
+                        best = e;
+                        best_den = d;
+                    }
+                }
+            }
+        }
+        for (int D = D_MIN; D <= D_MAX; D++){
+            uint64_t t = (uint64_t) f * (D + 1);
+            uint64_t e = sources[i] > t ? sources[i] - t : t - sources[i];
+            if (e * best_den < best * (D + 1)){
+                best = e;
+                best_den = D + 1;
+            }
+        }
+    }
+    *err = best;
+    *den = best_den;
+}
+
+// Settings that must come out exact, some of them without the PLL
+static void test_exact(void){
+    const int exact[] = {120000000, 100000000, 96000000, 72000000, 48000000,
+        12000000, 6000000, 4000000, 1000000, 32700};
+
+    for (int i = 0; i < 10; i++){
+        clock_settings *s = calculate_clock_settings(exact[i]);
+        CHECK(valid(s) && s->frequency == exact[i]);
+    }
+    CHECK(calculate_clock_settings(4000000)->val_PLL0CON == 0);
+    CHECK(calculate_clock_settings(6000000)->val_PLL0CON == 0);
+}
+
+// Every 1 kHz step is valid and reports the frequency it produces
+static void test_valid(void){
+    int invalid = 0, wrong = 0;
+
+    for (int f = 1000000; f <= CLOCK_SPEED_CCLK_MAX; f += 1000){
+        clock_settings *s = calculate_clock_settings(f);
+        uint64_t num, den;
+        settings_clock(s, &num, &den);
+        if (!valid(s)) invalid++;
+        if ((uint64_t) s->frequency != num / den) wrong++;
+    }
+    CHECK(invalid == 0);
+    CHECK(wrong == 0);
+}
+
+/*
+ * Error of the best valid setting as the fraction *err / *den, as
+ * brute_force finds it but quicker: for each source, N and M in pll0clk's
+ * range only the dividers either side of the exact one can be nearest.
+ */
+static void nearest(int f, uint64_t *err, uint64_t *den){
+    uint64_t best = ~0ull, best_den = 1;
+
+    for (int i = 0; i < 3; i++){
+        for (int N = N_MIN; N <= N_MAX; N++){
+            for (int M = M_MIN; M <= M_MAX; M++){
+                uint64_t num = 2ull * sources[i] * (M + 1);
+                if (num < (uint64_t) CLOCK_SPEED_PLL0CLK_MIN * (N + 1)) continue;
+                if (num > (uint64_t) CLOCK_SPEED_PLL0CLK_MAX * (N + 1)) break;
+                uint64_t d1 = num / ((uint64_t) f * (N + 1));
+                for (uint64_t d = d1; d <= d1 + 1; d++){
+                    if (d < D_MIN + 1 || d > D_MAX + 1) continue;
+                    uint64_t dd = d * (N + 1), t = (uint64_t) f * dd;
+                    uint64_t e = num > t ? num - t : t - num;
+                    if (e * best_den < best * dd){
+                        best = e;
+                        best_den = dd;
+                    }
+                }
+            }
+        }
+        uint64_t d1 = sources[i] / f;
+        for (uint64_t d = d1; d <= d1 + 1; d++){
+            if (d < D_MIN + 1 || d > D_MAX + 1) continue;
+            uint64_t t = (uint64_t) f * d;
+            uint64_t e = sources[i] > t ? sources[i] - t : t - sources[i];
+            if (e * best_den < best * d){
+                best = e;
+                best_den = d;
+            }
+        }
+    }
+    *err = best;
+    *den = best_den;
+}
+
+// The quick reference agrees with trying every setting
+static void test_nearest(void){
+    int differ = 0;
+
+    for (int k = 0; k < 40; k++){
+        int f = 1000000 + test_rand() % (CLOCK_SPEED_CCLK_MAX - 1000000);
+        uint64_t err, den, best, best_den;
+        nearest(f, &err, &den);
+        brute_force(f, &best, &best_den);
+        if (err * best_den != best * den) differ++;
+    }
+    CHECK(differ == 0);
+}
+
+// No setting comes closer than the one chosen, at every 1 kHz step
+static void test_optimal(void){
+    int worse = 0;
+
+    for (int f = 1000000; f <= CLOCK_SPEED_CCLK_MAX; f += 1000){
+        clock_settings *s = calculate_clock_settings(f);
+        uint64_t num, den, best, best_den;
+
+        settings_clock(s, &num, &den);
+        uint64_t t = (uint64_t) f * den;
+        uint64_t err = num > t ? num - t : t - num;
+        nearest(f, &best, &best_den);
+        if (err * best_den > best * den) worse++;
+    }
+    CHECK(worse == 0);
+}
+
+/*
+ * The search as it was before it moved to integers: D fixed at the first
+ * divider that puts pll0clk in range, then every source, N and M tried
+ * in floating point. Targets a source divides exactly are left out, as
+ * both searches handle them the same way.
+ */
+static int legacy_clock_frequency(int desired_frequency){
+    int D_SEL = 0, best_frequency = 0;
+    double least_error = DBL_MAX;
+
+    for (int D = D_MIN; (D <= D_MAX) && (D_SEL == 0); D++){
+        int f_pllclk = desired_frequency * (D+1);
+        if (f_pllclk >= CLOCK_SPEED_PLL0CLK_MIN &&
+                f_pllclk <= CLOCK_SPEED_PLL0CLK_MAX){
+            D_SEL = D;
+        }
+    }
+    for (int i = 0; i < 3; i++){
+        for (int N = N_MIN; N <= N_MAX; N++){
+            for (int M = M_MIN; M <= M_MAX; M++){
+                double freq = calc_f_pll0clk(N, M, sources[i]);
+                freq = calc_f_cclk(freq, D_SEL);
+                double error = (freq-desired_frequency);
+                error = error*error;
+                if (error < least_error){
+                    least_error = error;
+                    best_frequency = (int) freq;
+                }
+            }
+        }
+    }
+    return best_frequency;
+}
+
+// Mean time per call of searching for f
+static double time_search(int (*search)(int f), int calls){
+    volatile int sink = 0;
+    clock_t start = clock();
+
+    for (int k = 0; k < calls; k++){
+        int f = 1000000 + (int) ((uint64_t) k * (CLOCK_SPEED_CCLK_MAX - 1000000) /
+            calls);
+        sink += search(f);
+    }
+    return 1e6 * (clock() - start) / CLOCKS_PER_SEC / calls;
+}
+
+static int clock_frequency(int f){
+    return calculate_clock_settings(f)->frequency;
+}
+
+// Reports the mean time of each search; the check only guards against a
+// hang
+static void test_benchmark(void){
+    double us = time_search(clock_frequency, 20000);
+    double legacy_us = time_search(legacy_clock_frequency, 2000);
+
+    printf("calculate_clock_settings: %.2f us per call on this host, "
+        "%.2f us floating point\n", us, legacy_us);
+    CHECK(us < 1000);
+}
+
+int main(void){
+    test_exact();
+    test_valid();
+    test_nearest();
+    test_optimal();
+    test_benchmark();
+    return test_done("test_clock_util");
+}
@@ -0,0 +1,150 @@
+/*
+ ==============================================
+ Name        : test_compress.c
+ Author      :
+ Version     :
+ Description : Host test for compress.c: round trips of telemetry text,
+             : binary data and history longer than the window, the size
+             : of typical messages, and the worst case for data that
+             : does not compress. Prints the ratio and the encode and
+             : decode cycles per byte for the typical messages.
+ ==============================================
+ */
+
+#include "test.h"
+#include "compress.c"
+
+#define MAX_DATA 1024
+
+// Typical payloads and the most compressed bytes each may take
+static const struct {
+    const char *name;
+    const char *text;
+    int max_len;
+} messages[] = {
+    {"greeting", "Hello world!", 13},
+    {"T/H/P sensor pairs",
+     "T=23.5C H=41% P=1013hPa T=23.6C H=41% P=1013hPa", 30},
+    {"ADC channel dump",
+     "ADC0=1023 ADC1=0512 ADC2=0000 ADC3=4095 ADC4=1023 ADC5=0512", 44},
+    {"JSON status record",
+     "{\"node\":7,\"temp\":21.4,\"rssi\":-61,\"status\":\"ok\",\"seq\":1042}", 54},
+    {"two GPS fixes",
+     "GPS,3859.1234,N,07656.4321,W,12,0.9,45.2,M,"
+     "GPS,3859.1240,N,07656.4330,W", 51},
+};
+
+#define NUM_MESSAGES ((int) (sizeof(messages) / sizeof(messages[0])))
+
+// Decodes len compressed bytes into out; returns the number of bytes out
+static int decode(const char *in, int len, char *out){
+    compress_decoder dec;
+    int n = 0;
+
+    compress_decoder_init(&dec);
+    for (int i = 0; i < len; i++){
+        n += compress_decoder_push(&dec, in[i], out + n);
+    }
+    return n;
+}
+
+// Compresses and decompresses len bytes; returns the compressed size
+static int round_trip(const char *data, int len){
+    static char encoded[MAX_DATA * 2], decoded[MAX_DATA * 2];
+
+    int n = compress_encode(data, len, encoded, sizeof(encoded));
+    CHECK(n > 0);
+    if (n <= 0) return n;
+    CHECK(decode(encoded, n, decoded) >= len);
+    CHECK(memcmp(decoded, data, len) == 0);
+    return n;
+}
+
+static void test_messages(void){
+    for (int i = 0; i < NUM_MESSAGES; i++){
+        int len = (int) strlen(messages[i].text) + 1;
+        CHECK(round_trip(messages[i].text, len) <= messages[i].max_len);
+    }
+}
+
+// Random bytes cost at most a header byte and one flag bit per byte
+static void test_binary(void){
+    char data[MAX_DATA];
+
+    for (int len = 1; len <= 64; len++){
+        for (int i = 0; i < len; i++) data[i] = (char) test_rand();
+        CHECK(round_trip(data, len) <= 1 + (9 * len + 7) / 8);
+    }
+}
+
+// 7-bit text costs at most a header byte and seven bits per byte
+static void test_ascii(void){
+    char data[MAX_DATA];
+
+    for (int len = 1; len <= 64; len++){
+        for (int i = 0; i < len; i++){
+            data[i] = (char) (' ' + test_rand() % (COMPRESS_ESCAPE - ' '));
+        }
+        CHECK(round_trip(data, len) <= 1 + (7 * len + 7) / 8);
+    }
+}
+
+// Back references reach across the whole window as the history wraps
+static void test_window(void){
+    char data[MAX_DATA];
+    char block[COMPRESS_WINDOW - 8];
+
+    for (int i = 0; i < (int) sizeof(block); i++){
+        block[i] = (char) test_rand();
+    }
+    for (int i = 0; i < MAX_DATA; i++){
+        data[i] = block[i % sizeof(block)];
+    }
+    int n = round_trip(data, MAX_DATA);
+    CHECK(n < MAX_DATA / 2);
+}
+
+static void test_overflow(void){
+    const char *text = messages[1].text;
+    char encoded[8];
+
+    CHECK(compress_encode(text, strlen(text) + 1, encoded,
+        sizeof(encoded)) == -1);
+}
+
+// Sizes include the terminator and the header byte
+static void test_benchmark(void){
+    const int runs = 2000;
+    char encoded[MAX_DATA], decoded[MAX_DATA];
+    volatile int sink = 0;
+
+    printf("payload              bytes    ratio  enc cyc/B  dec cyc/B\n");
+    for (int i = 0; i < NUM_MESSAGES; i++){
+        int len = (int) strlen(messages[i].text) + 1, n = 0;
+
+        uint64_t start = test_cycles();
+        for (int r = 0; r < runs; r++){
+            n = compress_encode(messages[i].text, len, encoded,
+                sizeof(encoded));
+        }
+        uint64_t enc = test_cycles() - start;
+        start = test_cycles();
+        for (int r = 0; r < runs; r++) sink += decode(encoded, n, decoded);
+        uint64_t dec = test_cycles() - start;
+
+        printf("%-19s %3d->%-3d %5.0f%%  %9.0f  %9.0f\n", messages[i].name,
+            len, n, 100.0 * n / len, (double) enc / runs / len,
+            (double) dec / runs / len);
+        CHECK(n > 0 && n <= messages[i].max_len);
+    }
+}
+
+int main(void){
+    test_messages();
+    test_binary();
+    test_ascii();
+    test_window();
+    test_overflow();
+    test_benchmark();
+    return test_done("test_compress");
+}
@@ -0,0 +1,114 @@
+/*
+ ==============================================
+ Name        : test_fec.c
+ Author      :
+ Version     :
+ Description : Host test for fec.c: round trips, every single bit error,
+             : and every burst of up to twelve bits on the wire. Bursts
+             : of up to eight bits the interleaver must spread to one bit
+             : per codeword; the rate for longer ones is printed.
+ ==============================================
+ */
+
+#include "test.h"
+#include "fec.c"
+
+#define MAX_DATA    40
+#define MAX_ENCODED ((MAX_DATA + FEC_DATA_BYTES - 1) / FEC_DATA_BYTES * \
+                     FEC_BLOCK_BYTES)
+
+// Decodes len encoded bytes into out; returns the decoder's counts
+static fec_decoder decode(const char *in, int len, char *out){
+    fec_decoder dec;
+    int n = 0;
+
+    fec_decoder_init(&dec);
+    for (int i = 0; i < len; i++){
+        n += fec_decoder_push(&dec, in[i], out + n);
+    }
+    return dec;
+}
+
+// Flips bit i of a byte stream sent least significant bit first, as
+// transmit.c sends it and receive_process_bit collects it
+static void flip_wire_bit(char *stream, int i){
+    stream[i / 8] ^= (char) (1 << (i % 8));
+}
+
+static void test_round_trip(void){
+    char data[MAX_DATA], encoded[MAX_ENCODED], decoded[MAX_ENCODED];
+
+    for (int len = 1; len <= MAX_DATA; len++){
+        for (int i = 0; i < len; i++) data[i] = (char) test_rand();
+        int n = fec_encode(data, len, encoded, sizeof(encoded));
+        CHECK(n == (len + FEC_DATA_BYTES - 1) / FEC_DATA_BYTES *
+            FEC_BLOCK_BYTES);
+
+        fec_decoder dec = decode(encoded, n, decoded);
+        CHECK(memcmp(decoded, data, len) == 0);
+        CHECK(dec.num_corrected == 0 && dec.num_uncorrectable == 0);
+    }
+    CHECK(fec_encode(data, 5, encoded, FEC_BLOCK_BYTES) == -1);
+}
+
+static void test_single_errors(void){
+    char data[FEC_DATA_BYTES] = {'L', 'P', 'C', 0x5A};
+    char encoded[FEC_BLOCK_BYTES], decoded[FEC_DATA_BYTES];
+
+    for (int bit = 0; bit < FEC_BLOCK_BYTES * 8; bit++){
+        fec_encode(data, FEC_DATA_BYTES, encoded, sizeof(encoded));
+        flip_wire_bit(encoded, bit);
+        fec_decoder dec = decode(encoded, FEC_BLOCK_BYTES, decoded);
+        CHECK(memcmp(decoded, data, FEC_DATA_BYTES) == 0);
+        CHECK(dec.num_corrected == 1 && dec.num_uncorrectable == 0);
+    }
+}
+
+/*
+ * Every burst of 1 to 12 flipped bits, anywhere in a three block message.
+ * Prints the share of frames decoded intact at each length; up to eight
+ * bits must all be.
+ */
+static void test_bursts(void){
+    char data[3 * FEC_DATA_BYTES], encoded[3 * FEC_BLOCK_BYTES];
+    char decoded[3 * FEC_DATA_BYTES];
+    int bits = (int) sizeof(encoded) * 8;
+
+    for (int i = 0; i < (int) sizeof(data); i++) data[i] = (char) test_rand();
+    printf("burst bits   frames corrected\n");
+    for (int len = 1; len <= 12; len++){
+        int frames = 0, corrected = 0;
+        for (int start = 0; start + len <= bits; start++){
+            fec_encode(data, sizeof(data), encoded, sizeof(encoded));
+            for (int i = start; i < start + len; i++) flip_wire_bit(encoded, i);
+            fec_decoder dec = decode(encoded, sizeof(encoded), decoded);
+            frames++;
+            if (memcmp(decoded, data, sizeof(data)) == 0 &&
+                    dec.num_uncorrectable == 0) corrected++;
+        }
+        printf("%10d   %4d/%4d %5.1f%%\n", len, corrected, frames,
+            100.0 * corrected / frames);
+        if (len <= 8) CHECK(corrected == frames);
+    }
+}
+
+// Two errors in one codeword are detected, not miscorrected
+static void test_double_error(void){
+    char data[FEC_DATA_BYTES] = {0x12, 0x34, 0x56, 0x78};
+    char encoded[FEC_BLOCK_BYTES], decoded[FEC_DATA_BYTES];
+
+    fec_encode(data, FEC_DATA_BYTES, encoded, sizeof(encoded));
+    // Wire bytes 0 and 1 hold bits 0 and 1 of every codeword
+    encoded[0] ^= 1;
+    encoded[1] ^= 1;
+    fec_decoder dec = decode(encoded, FEC_BLOCK_BYTES, decoded);
+    CHECK(dec.num_uncorrectable == 1);
+}
+
+int main(void){
+    test_round_trip();
+    test_single_errors();
+    test_bursts();
+    test_double_error();
+    return test_done("test_fec");
+}
@@ -0,0 +1,211 @@
+/*
+ ==============================================
+ Name        : test_framebuffer.c
+ Author      :
+ Version     :
+ Description : Host test for framebuffer.c: a model of the register chain
+             : must show each swapped-in frame column for column, by
+             : bit-banging or SSP, a swap must wait for the frame being
+             : shifted, and text must scroll in from the far end.
+ ==============================================
+ */
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "SN74HC164N.c"
+#include "framebuffer.c"
+
+#define PIN_A     7
+#define PIN_CLEAR 8
+#define PIN_CLOCK 9
+
+// Register k's QH output feeds register k + 1's A input
+typedef struct {
+    uint8_t q[FRAMEBUFFER_COLUMNS];
+    int clock;
+} register_chain;
+
+static void chain_shift(register_chain *chain, int a){
+    for (int k = FRAMEBUFFER_COLUMNS - 1; k > 0; k--){
+        chain->q[k] = (uint8_t) ((chain->q[k] << 1) | (chain->q[k-1] >> 7));
+    }
+    chain->q[0] = (uint8_t) ((chain->q[0] << 1) | a);
+}
+
+static void chain_update(register_chain *chain, uint32_t pins){
+    int clock = (pins >> PIN_CLOCK) & 1;
+    if (clock && !chain->clock) chain_shift(chain, (pins >> PIN_A) & 1);
+    chain->clock = clock;
+}
+
+static void init_gpio(SN74HC164N_state *sreg, volatile uint32_t *pins){
+    SN74HC164N_init(sreg);
+    sreg->reg_clock  = sreg->reg_clear = sreg->reg_a = pins;
+    sreg->mask_clock = 1 << PIN_CLOCK;
+    sreg->mask_clear = 1 << PIN_CLEAR;
+    sreg->mask_a     = 1 << PIN_A;
+}
+
+static void random_frame(unsigned char *buf){
+    for (int c = 0; c < FRAMEBUFFER_COLUMNS; c++) buf[c] = test_rand();
+}
+
+static void test_bit_bang(void){
+    static framebuffer fb;
+    SN74HC164N_state sreg;
+    register_chain chain = {{0}, 0};
+    unsigned char frame[FRAMEBUFFER_COLUMNS];
+    volatile uint32_t pins = 1 << PIN_CLEAR;
+
+    framebuffer_init(&fb);
+    init_gpio(&sreg, &pins);
+
+    // Nothing is shifted until a frame is swapped in
+    for (int t = 0; t < 100; t++) framebuffer_step(&fb, &sreg);
+    CHECK(pins == 1 << PIN_CLEAR && fb.num_frames_shown == 0);
+
+    for (int f = 0; f < 20; f++){
+        CHECK(framebuffer_ready(&fb));
+        random_frame(frame);
+        memcpy(framebuffer_back(&fb), frame, sizeof(frame));
+        framebuffer_swap(&fb);
+        CHECK(!framebuffer_ready(&fb));
+
+        int ticks = 0;
+        do {
+            framebuffer_step(&fb, &sreg);
+            chain_update(&chain, pins);
+            ticks++;
+        } while (fb.shifting);
+        CHECK(ticks == FRAMEBUFFER_COLUMNS * 32);
+        CHECK(memcmp(chain.q, frame, sizeof(frame)) == 0);
+        CHECK(fb.num_frames_shown == f + 1);
+    }
+}
+
+/*
+ * The status pointer aims at the data register, so the FIFO reads full
+ * right after a byte with bit 1 (TNF) clear. Clearing it in one column
+ * stops each step there, which shows the order the bytes go out in.
+ */
+static void test_ssp(void){
+    static framebuffer fb;
+    SN74HC164N_state sreg;
+    unsigned char frame[FRAMEBUFFER_COLUMNS];
+    volatile uint32_t reg = 0;
+
+    SN74HC164N_init(&sreg);
+    sreg.reg_ssp_data   = &reg;
+    sreg.reg_ssp_status = &reg;
+
+    for (int stop = FRAMEBUFFER_COLUMNS - 1; stop >= 0; stop--){
+        framebuffer_init(&fb);
+        for (int c = 0; c < FRAMEBUFFER_COLUMNS; c++){
+            frame[c] = (unsigned char) (c << 4 | SN74HC164N_SSP_TNF);
+        }
+        frame[stop] &= ~SN74HC164N_SSP_TNF;
+        memcpy(framebuffer_back(&fb), frame, sizeof(frame));
+        framebuffer_swap(&fb);
+
+        // A full FIFO holds the frame back without losing it
+        reg = 0;
+        framebuffer_step(&fb, &sreg);
+        CHECK(fb.shifting && fb.shift_pos == 0);
+
+        reg = SN74HC164N_SSP_TNF;
+        framebuffer_step(&fb, &sreg);
+        CHECK(reg == frame[stop]);
+        CHECK(fb.shift_pos == FRAMEBUFFER_COLUMNS - stop);
+
+        reg = SN74HC164N_SSP_TNF;
+        framebuffer_step(&fb, &sreg);
+        CHECK(reg == (stop ? frame[0] : SN74HC164N_SSP_TNF));
+        CHECK(!fb.shifting && fb.num_frames_shown == 1);
+    }
+}
+
+// A frame swapped in mid-shift waits; the one on the wire is not torn
+static void test_swap_during_shift(void){
+    static framebuffer fb;
+    SN74HC164N_state sreg;
+    register_chain chain = {{0}, 0};
+    unsigned char first[FRAMEBUFFER_COLUMNS], second[FRAMEBUFFER_COLUMNS];
+    volatile uint32_t pins = 1 << PIN_CLEAR;
+
+    framebuffer_init(&fb);
+    init_gpio(&sreg, &pins);
+    random_frame(first);
+    random_frame(second);
+
+    memcpy(framebuffer_back(&fb), first, sizeof(first));
+    framebuffer_swap(&fb);
+    for (int t = 0; t < 100; t++){
+        framebuffer_step(&fb, &sreg);
+        chain_update(&chain, pins);
+    }
+    CHECK(framebuffer_ready(&fb));
+    memcpy(framebuffer_back(&fb), second, sizeof(second));
+    framebuffer_swap(&fb);
+
+    while (fb.num_frames_shown == 0){
+        framebuffer_step(&fb, &sreg);
+        chain_update(&chain, pins);
+    }
+    CHECK(memcmp(chain.q, first, sizeof(first)) == 0);
+    while (fb.num_frames_shown == 1){
+        framebuffer_step(&fb, &sreg);
+        chain_update(&chain, pins);
+    }
+    CHECK(memcmp(chain.q, second, sizeof(second)) == 0);
+}
+
+static void test_render(void){
+    unsigned char buf[FRAMEBUFFER_COLUMNS];
+    const char *text = "Hi";
+    int num_columns = FRAMEBUFFER_COLUMNS + 2 * (FONT_WIDTH + FONT_SPACING);
+
+    CHECK(framebuffer_text_column(text, 0) == framebuffer_font['H' - FONT_FIRST][0]);
+    CHECK(framebuffer_text_column(text, FONT_WIDTH) == 0);
+    CHECK(framebuffer_text_column(text, FONT_WIDTH + FONT_SPACING) ==
+        framebuffer_font['i' - FONT_FIRST][0]);
+    CHECK(framebuffer_text_column("\x01", 0) == 0);
+
+    // The strip starts blank, then the text enters at the last column
+    framebuffer_render_text(buf, text, num_columns, 0);
+    for (int c = 0; c < FRAMEBUFFER_COLUMNS; c++) CHECK(buf[c] == 0);
+    framebuffer_render_text(buf, text, num_columns, 1);
+    CHECK(buf[FRAMEBUFFER_COLUMNS - 1] == framebuffer_font['H' - FONT_FIRST][0]);
+    framebuffer_render_text(buf, text, num_columns, FRAMEBUFFER_COLUMNS);
+    for (int c = 0; c < FONT_WIDTH; c++){
+        CHECK(buf[c] == framebuffer_font['H' - FONT_FIRST][c]);
+    }
+
+    // And wraps back to blank at the end
+    framebuffer_render_text(buf, text, num_columns, num_columns);
+    for (int c = 0; c < FRAMEBUFFER_COLUMNS; c++) CHECK(buf[c] == 0);
+}
+
+// One scroll step per interval, and none while a swap is pending
+static void test_scroller(void){
+    static framebuffer fb;
+    text_scroller scroller;
+    int frames = 0;
+
+    framebuffer_init(&fb);
+    text_scroller_start(&scroller, "Hello", 10, 0);
+    for (int t = 0; t < 1000; t++){
+        frames += text_scroller_step(&scroller, &fb, t);
+        if (t % 20 == 19) fb.swap_pending = 0;
+    }
+    CHECK(frames == 1000 / 20);
+    CHECK(scroller.offset == frames % scroller.num_columns);
+}
+
+int main(void){
+    test_bit_bang();
+    test_ssp();
+    test_swap_during_shift();
+    test_render();
+    test_scroller();
+    return test_done("test_framebuffer");
+}
@@ -0,0 +1,174 @@
+/*
+ ==============================================
+ Name        : test_jitter.c
+ Author      :
+ Version     :
+ Description : Host test for jitter.c: the capture queue, and statistics
+             : of frames from transmit_step with a random latency on
+             : every edge or a bit clock that runs slow, checked against
+             : the edge errors worked out here from the true bit times.
+ ==============================================
+ */
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "compress.c"
+#include "fec.c"
+#include "linecode.c"
+#include "pam4.c"
+#include "receive.c"
+#include "transmit.c"
+#include "jitter.c"
+
+#define NOMINAL     1200001     // Bit period in capture ticks
+#define NUM_FRAMES  20
+#define GAP_BITS    100         // Idle bits between frames
+#define BIN_WIDTH   25
+
+static void test_queue(void){
+    jitter_edge_queue queue;
+    uint32_t t;
+
+    jitter_edge_queue_init(&queue);
+    CHECK(!jitter_edge_pop(&queue, &t));
+    for (int i = 0; i < JITTER_EDGE_QUEUE_LEN + 5; i++){
+        jitter_edge_push(&queue, 1000 + i);
+    }
+    CHECK(queue.num_dropped == 5);
+    for (int i = 0; i < JITTER_EDGE_QUEUE_LEN; i++){
+        CHECK(jitter_edge_pop(&queue, &t) && t == (uint32_t) (1000 + i));
+    }
+    CHECK(!jitter_edge_pop(&queue, &t));
+}
+
+typedef struct {
+    uint32_t num_edges;
+    uint32_t num_bits;
+    int min_error;
+    int max_error;
+} expected_stats;
+
+/*
+ * Sends NUM_FRAMES frames and timestamps every edge, starting just
+ * before the capture counter wraps. Each bit lasts period ticks and
+ * each edge lands up to latency ticks late. Returns what jitter.c
+ * should report: errors are measured from the ideal times set by the
+ * first edge of each frame.
+ */
+static expected_stats run_frames(jitter_stats *stats, uint32_t period,
+        int latency){
+    static transmit_state tx;
+    jitter_edge_queue queue;
+    expected_stats want = {0, 0, 0, 0};
+    volatile uint32_t pin = 0;
+    uint32_t bit = 0;
+    int level = 0;
+
+    jitter_stats_init(stats, NOMINAL, BIN_WIDTH);
+    jitter_edge_queue_init(&queue);
+    transmit_init(&tx, &pin, 1, 1);
+    for (int f = 0; f < NUM_FRAMES; f++){
+        uint32_t first_bit = 0, last_bit = 0;
+        int first_late = 0, first_edge = 1;
+
+        transmit_queue(&tx, "Hello world! jitter");
+        while (transmit_busy(&tx)){
+            transmit_step(&tx);
+            if ((int) (pin & 1) != level){
+                int late = latency ? (int) (test_rand() % (latency + 1)) : 0;
+                uint32_t t = 0xFFFF0000u + bit * period + late;
+                level = pin & 1;
+                jitter_edge_push(&queue, t);
+                if (++want.num_edges % 32 == 0) jitter_drain(&queue, stats);
+
+                if (first_edge){
+                    first_edge = 0;
+                    first_bit = bit;
+                    first_late = late;
+                } else {
+                    int error = (int) (t - (0xFFFF0000u + first_bit * period +
+                        first_late + (bit - first_bit) * NOMINAL));
+                    want.num_bits += bit - last_bit;
+                    if (error < want.min_error) want.min_error = error;
+                    if (error > want.max_error) want.max_error = error;
+                }
+                last_bit = bit;
+            }
+            bit++;
+        }
+        bit += GAP_BITS;
+    }
+    jitter_drain(&queue, stats);
+    CHECK(queue.num_dropped == 0);
+    return want;
+}
+
+static void check_stats(const jitter_stats *stats, expected_stats want){
+    uint32_t binned = stats->num_outliers;
+
+    for (int i = 0; i < JITTER_HISTOGRAM_BINS; i++){
+        binned += stats->histogram[i];
+    }
+    CHECK(stats->num_edges == want.num_edges);
+    CHECK(stats->num_bits == want.num_bits);
+    CHECK(stats->min_error == want.min_error);
+    CHECK(stats->max_error == want.max_error);
+    // The first edge of each frame only sets the ideal times
+    CHECK(binned == want.num_edges - NUM_FRAMES);
+}
+
+static void test_latency(void){
+    const int latencies[] = {0, 10, 100, 400};
+    jitter_stats stats;
+
+    for (int i = 0; i < 4; i++){
+        expected_stats want = run_frames(&stats, NOMINAL, latencies[i]);
+        check_stats(&stats, want);
+        CHECK(stats.min_period >= NOMINAL - latencies[i]);
+        CHECK(stats.max_period <= NOMINAL + latencies[i]);
+        CHECK(stats.min_error >= -latencies[i]);
+        CHECK(stats.max_error <= latencies[i]);
+        if (latencies[i] == 0){
+            CHECK(stats.histogram[8] == stats.num_edges - NUM_FRAMES);
+        }
+    }
+}
+
+// A clock that is slow by a tick a bit drifts further behind every bit
+static void test_drift(void){
+    jitter_stats stats;
+    expected_stats want = run_frames(&stats, NOMINAL + 1, 0);
+
+    check_stats(&stats, want);
+    CHECK(stats.min_error == 0);
+    CHECK(stats.max_error > 100);
+    CHECK(stats.min_period == NOMINAL + 1 && stats.max_period == NOMINAL + 1);
+    CHECK(jitter_mean_period(&stats) == NOMINAL + 1);
+}
+
+// Bin 8 covers [0, bin_width) and bin 7 covers [-bin_width, 0)
+static void test_bins(void){
+    const int errors[] = {0, BIN_WIDTH - 1, BIN_WIDTH, -1, -BIN_WIDTH,
+        -BIN_WIDTH - 1};
+    const int bins[] = {8, 8, 9, 7, 7, 6};
+    jitter_stats stats;
+
+    for (int i = 0; i < 6; i++){
+        jitter_stats_init(&stats, NOMINAL, BIN_WIDTH);
+        jitter_add_edge(&stats, 0);
+        jitter_add_edge(&stats, NOMINAL + errors[i]);
+        CHECK(stats.histogram[bins[i]] == 1);
+    }
+    jitter_stats_init(&stats, NOMINAL, BIN_WIDTH);
+    jitter_add_edge(&stats, 0);
+    jitter_add_edge(&stats, NOMINAL + 8 * BIN_WIDTH);
+    CHECK(stats.num_outliers == 1);
+}
+
+int main(void){
+    test_queue();
+    test_latency();
+    test_drift();
+    test_bins();
+    return test_done("test_jitter");
+}
@@ -0,0 +1,134 @@
+/*
+ ==============================================
+ Name        : test_linecode.c
+ Author      :
+ Version     :
+ Description : Host test for linecode.c: round trips, the longest run
+             : without an edge, and the receiver staying locked through
+             : long frames whose bit period is off from a whole number
+             : of receiver ticks. Prints the longest all-ones frame
+             : received and the line bits it took at each period;
+             : test_linecode_nrz builds this file without line coding
+             : for the same table from plain NRZ.
+ ==============================================
+ */
+
+#ifndef LINE_CODE_ENABLED
+#define LINE_CODE_ENABLED 1
+#endif
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "compress.c"
+#include "fec.c"
+#include "linecode.c"
+#include "pam4.c"
+#include "receive.c"
+#include "transmit.c"
+
+#if LINE_CODE_ENABLED
+static void test_round_trip(void){
+    char data[64], line[80], decoded[64];
+
+    for (int len = 1; len <= (int) sizeof(data); len++){
+        for (int i = 0; i < len; i++) data[i] = (char) test_rand();
+        int level = len & 1;
+        int bits = linecode_encode(data, len, line, sizeof(line), level);
+        CHECK(bits == len * 10);
+
+        linecode_decoder dec;
+        int n = 0;
+        linecode_decoder_init(&dec, level);
+        for (int i = 0; i < bits; i++){
+            n += linecode_decoder_push(&dec, (line[i/8] >> (i%8)) & 1,
+                decoded + n);
+        }
+        CHECK(n == len && memcmp(decoded, data, len) == 0);
+        CHECK(dec.num_invalid == 0);
+    }
+}
+
+// The line changes level at least once every four bit periods
+static void test_run_length(void){
+    char data[256], line[320];
+    int run = 0, longest = 0, prev = 0;
+
+    for (int i = 0; i < 256; i++) data[i] = (char) i;
+    int bits = linecode_encode(data, sizeof(data), line, sizeof(line), 0);
+    for (int i = 0; i < bits; i++){
+        int level = (line[i/8] >> (i%8)) & 1;
+        run = level == prev ? run + 1 : 1;
+        prev = level;
+        if (run > longest) longest = run;
+    }
+    CHECK(longest <= 4);
+}
+#endif
+
+/*
+ * Sends text through transmit.c, one bit at a time, to receive.c
+ * sampling every tick. A bit lasts ticks_per_bit ticks on average, which
+ * need not be whole. Returns 1 if the frame arrived intact, and the bits
+ * the frame took on the line in *line_bits.
+ */
+static int send_frame(const char *text, double ticks_per_bit,
+        int *line_bits){
+    static transmit_state tx;
+    static receive_state rx;
+    volatile uint32_t pin = 0;
+    double edge = 0;
+    int t = 0;
+
+    transmit_init(&tx, &pin, 1, 1);
+    receive_init(&rx, &pin, 1);
+    transmit_queue(&tx, text);
+    *line_bits = 0;
+    while (transmit_busy(&tx)){
+        transmit_step(&tx);
+        (*line_bits)++;
+        for (edge += ticks_per_bit; t < edge; t++) receive_step(&rx, t);
+    }
+    for (int i = 0; i < 40 * ticks_per_bit; i++) receive_step(&rx, t++);
+    return rx.state == SIGNAL_COMPLETE && strcmp(rx.bit_buffer, text) == 0;
+}
+
+/*
+ * All-ones bytes give plain NRZ no edges to keep phase on. Line coding
+ * must carry the longest frame at every period; NRZ only where the
+ * period is a whole number of ticks.
+ */
+static void test_lock(void){
+    const double periods[] = {10.0, 10.2, 10.5, 11.0};
+    char text[RECEIVE_BUFFER_LEN - 1];
+    int line_bits;
+
+    const char *name = LINE_CODE_ENABLED ? "4B5B/NRZI" : "NRZ";
+
+    printf("line code  ticks/bit  longest frame  line bits  payload/line\n");
+    for (int i = 0; i < 4; i++){
+        int longest = 0, bits = 0;
+        for (int len = 1; len < (int) sizeof(text); len++){
+            memset(text, 0xFF, len);
+            text[len] = '\0';
+            if (!send_frame(text, periods[i], &line_bits)) continue;
+            longest = len;
+            bits = line_bits;
+        }
+        printf("%-9s  %9.1f  %7d bytes  %9d  %12.2f\n", name, periods[i],
+            longest, bits, bits ? longest * 8.0 / bits : 0);
+        if (LINE_CODE_ENABLED || periods[i] == (int) periods[i]){
+            CHECK(longest == (int) sizeof(text) - 1);
+        }
+        CHECK(send_frame("Hello world!", periods[i], &line_bits) ==
+            (LINE_CODE_ENABLED || periods[i] == (int) periods[i]));
+    }
+}
+
+int main(void){
+#if LINE_CODE_ENABLED
+    test_round_trip();
+    test_run_length();
+#endif
+    test_lock();
+    return test_done(LINE_CODE_ENABLED ? "test_linecode" : "test_linecode_nrz");
+}
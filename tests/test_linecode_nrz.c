@@ -0,0 +1,14 @@
+/*
+ ==============================================
+ Name        : test_linecode_nrz.c
+ Author      :
+ Version     :
+ Description : test_linecode.c built without line coding, so its table
+             : shows plain NRZ at the same bit periods, and the receiver
+             : without edge re-centring still takes whole-tick frames.
+ ==============================================
+ */
+
+#define LINE_CODE_ENABLED 0
+
+#include "test_linecode.c"
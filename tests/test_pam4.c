@@ -0,0 +1,124 @@
+/*
+ ==============================================
+ Name        : test_pam4.c
+ Author      :
+ Version     :
+ Description : Host test for pam4.c: Gray mapping, slicer training on a
+             : channel with unknown gain and offset, and whole frames
+             : sent through transmit.c's DAC output to receive.c's ADC
+             : input over a noisy channel.
+ ==============================================
+ */
+
+#define PAM4_ENABLED 1
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "compress.c"
+#include "fec.c"
+#include "linecode.c"
+#include "pam4.c"
+#include "receive.c"
+#include "transmit.c"
+
+// Light reaching the photodiode: an offset, a gain and some noise
+#define CHANNEL_OFFSET 500
+#define CHANNEL_GAIN   2
+
+// ADC data register reading for a DACR value, with up to +/-noise LSB
+static uint32_t channel(uint32_t dacr, int noise){
+    int sample = CHANNEL_OFFSET + CHANNEL_GAIN * (int) (dacr >> 6);
+
+    if (noise) sample += (int) (test_rand() % (2*noise + 1)) - noise;
+    if (sample < 0) sample = 0;
+    if (sample > PAM4_ADC_MAX) sample = PAM4_ADC_MAX;
+    return (uint32_t) sample << 4;
+}
+
+// Neighbouring levels carry bit pairs that differ in one bit
+static void test_gray(void){
+    for (int level = 0; level < PAM4_LEVELS - 1; level++){
+        int a = -1, b = -1;
+        for (int bits = 0; bits < PAM4_LEVELS; bits++){
+            if (pam4_gray[bits] == level) a = bits;
+            if (pam4_gray[bits] == level + 1) b = bits;
+        }
+        int diff = a ^ b;
+        CHECK(a >= 0 && b >= 0 && diff && !(diff & (diff - 1)));
+    }
+
+    char bits = 0x1B;   // Pairs 11, 10, 01, 00 from the least significant
+    CHECK(pam4_map_symbol(&bits, 0, 8) == pam4_gray[3]);
+    CHECK(pam4_map_symbol(&bits, 2, 8) == pam4_gray[2]);
+    CHECK(pam4_map_symbol(&bits, 4, 8) == pam4_gray[1]);
+    CHECK(pam4_map_symbol(&bits, 6, 8) == pam4_gray[0]);
+    CHECK(pam4_map_symbol(&bits, 0, 1) == pam4_gray[1]);
+}
+
+// Training moves the thresholds to the midpoints of the levels received
+static void test_training(void){
+    pam4_slicer slicer;
+    int trained = 0;
+
+    pam4_slicer_init(&slicer);
+    for (int i = 0; i < PAM4_TRAINING_SYMBOLS; i++){
+        int level = pam4_training_level(i);
+        trained = pam4_train(&slicer, pam4_adc_sample(
+            channel(pam4_dac_value(level), 0)));
+        CHECK(trained == (i == PAM4_TRAINING_SYMBOLS - 1));
+    }
+    for (int i = 0; i < PAM4_LEVELS - 1; i++){
+        int lo = CHANNEL_OFFSET + CHANNEL_GAIN * pam4_dac_levels[i];
+        int hi = CHANNEL_OFFSET + CHANNEL_GAIN * pam4_dac_levels[i+1];
+        CHECK(slicer.threshold[i] == (lo + hi) / 2);
+    }
+    for (int level = 0; level < PAM4_LEVELS; level++){
+        int sample = pam4_adc_sample(channel(pam4_dac_value(level), 0));
+        CHECK(pam4_slice(&slicer, sample) == level);
+        CHECK(pam4_slice(&slicer, sample - 300) == level);
+        CHECK(pam4_slice(&slicer, sample + 300) == level);
+    }
+}
+
+/*
+ * Sends text through transmit.c and the channel to receive.c, ten
+ * receiver ticks per symbol. Returns 1 if the frame arrived intact.
+ */
+static int send_frame(const char *text, int noise){
+    static transmit_state tx;
+    static receive_state rx;
+    uint32_t dacr = 0;
+    volatile uint32_t adc = 0;
+    int t = 0;
+
+    transmit_init(&tx, &dacr, 1, 1);
+    receive_init(&rx, &adc, 0);
+    transmit_queue(&tx, text);
+    for (int i = 0; transmit_busy(&tx) || i < 400; i++){
+        if (transmit_busy(&tx)) transmit_step(&tx);
+        for (int k = 0; k < 10; k++){
+            adc = channel(dacr, noise);
+            receive_step(&rx, t++);
+        }
+    }
+    return rx.state == SIGNAL_COMPLETE && strcmp(rx.bit_buffer, text) == 0;
+}
+
+// Levels arrive 682 LSB apart; noise up to 200 LSB costs no frames
+static void test_frames(void){
+    const char *text = "Hello world! PAM-4 telemetry frame";
+    const int noise[] = {0, 50, 100, 200};
+
+    for (int i = 0; i < 4; i++){
+        int ok = 0;
+        for (int n = 0; n < 20; n++) ok += send_frame(text, noise[i]);
+        CHECK(ok == 20);
+    }
+}
+
+int main(void){
+    test_gray();
+    test_training();
+    test_frames();
+    return test_done("test_pam4");
+}
@@ -0,0 +1,222 @@
+/*
+ ==============================================
+ Name        : test_peripheral_clock.c
+ Author      :
+ Version     :
+ Description : Host test for peripheral_clock.c: timer, ADC and SSP plans
+             : at random cclk frequencies, each checked against the rate
+             : it really produces and against a brute force search of the
+             : dividers, then the PCLKSEL and timer register writes.
+ ==============================================
+ */
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "clock_util.c"
+#include "peripheral_clock.c"
+
+#define FREQUENCIES 400
+
+// The RTC, the IRC and the fastest cclk, then random ones from 1 MHz up
+static int random_frequency(int i){
+    if (i == 0) return CLOCK_SPEED_RTC_CLK;
+    if (i == 1) return CLOCK_SPEED_IRC_OSC;
+    if (i == 2) return CLOCK_SPEED_CCLK_MAX;
+    return 1000000 + (int) (test_rand() % (CLOCK_SPEED_CCLK_MAX - 1000000));
+}
+
+// Relative error of a period of got seconds for a requested want
+static double relative(double got, double want){
+    return fabs(got - want) / want;
+}
+
+// Smallest error of any divider and prescale 1 to 4 for num/den seconds
+static double timer_brute(int f, uint32_t num, uint32_t den){
+    double best = 1e300;
+
+    for (int sel = 0; sel < 4; sel++){
+        double want = (double) f / pclk_divider[sel] * num / den;
+        for (int pr = 1; pr <= 4; pr++){
+            double c = floor(want / pr + 0.5);
+            for (double counts = c - 1; counts <= c + 1; counts++){
+                if (counts < 1 || counts > 4294967295.0 || counts * pr < 2){
+                    continue;
+                }
+                double err = fabs(counts * pr - want) / want;
+                if (err < best) best = err;
+            }
+        }
+    }
+    return best;
+}
+
+// Bit periods of 48 ms down to 4.8 us, a 25 kHz tick and a 38 kHz carrier
+static void test_timer(void){
+    const uint32_t periods[][2] = {
+        {1, 25000}, {48000, 1000000}, {48000, 10000000}, {4800, 10000000},
+        {480, 10000000}, {48, 1000000}, {48, 10000000}, {1, 38000}
+    };
+
+    for (int i = 0; i < FREQUENCIES; i++){
+        clock_settings clock = {.frequency = random_frequency(i)};
+        for (int p = 0; p < 8; p++){
+            uint32_t num = periods[p][0], den = periods[p][1];
+            timer_plan t;
+            t.pclk = 0;
+            int ret = timer_plan_period(&clock, num, den, &t);
+            if (ret != 0 && t.pclk == 0) continue;
+
+            CHECK(t.pclk == (uint32_t) clock.frequency / pclk_divider[t.pclksel]);
+            double got = (t.match + 1.0) * (t.prescale + 1.0) *
+                pclk_divider[t.pclksel] / clock.frequency;
+            double err = relative(got, (double) num / den);
+            CHECK(fabs(fabs(t.error_ppm) - err * 1e6) <= 0.51);
+            CHECK(err <= timer_brute(clock.frequency, num, den) * (1 + 1e-9) +
+                1e-15);
+            CHECK((ret != 0) == (abs(t.error_ppm) > PCLK_MAX_ERROR_PPM));
+        }
+    }
+}
+
+// The fixed divider is kept, and the helpers agree with the general call
+static void test_timer_helpers(void){
+    clock_settings clock = {.frequency = 100000000};
+    timer_plan a, b;
+
+    for (int sel = 0; sel < 4; sel++){
+        CHECK(timer_plan_fixed(&clock, sel, 1, 25000, &a) == 0);
+        CHECK(a.pclksel == sel && a.rate == 25000 && a.error_ppm == 0);
+    }
+    CHECK(timer_plan_rate(&clock, 25000, &a) == 0);
+    CHECK(timer_plan_period(&clock, 1, 25000, &b) == 0);
+    CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+    CHECK(timer_plan_period_us(&clock, 48000, &a) == 0);
+    CHECK(timer_plan_period(&clock, 48000, 1000000, &b) == 0);
+    CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+
+    // Longer than 32 bits of pclk ticks needs a prescale
+    CHECK(timer_plan_period(&clock, 1000, 1, &a) == 0);
+    CHECK(a.prescale > 0 && a.error_ppm == 0);
+
+    clock.frequency = 0;
+    CHECK(timer_plan_rate(&clock, 25000, &a) == -1);
+}
+
+// Never faster than requested, and no slower than it needs to be
+static void test_adc(void){
+    const uint32_t rates[] = {153846, 200000, 100000, 1000, 1};
+
+    for (int i = 0; i < FREQUENCIES; i++){
+        clock_settings clock = {.frequency = random_frequency(i)};
+        for (int r = 0; r < 5; r++){
+            adc_plan a;
+            double best = 1e300;
+            for (int sel = 0; sel < 4; sel++){
+                double pclk = (double) clock.frequency / pclk_divider[sel];
+                for (int div = 1; div <= 256; div++){
+                    if (pclk / div > ADC_CLOCK_MAX) continue;
+                    double err = div * 65.0 * rates[r] / pclk - 1;
+                    if (err <= 1e-12 && -err < best) best = -err;
+                }
+            }
+
+            int ret = adc_plan_rate(&clock, rates[r], &a);
+            CHECK((ret == 0) == (best < 1e300));
+            if (ret != 0) continue;
+            CHECK(a.clkdiv <= 255 && a.adc_clock <= ADC_CLOCK_MAX);
+            CHECK(a.pclk == (uint32_t) clock.frequency / pclk_divider[a.pclksel]);
+            CHECK(a.error_ppm <= 0 && a.rate >= rates[r]);
+            double err = relative((a.clkdiv + 1.0) * 65 *
+                pclk_divider[a.pclksel] / clock.frequency, 1.0 / rates[r]);
+            CHECK(fabs(-a.error_ppm - err * 1e6) <= 0.51);
+            CHECK(err <= best * (1 + 1e-9) + 1e-15);
+        }
+    }
+}
+
+// Out of reach, the fixed plan is still the fastest the ADC allows
+static void test_adc_fixed(void){
+    clock_settings clock = {.frequency = 120000000};
+    adc_plan a;
+
+    CHECK(adc_plan_fixed(&clock, 1, 153846, &a) == 0);
+    CHECK(a.pclksel == 1 && a.rate >= 153846);
+    CHECK(adc_plan_fixed(&clock, 1, 1000000, &a) == -1);
+    CHECK(a.pclksel == 1 && a.clkdiv == 9 && a.adc_clock == 12000000);
+    CHECK(a.rate == 12000000 / 65 && a.error_ppm > 0);
+}
+
+// Never faster than requested, and no slower than any divider pair
+static void test_ssp(void){
+    const uint32_t rates[] = {10000000, 2400000, 1000000, 115200, 9600};
+
+    for (int i = 0; i < FREQUENCIES; i++){
+        clock_settings clock = {.frequency = random_frequency(i)};
+        for (int r = 0; r < 5; r++){
+            int sel = (int) (test_rand() & 3);
+            uint64_t want = (uint32_t) clock.frequency, best = 0;
+            for (uint64_t cps = 2; cps <= 254; cps += 2){
+                for (uint64_t scr = 1; scr <= 256; scr++){
+                    uint64_t div = cps * scr * pclk_divider[sel];
+                    if (div * rates[r] >= want && (!best || div < best)){
+                        best = div;
+                    }
+                }
+            }
+
+            ssp_plan s;
+            int ret = ssp_plan_rate(&clock, sel, rates[r], &s);
+            CHECK(s.pclksel == sel && s.cpsdvsr % 2 == 0);
+            CHECK(s.cpsdvsr >= 2 && s.cpsdvsr <= 254 && s.scr <= 255);
+            uint64_t div = (uint64_t) s.cpsdvsr * (s.scr + 1) *
+                pclk_divider[sel];
+            CHECK(ret == (best ? 0 : -1));
+            if (ret == 0){
+                CHECK(div == best);
+                CHECK(s.rate <= rates[r] && s.error_ppm >= 0);
+            } else {
+                CHECK(div == 254u * 256 * pclk_divider[sel]);
+            }
+        }
+    }
+}
+
+// PCLKSEL fields, and a new period loaded into a running timer
+static void test_registers(void){
+    clock_settings clock = {.frequency = 100000000};
+    timer_plan t;
+
+    LPC_SC->PCLKSEL0 = LPC_SC->PCLKSEL1 = 0;
+    pclk_select(PCLK_TIMER0, 1);
+    pclk_select(PCLK_ADC, 2);
+    pclk_select(PCLK_TIMER3, 3);
+    CHECK(LPC_SC->PCLKSEL0 == (1u << 2 | 2u << 24));
+    CHECK(LPC_SC->PCLKSEL1 == 3u << 14);
+    pclk_select(PCLK_TIMER0, 0);
+    CHECK(LPC_SC->PCLKSEL0 == 2u << 24);
+
+    // A shorter period holds the count inside it, and restarts the timer
+    timer_plan_fixed(&clock, 1, 1, 25000, &t);
+    LPC_TIM0->PR = 0;
+    LPC_TIM0->MR0 = 9999;
+    LPC_TIM0->TC = 9000;
+    LPC_TIM0->TCR = 1;
+    timer_plan_retune(LPC_TIM0, &t);
+    CHECK(LPC_TIM0->PR == t.prescale && LPC_TIM0->MR0 == t.match);
+    CHECK(LPC_TIM0->TC == t.match && LPC_TIM0->TCR == 1);
+
+    // The same plan again leaves a running count alone
+    LPC_TIM0->TC = 5;
+    timer_plan_retune(LPC_TIM0, &t);
+    CHECK(LPC_TIM0->TC == 5);
+}
+
+int main(void){
+    test_timer();
+    test_timer_helpers();
+    test_adc();
+    test_adc_fixed();
+    test_ssp();
+    test_registers();
+    return test_done("test_peripheral_clock");
+}
@@ -0,0 +1,89 @@
+/*
+ ==============================================
+ Name        : test_pwm_carrier.c
+ Author      :
+ Version     :
+ Description : Host test for pwm_carrier.c: the match values give the
+             : whole carrier period closest to the one requested, the
+             : PCLKSEL field matches the divider, and the PWM1 registers
+             : come out as the carrier gating expects.
+ ==============================================
+ */
+
+#define CLOCK_UTIL_HOST
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "clock_util.c"
+#include "pwm_carrier.c"
+
+// Distance of pclk / period from carrier, in Hz
+static double carrier_error(uint32_t pclk, uint32_t period, uint32_t carrier){
+    return fabs((double) pclk / period - carrier);
+}
+
+static void test_calculate(void){
+    const int cclks[] = {12000000, 48000000, 72000000, 100000000, 120000000};
+    const uint32_t carriers[] = {38000, 56000, 100000, 455000, 500000};
+    pwm_carrier_settings pwm = {0};
+
+    for (int c = 0; c < 5; c++){
+        clock_settings *clock = calculate_clock_settings(cclks[c]);
+        for (int div = 1; div <= 8; div *= 2){
+            for (int k = 0; k < 5; k++){
+                uint32_t pclk = clock->frequency / div;
+                CHECK(pwm_carrier_calculate(clock, div, carriers[k], &pwm) == 0);
+                CHECK(pwm.pclk == pclk);
+                CHECK(pwm.mr1 == (pwm.mr0 + 1) / 2 && pwm.mr1 > 0);
+                CHECK(pwm.frequency == pclk / (pwm.mr0 + 1));
+
+                // No neighbouring whole period comes closer
+                uint32_t period = pwm.mr0 + 1;
+                double error = carrier_error(pclk, period, carriers[k]);
+                CHECK(error <= carrier_error(pclk, period - 1, carriers[k]));
+                CHECK(error <= carrier_error(pclk, period + 1, carriers[k]));
+            }
+        }
+    }
+
+    clock_settings slow = {0};
+    slow.frequency = CLOCK_SPEED_IRC_OSC;
+    CHECK(pwm_carrier_calculate(&slow, 4, 800000, &pwm) == -1);
+    CHECK(pwm_carrier_calculate(&slow, 1, 0, &pwm) == -1);
+    CHECK(pwm_carrier_calculate(&slow, 0, 38000, &pwm) == -1);
+}
+
+// PCLKSEL field values: 0 divides by 4, 1 by 1, 2 by 2, 3 by 8
+static void test_pclksel(void){
+    CHECK(pwm_carrier_pclksel(1) == 1);
+    CHECK(pwm_carrier_pclksel(2) == 2);
+    CHECK(pwm_carrier_pclksel(4) == 0);
+    CHECK(pwm_carrier_pclksel(8) == 3);
+}
+
+static void test_registers(void){
+    pwm_carrier_settings pwm = {0};
+
+    pwm_carrier_calculate(calculate_clock_settings(120000000), 1, 38000, &pwm);
+    LPC_PINCON->PINSEL4 = 0xFFFFFFFF;
+    pwm_carrier_init(&pwm);
+    CHECK(LPC_SC->PCONP & (1 << 6));
+    CHECK(LPC_PINCON->PINSEL4 == 0xFFFFFFFD);
+    CHECK(LPC_PWM1->MR0 == pwm.mr0);
+    CHECK(LPC_PWM1->MR1 == 0);
+    CHECK(LPC_PWM1->MCR == 2);
+    CHECK(LPC_PWM1->PCR == 1 << 9);
+    CHECK(LPC_PWM1->TCR == 9);
+
+    pwm_carrier_set(&pwm, 1);
+    CHECK(LPC_PWM1->MR1 == pwm.mr1 && LPC_PWM1->LER == 2);
+    pwm_carrier_set(&pwm, 0);
+    CHECK(LPC_PWM1->MR1 == 0 && LPC_PWM1->LER == 2);
+}
+
+int main(void){
+    test_calculate();
+    test_pclksel();
+    test_registers();
+    return test_done("test_pwm_carrier");
+}
@@ -0,0 +1,105 @@
+/*
+ ==============================================
+ Name        : test_rate.c
+ Author      :
+ Version     :
+ Description : Host test for rate.c: frame grading, stepping through the
+             : rate table, falling back after missing acks, and
+             : converging on a channel whose best usable rate changes.
+ ==============================================
+ */
+
+#include "test.h"
+#include "rate.c"
+
+static void test_grading(void){
+    rate_monitor m;
+
+    rate_monitor_init(&m);
+    CHECK(rate_monitor_frame(&m, 0, 0, 0, 100) == RATE_REPORT_DOWN);
+    CHECK(rate_monitor_frame(&m, 1, RATE_DOWN_CORRECTIONS, 0, 100) ==
+        RATE_REPORT_DOWN);
+    CHECK(rate_monitor_frame(&m, 1, 0, 26, 100) == RATE_REPORT_DOWN);
+    CHECK(rate_monitor_frame(&m, 1, 1, 0, 100) == RATE_REPORT_HOLD);
+    CHECK(rate_monitor_frame(&m, 1, 0, 13, 100) == RATE_REPORT_HOLD);
+
+    // Only a run of clean frames asks for more speed, then starts over
+    for (int i = 1; i < RATE_UP_FRAMES; i++){
+        CHECK(rate_monitor_frame(&m, 1, 0, 12, 100) == RATE_REPORT_HOLD);
+    }
+    CHECK(rate_monitor_frame(&m, 1, 0, 12, 100) == RATE_REPORT_UP);
+    CHECK(rate_monitor_frame(&m, 1, 0, 0, 100) == RATE_REPORT_HOLD);
+}
+
+static void test_controller(void){
+    rate_controller c;
+
+    rate_controller_init(&c);
+    CHECK(rate_bit_period(&c) == rate_bit_periods[0]);
+    CHECK(rate_controller_report(&c, RATE_REPORT_DOWN) == 0);
+    for (int i = 1; i < RATE_NUM_RATES; i++){
+        CHECK(rate_controller_report(&c, RATE_REPORT_UP) == 1);
+    }
+    CHECK(rate_controller_report(&c, RATE_REPORT_UP) == 0);
+    CHECK(rate_bit_period(&c) == RATE_FASTEST_US);
+    CHECK(rate_controller_report(&c, RATE_REPORT_DOWN) == 1);
+    CHECK(c.index == RATE_NUM_RATES - 2);
+
+    // An ack between timeouts resets the count
+    CHECK(rate_controller_timeout(&c) == 0);
+    CHECK(rate_controller_timeout(&c) == 0);
+    CHECK(rate_controller_report(&c, RATE_REPORT_HOLD) == 0);
+    for (int i = 1; i < RATE_MAX_FAILURES; i++){
+        CHECK(rate_controller_timeout(&c) == 0);
+    }
+    CHECK(rate_controller_timeout(&c) == 1);
+    CHECK(c.index == 0 && c.num_fallbacks == 1);
+}
+
+/*
+ * A channel whose fastest usable rate index changes every SEGMENT_FRAMES.
+ * Frames above it are lost and never acknowledged, frames at it need a
+ * few corrections and sometimes fail, and frames below it are clean.
+ */
+#define SEGMENT_FRAMES 200
+#define SETTLE_FRAMES  80
+
+static void test_convergence(void){
+    const int capacity[] = {4, 6, 2, 5, 0, 3};
+    rate_controller c;
+    rate_monitor m;
+    int settled = 0, at_capacity = 0, above = 0;
+
+    rate_controller_init(&c);
+    rate_monitor_init(&m);
+    for (int f = 0; f < 6 * SEGMENT_FRAMES; f++){
+        int cap = capacity[f / SEGMENT_FRAMES];
+        int i = c.index;
+
+        if (i > cap){
+            rate_controller_timeout(&c);
+            above++;
+        } else {
+            int corrected = i == cap ? (int) (test_rand() % 3) : 0;
+            int ok = i < cap || test_rand() % 20 != 0;
+            int report = rate_monitor_frame(&m, ok, corrected, i == cap, 10);
+            rate_controller_report(&c, report);
+        }
+
+        // Once settled, the rate stays at or one below the capacity
+        if (f % SEGMENT_FRAMES >= SETTLE_FRAMES){
+            settled++;
+            if (i == cap) at_capacity++;
+            CHECK(i >= cap - 1 && i <= cap);
+        }
+    }
+    CHECK(at_capacity * 10 >= settled * 6);
+    CHECK(above < 20);
+}
+
+int main(void){
+    test_grading();
+    test_controller();
+    test_convergence();
+    return test_done("test_rate");
+}
@@ -0,0 +1,138 @@
+/*
+ ==============================================
+ Name        : test_tracelog.c
+ Author      :
+ Version     :
+ Description : Host test for tracelog.c: records come out in the order
+             : they went in, the ring wraps and keeps working across the
+             : 32 bit wrap of its counters, a full ring counts and drops
+             : new records, and an interrupt pushing at random against a
+             : slower main loop loses nothing it did not count. Then the
+             : ISR timing statistics.
+ ==============================================
+ */
+
+#include "test.h"
+
+static uint32_t sim_cycles;
+#define CLOCK_DWT_CYCCNT sim_cycles
+
+#include "tracelog.c"
+
+// Pops one record and checks it is the one pushed as number seq
+static int pop_seq(trace_log *log, uint32_t seq){
+    trace_record rec;
+
+    if (!trace_pop(log, &rec)) return 0;
+    CHECK(rec.event == TRACE_TX_SYMBOL && rec.arg1 == seq);
+    CHECK(rec.arg0 == (uint16_t) seq && rec.time == seq * 3);
+    return 1;
+}
+
+static void push_seq(trace_log *log, uint32_t seq){
+    sim_cycles = seq * 3;
+    trace_push(log, TRACE_TX_SYMBOL, (int) seq, seq);
+}
+
+static void test_order(void){
+    trace_record rec;
+
+    trace_init(&global_trace);
+    CHECK(!trace_pop(&global_trace, &rec));
+    for (uint32_t i = 0; i < 10; i++) push_seq(&global_trace, i);
+    for (uint32_t i = 0; i < 10; i++) CHECK(pop_seq(&global_trace, i));
+    CHECK(!trace_pop(&global_trace, &rec));
+    CHECK(global_trace.num_dropped == 0);
+
+    // arg0 keeps its low 16 bits
+    trace_push(&global_trace, TRACE_TX_FRAME, 0x12345, 7);
+    CHECK(trace_pop(&global_trace, &rec));
+    CHECK(rec.event == TRACE_TX_FRAME && rec.arg0 == 0x2345 && rec.arg1 == 7);
+}
+
+// Many times round the ring, and past the wrap of head and tail
+static void test_wrap(void){
+    uint32_t seq = 0;
+
+    trace_init(&global_trace);
+    global_trace.head = global_trace.tail = 0xFFFFFF00;
+    for (int round = 0; round < 40; round++){
+        int n = 1 + round * 7 % TRACE_LOG_LEN;
+        for (int i = 0; i < n; i++) push_seq(&global_trace, seq + i);
+        for (int i = 0; i < n; i++) CHECK(pop_seq(&global_trace, seq + i));
+        seq += n;
+    }
+    CHECK(global_trace.head < 0xFFFFFF00 && global_trace.num_dropped == 0);
+}
+
+// A full ring drops new records, and takes them again once popped
+static void test_dropped(void){
+    trace_init(&global_trace);
+    for (uint32_t i = 0; i < TRACE_LOG_LEN + 5; i++){
+        push_seq(&global_trace, i);
+    }
+    CHECK(global_trace.num_dropped == 5);
+    CHECK(global_trace.head - global_trace.tail == TRACE_LOG_LEN);
+
+    CHECK(pop_seq(&global_trace, 0));
+    push_seq(&global_trace, 1000);
+    CHECK(global_trace.num_dropped == 5);
+    for (uint32_t i = 1; i < TRACE_LOG_LEN; i++){
+        CHECK(pop_seq(&global_trace, i));
+    }
+    CHECK(pop_seq(&global_trace, 1000));
+}
+
+/*
+ * Bursts of pushes from the interrupt between main loop passes that pop
+ * a few at a time. Every record is either popped, in order, or counted.
+ */
+static void test_bursts(void){
+    trace_record rec;
+    uint32_t pushed = 0, popped = 0, last = 0;
+    int first = 1;
+
+    trace_init(&global_trace);
+    for (int pass = 0; pass < 20000; pass++){
+        int burst = (int) (test_rand() % 40);
+        for (int i = 0; i < burst; i++){
+            sim_cycles = pushed;
+            trace_push(&global_trace, TRACE_TX_SYMBOL, 0, pushed++);
+        }
+        int pops = (int) (test_rand() % 24);
+        for (int i = 0; i < pops && trace_pop(&global_trace, &rec); i++){
+            CHECK(first || rec.arg1 > last);
+            CHECK(rec.time == rec.arg1);
+            last = rec.arg1;
+            first = 0;
+            popped++;
+        }
+    }
+    while (trace_pop(&global_trace, &rec)) popped++;
+    CHECK(global_trace.num_dropped > 0);
+    CHECK(popped + global_trace.num_dropped == pushed);
+}
+
+static void test_timing(void){
+    const uint32_t cycles[] = {120, 80, 300, 95};
+    trace_timing t;
+
+    trace_timing_init(&t);
+    sim_cycles = 0xFFFFFFF0;
+    for (int i = 0; i < 4; i++){
+        trace_timing_begin(&t);
+        sim_cycles += cycles[i];
+        trace_timing_end(&t);
+        sim_cycles += 1000;
+    }
+    CHECK(t.count == 4 && t.min == 80 && t.max == 300 && t.total == 595);
+}
+
+int main(void){
+    test_order();
+    test_wrap();
+    test_dropped();
+    test_bursts();
+    test_timing();
+    return test_done("test_tracelog");
+}
@@ -0,0 +1,227 @@
+/*
+ ==============================================
+ Name        : test_transmit.c
+ Author      :
+ Version     :
+ Description : Host test for transmit.c: the symbols of a frame on the
+             : wire, queued frames going out back to back with every bit
+             : lasting the same number of ticks, and a full queue or an
+             : oversized message being refused. Prints the cycles per
+             : symbol of the ISR against the per-bit one it replaced.
+ ==============================================
+ */
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "compress.c"
+#include "fec.c"
+#include "linecode.c"
+#include "pam4.c"
+#include "receive.c"
+#include "transmit.c"
+
+#define TICKS_PER_BIT 10
+
+// Preamble, frame flag, payload least significant bit first, idle low
+static int expected_bits(const char *text, char *bits){
+    int n = 0;
+
+    for (int i = 0; i < 8; i++) bits[n++] = !(i % 2);
+    for (int i = 0; i < 8; i++) bits[n++] = i >= 4;
+    for (int i = 0; i <= (int) strlen(text); i++){
+        for (int b = 0; b < 8; b++) bits[n++] = (text[i] >> b) & 1;
+    }
+    bits[n++] = 0;
+    return n;
+}
+
+/*
+ * Sends every queued frame and checks the output against the frames'
+ * bits, one level per TICKS_PER_BIT ticks. Returns the ticks taken.
+ */
+static int send(transmit_state *tx, volatile uint32_t *pin, const char *bits,
+        int num_bits){
+    int ticks = 0;
+
+    while (transmit_busy(tx) || tx->tick != 0){
+        transmit_step(tx);
+        int bit = ticks / TICKS_PER_BIT;
+        if (bit < num_bits) CHECK((*pin & 1) == (uint32_t) bits[bit]);
+        ticks++;
+    }
+    return ticks;
+}
+
+static void test_frame(void){
+    transmit_state tx;
+    volatile uint32_t pin = 0;
+    char bits[512];
+    int n = expected_bits("Hi!", bits);
+
+    transmit_init(&tx, &pin, 1, TICKS_PER_BIT);
+    CHECK(!transmit_busy(&tx));
+    CHECK(transmit_queue(&tx, "Hi!") == 0);
+    CHECK(transmit_busy(&tx));
+    CHECK(send(&tx, &pin, bits, n) == n * TICKS_PER_BIT);
+    CHECK(tx.num_frames_sent == 1);
+}
+
+// Queued frames follow each other with no gap and no short bit
+static void test_back_to_back(void){
+    const char *texts[] = {"A", "Back to back", "C"};
+    transmit_state tx;
+    volatile uint32_t pin = 0;
+    char bits[1024];
+    int n = 0;
+
+    transmit_init(&tx, &pin, 1, TICKS_PER_BIT);
+    for (int i = 0; i < TRANSMIT_QUEUE_LEN - 1; i++){
+        CHECK(transmit_queue(&tx, texts[i]) == 0);
+        n += expected_bits(texts[i], bits + n);
+    }
+    CHECK(transmit_queue_full(&tx));
+    CHECK(transmit_queue(&tx, "full") == -1);
+    CHECK(send(&tx, &pin, bits, n) == n * TICKS_PER_BIT);
+    CHECK(tx.num_frames_sent == TRANSMIT_QUEUE_LEN - 1);
+}
+
+// A slot freed by the transmitter can be refilled while it sends
+static void test_refill(void){
+    transmit_state tx;
+    volatile uint32_t pin = 0;
+    int queued = 0;
+
+    transmit_init(&tx, &pin, 1, 1);
+    for (int t = 0; t < 20000; t++){
+        if (!transmit_queue_full(&tx) && transmit_queue(&tx, "refill") == 0){
+            queued++;
+        }
+        transmit_step(&tx);
+    }
+    CHECK(queued > 100);
+    CHECK(tx.num_frames_sent >= queued - (TRANSMIT_QUEUE_LEN - 1));
+}
+
+static void test_too_long(void){
+    transmit_state tx;
+    volatile uint32_t pin = 0;
+    char text[TRANSMIT_LINE_BUFFER_LEN + 1];
+
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    transmit_init(&tx, &pin, 1, TICKS_PER_BIT);
+    CHECK(transmit_queue(&tx, text) == -1);
+    CHECK(!transmit_busy(&tx));
+}
+
+/*
+ * The ISR as it was before frames were packed: a switch on the frame
+ * phase every bit, and the payload bit found by division and modulo.
+ */
+typedef struct {
+    int phase;
+    int position;
+    int tick;
+    int ticks_per_bit;
+    const char *message;
+    int num_bits;
+    volatile uint32_t *output;
+    int output_mask;
+} legacy_state;
+
+static void legacy_set_bit(legacy_state *state, int bit){
+    if (bit){
+        *state->output |= state->output_mask;
+    } else {
+        *state->output &= ~state->output_mask;
+    }
+}
+
+static void legacy_step(legacy_state *state){
+    if (state->phase == 3) return;
+
+    int first_tick = (state->tick == 0);
+    if (++state->tick >= state->ticks_per_bit){
+        state->tick = 0;
+    }
+    if (!first_tick) return;
+
+    switch(state->phase){
+        case 0:
+            legacy_set_bit(state, !(state->position%2));
+            if (++state->position >= 8){
+                state->phase = 1;
+                state->position = 0;
+            }
+            break;
+        case 1:
+            legacy_set_bit(state, state->position >= 4);
+            if (++state->position >= 8){
+                state->phase = 2;
+                state->position = 0;
+            }
+            break;
+        case 2:
+            if (state->position >= state->num_bits){
+                legacy_set_bit(state, 0);
+                state->phase = 3;
+                break;
+            }
+            int index  = state->position/8;
+            int bitNum = state->position%8;
+            legacy_set_bit(state, state->message[index] & (1<<bitNum));
+            state->position++;
+            break;
+    }
+}
+
+/*
+ * One symbol per tick, so every step is an ISR that writes the output.
+ * Both are called through a pointer, as the timer interrupt calls them,
+ * so neither is inlined into the timing loop.
+ */
+static void test_benchmark(void){
+    void (*volatile new_step)(transmit_state *) = transmit_step;
+    void (*volatile old_step)(legacy_state *) = legacy_step;
+    const int runs = 2000;
+    char text[100];
+    transmit_state tx;
+    legacy_state old;
+    volatile uint32_t pin = 0, old_pin = 0;
+    uint64_t new_cycles = UINT64_MAX, old_cycles = UINT64_MAX;
+    int n = 0;
+
+    memset(text, 'b', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    transmit_init(&tx, &pin, 1, 1);
+    for (int r = 0; r < runs; r++){
+        CHECK(transmit_queue(&tx, text) == 0);
+        n = tx.queue[tx.tail].num_symbols;
+        uint64_t start = test_cycles();
+        for (int i = 0; i < n; i++) new_step(&tx);
+        uint64_t cycles = test_cycles() - start;
+        if (cycles < new_cycles) new_cycles = cycles;
+
+        old = (legacy_state) {0, 0, 0, 1, text, (int) sizeof(text) * 8,
+            &old_pin, 1};
+        start = test_cycles();
+        for (int i = 0; i < n; i++) old_step(&old);
+        cycles = test_cycles() - start;
+        if (cycles < old_cycles) old_cycles = cycles;
+        CHECK(old.phase == 3 && pin == old_pin);
+    }
+    CHECK(!transmit_busy(&tx));
+
+    // The quickest frame of each, clear of interrupts on the host
+    printf("per-bit ISR %.1f cycles per symbol, word-shift ISR %.1f\n",
+        (double) old_cycles / n, (double) new_cycles / n);
+}
+
+int main(void){
+    test_frame();
+    test_back_to_back();
+    test_refill();
+    test_too_long();
+    test_benchmark();
+    return test_done("test_transmit");
+}
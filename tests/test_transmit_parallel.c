@@ -0,0 +1,106 @@
+/*
+ ==============================================
+ Name        : test_transmit_parallel.c
+ Author      :
+ Version     :
+ Description : Host test for transmit_parallel.c: every lane of the byte
+             : lane register must carry the bits transmit_step would send
+             : for that lane's message alone, for any number of lanes
+             : and bit lengths.
+ ==============================================
+ */
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "compress.c"
+#include "fec.c"
+#include "linecode.c"
+#include "pam4.c"
+#include "receive.c"
+#include "transmit.c"
+#include "transmit_parallel.c"
+
+#define NUM_TRIALS 200
+#define MAX_BITS   (TRANSMIT_PARALLEL_TICKS)
+
+// The bits transmit_step sends for text, one per tick; returns how many
+static int reference_bits(const char *text, char *bits){
+    static transmit_state tx;
+    volatile uint32_t pin = 0;
+    int n = 0;
+
+    transmit_init(&tx, &pin, 1, 1);
+    transmit_queue(&tx, text);
+    while (transmit_busy(&tx)){
+        transmit_step(&tx);
+        bits[n++] = pin & 1;
+    }
+    return n;
+}
+
+static void test_lanes(void){
+    static transmit_parallel_state par;
+    static char texts[TRANSMIT_LANES][64];
+    static char bits[TRANSMIT_LANES][MAX_BITS];
+    const char *lanes[TRANSMIT_LANES];
+    int num_bits[TRANSMIT_LANES];
+    volatile uint8_t lane_register = 0;
+    int failed = 0;
+
+    for (int trial = 0; trial < NUM_TRIALS; trial++){
+        int num_lanes = 1 + trial % TRANSMIT_LANES;
+        int ticks_per_bit = 1 + trial % 3;
+
+        for (int k = 0; k < TRANSMIT_LANES; k++){
+            num_bits[k] = 0;
+            if (k >= num_lanes) continue;
+            int len = test_rand() % 60;
+            for (int i = 0; i < len; i++) texts[k][i] = ' ' + test_rand() % 95;
+            texts[k][len] = '\0';
+            lanes[k] = texts[k];
+            num_bits[k] = reference_bits(texts[k], bits[k]);
+        }
+
+        transmit_parallel_init(&par, &lane_register, ticks_per_bit);
+        CHECK(transmit_parallel_queue(&par, lanes, num_lanes) == 0);
+        int ticks = 0;
+        while (transmit_parallel_busy(&par) || par.tick != 0){
+            transmit_parallel_step(&par);
+            int bit = ticks++ / ticks_per_bit;
+            for (int k = 0; k < TRANSMIT_LANES; k++){
+                int want = bit < num_bits[k] ? bits[k][bit] : 0;
+                if (((lane_register >> k) & 1) != want) failed++;
+            }
+        }
+        CHECK(ticks == par.queue[0].num_ticks * ticks_per_bit);
+        CHECK(par.num_frames_sent == 1);
+    }
+    CHECK(failed == 0);
+}
+
+static void test_queue(void){
+    transmit_parallel_state par;
+    volatile uint8_t lane_register = 0;
+    const char *texts[TRANSMIT_LANES + 1] = {"a", "b"};
+    const char *too_long[1];
+    char text[TRANSMIT_LINE_BUFFER_LEN + 1];
+
+    transmit_parallel_init(&par, &lane_register, 1);
+    CHECK(transmit_parallel_queue(&par, texts, TRANSMIT_LANES + 1) == -1);
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    too_long[0] = text;
+    CHECK(transmit_parallel_queue(&par, too_long, 1) == -1);
+
+    for (int i = 0; i < TRANSMIT_PARALLEL_QUEUE_LEN - 1; i++){
+        CHECK(transmit_parallel_queue(&par, texts, 2) == 0);
+    }
+    CHECK(transmit_parallel_queue_full(&par));
+    CHECK(transmit_parallel_queue(&par, texts, 2) == -1);
+}
+
+int main(void){
+    test_lanes();
+    test_queue();
+    return test_done("test_transmit_parallel");
+}
@@ -0,0 +1,141 @@
+/*
+ ==============================================
+ Name        : test_transmit_ssp.c
+ Author      :
+ Version     :
+ Description : Host test for transmit_ssp.c: the bits written to the SSP
+             : FIFO must be the bits transmit_step would send, frame
+             : after frame, and the SSP is set up with the dividers
+             : ssp_plan_rate chose, never faster than requested.
+ ==============================================
+ */
+
+#include "LPC17xx.h"
+#include "test.h"
+#include "clock_util.c"
+#include "peripheral_clock.c"
+#include "compress.c"
+#include "fec.c"
+#include "linecode.c"
+#include "pam4.c"
+#include "receive.c"
+#include "transmit.c"
+
+#define MAX_FIFO_WRITES 4096
+
+// Records every FIFO write; the FIFO has room until fifo_limit writes
+typedef struct {
+    uint32_t CR0, CR1, CPSR, IMSC;
+    uint32_t written[MAX_FIFO_WRITES];
+    int num_written;
+    int fifo_limit;
+    uint32_t status[2];     // SR while full, SR while not full
+} ssp_model;
+
+// transmit_ssp.c names its SSP pointer ssp
+#define LPC_SSP_TypeDef ssp_model
+#define DR written[ssp->num_written++]
+#define SR status[ssp->num_written < ssp->fifo_limit]
+
+#include "transmit_ssp.c"
+
+#undef DR
+#undef SR
+
+static const char *messages[] = {
+    "Hello world!", "A", "telemetry T=21.5 H=40%",
+    "0123456789abcdefghijklmnopqrstuvwxyz"
+};
+#define NUM_MESSAGES 4
+
+static void test_halfword(void){
+    CHECK(transmit_ssp_halfword(0x0001) == 0x8000);
+    CHECK(transmit_ssp_halfword(0x8000) == 0x0001);
+    CHECK(transmit_ssp_halfword(0x12345) == 0xA2C4);
+    for (int i = 0; i < 100; i++){
+        uint32_t w = test_rand() & 0xFFFF;
+        CHECK(transmit_ssp_halfword(transmit_ssp_halfword(w)) == w);
+    }
+}
+
+/*
+ * Queues all messages, refilling the queue as slots free up, and drains
+ * the FIFO one interrupt's worth at a time. Each message's bits must
+ * match transmit_step's, padded with zeros to a whole SSP frame.
+ */
+static void test_bitstream(void){
+    static transmit_state ref, tx;
+    static ssp_model ssp;
+    static char bits[NUM_MESSAGES][2048];
+    int num_bits[NUM_MESSAGES];
+    volatile uint32_t pin = 0;
+    int queued = 0, pos = 0, mismatches = 0;
+
+    transmit_init(&ref, &pin, 1, 1);
+    for (int m = 0; m < NUM_MESSAGES; m++){
+        transmit_queue(&ref, messages[m]);
+        for (num_bits[m] = 0; transmit_busy(&ref); num_bits[m]++){
+            transmit_step(&ref);
+            bits[m][num_bits[m]] = pin & 1;
+        }
+    }
+
+    ssp.status[1] = TRANSMIT_SSP_SR_TNF;
+    transmit_init(&tx, &pin, 1, 1);
+    int more = 1;
+    while (more || queued < NUM_MESSAGES){
+        while (queued < NUM_MESSAGES && transmit_queue(&tx, messages[queued]) == 0){
+            queued++;
+        }
+        ssp.fifo_limit = ssp.num_written + TRANSMIT_SSP_FIFO_LEN;
+        more = transmit_ssp_fill(&tx, &ssp);
+    }
+    CHECK(tx.num_frames_sent == NUM_MESSAGES);
+
+    for (int m = 0; m < NUM_MESSAGES; m++){
+        int padded = (num_bits[m] + 15) / 16 * 16;
+        for (int i = 0; i < padded; i++, pos++){
+            int bit = (ssp.written[pos / 16] >> (15 - pos % 16)) & 1;
+            if (bit != (i < num_bits[m] ? bits[m][i] : 0)) mismatches++;
+        }
+    }
+    CHECK(mismatches == 0);
+    CHECK(pos == ssp.num_written * 16);
+}
+
+// The planned rate is exact for its dividers, and loaded as planned
+static void test_rate(void){
+    const int cclks[] = {100000000, 120000000, 25000000};
+    const uint32_t rates[] = {50000000, 4000000, 1000000, 9600, 2400};
+    static ssp_model ssp;
+    ssp_plan plan;
+
+    for (int p = 0; p < 3; p++){
+        clock_settings clock = {.frequency = cclks[p]};
+        for (int i = 0; i < 5; i++){
+            CHECK(ssp_plan_rate(&clock, 1, rates[i], &plan) == 0);
+            CHECK(plan.rate == (uint32_t) cclks[p] /
+                (plan.cpsdvsr * (plan.scr + 1)));
+            CHECK(plan.rate <= rates[i]);
+
+            transmit_ssp_init(&ssp, &plan);
+            CHECK(ssp.CPSR == plan.cpsdvsr && ssp.CR1 == 1 << 1);
+            CHECK(ssp.CR0 == (15 | 1 << 7 | plan.scr << 8));
+        }
+    }
+    clock_settings clock = {.frequency = 120000000};
+    CHECK(ssp_plan_rate(&clock, 1, 4000000, &plan) == 0);
+    CHECK(plan.rate == 4000000);
+
+    // Too slow for the largest dividers, or zero
+    clock.frequency = 100000000;
+    CHECK(ssp_plan_rate(&clock, 1, 1200, &plan) == -1);
+    CHECK(ssp_plan_rate(&clock, 1, 0, &plan) == -1);
+}
+
+int main(void){
+    test_halfword();
+    test_bitstream();
+    test_rate();
+    return test_done("test_transmit_ssp");
+}
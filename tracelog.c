@@ -0,0 +1,139 @@
+/*
+ ==============================================
+ Name        : tracelog.c
+ Author      :
+ Version     :
+ Description : Deferred binary trace log. Interrupt handlers push small
+             : fixed-size records into a RAM ring without locking, and
+             : the main loop pops and prints them later, so tracing costs
+             : the ISR a few stores instead of a semihosted printf. Also
+             : measures ISR duration with the Cortex-M3 DWT cycle counter.
+ ==============================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "clock_util.h" // DWT cycle counter
+
+// Records held before new ones are dropped, a power of two
+#ifndef TRACE_LOG_LEN
+#define TRACE_LOG_LEN 256
+#endif
+
+// Record timestamp; override to trace on a host
+#ifndef TRACE_TIMESTAMP
+#define TRACE_TIMESTAMP() CLOCK_DWT_CYCCNT
+#endif
+
+// Trace events
+#define TRACE_TX_SYMBOL  1  // arg0 = symbol, arg1 = symbols left in frame
+#define TRACE_TX_FRAME   2  // arg0 = queue slot, arg1 = frames sent
+
+typedef struct {
+    uint32_t time;          // Cycle count when the record was pushed
+    uint16_t event;
+    uint16_t arg0;
+    uint32_t arg1;
+} trace_record;
+
+// Single producer (ISR), single consumer (main loop) ring
+typedef struct {
+    trace_record records[TRACE_LOG_LEN];
+    volatile uint32_t head;  // Records pushed, written by the ISR only
+    volatile uint32_t tail;  // Records popped, written by the main loop only
+    volatile uint32_t num_dropped;
+} trace_log;
+
+// ISR duration statistics, in CPU cycles
+typedef struct {
+    uint32_t start;
+    uint32_t min;
+    uint32_t max;
+    uint32_t total;
+    uint32_t count;
+} trace_timing;
+
+trace_log global_trace;
+
+// Clears the log and starts the DWT cycle counter
+void trace_init(trace_log *log){
+    memset(log, 0, sizeof(trace_log));
+#ifdef CLOCK_DEMCR
+    CLOCK_DEMCR    |= 1 << 24;  // TRCENA
+    CLOCK_DWT_CTRL |= 1;        // CYCCNTENA
+#endif
+}
+
+/*
+ * Appends a record. Safe to call from one interrupt handler while the
+ * main loop pops. If the ring is full the record is counted and dropped.
+ */
+void trace_push(trace_log *log, int event, int arg0, uint32_t arg1){
+    uint32_t head = log->head;
+    trace_record *rec;
+
+    if (head - log->tail >= TRACE_LOG_LEN){
+        log->num_dropped++;
+        return;
+    }
+    rec = &log->records[head % TRACE_LOG_LEN];
+    rec->time  = TRACE_TIMESTAMP();
+    rec->event = (uint16_t) event;
+    rec->arg0  = (uint16_t) arg0;
+    rec->arg1  = arg1;
+    log->head  = head + 1;
+}
+
+// Removes the oldest record into rec. Returns 0 if the log was empty.
+int trace_pop(trace_log *log, trace_record *rec){
+    uint32_t tail = log->tail;
+
+    if (tail == log->head) return 0;
+    *rec = log->records[tail % TRACE_LOG_LEN];
+    log->tail = tail + 1;
+    return 1;
+}
+
+void trace_print(const trace_record *rec){
+    switch(rec->event){
+        case TRACE_TX_SYMBOL:
+            printf("%lu tx %d %lu, ", (unsigned long) rec->time,
+                rec->arg0, (unsigned long) rec->arg1);
+            break;
+        case TRACE_TX_FRAME:
+            printf("%lu frame %d %lu\n", (unsigned long) rec->time,
+                rec->arg0, (unsigned long) rec->arg1);
+            break;
+        default:
+            printf("%lu event %d %d %lu\n", (unsigned long) rec->time,
+                rec->event, rec->arg0, (unsigned long) rec->arg1);
+            break;
+    }
+}
+
+// Prints every pending record; call from the main loop
+void trace_flush(trace_log *log){
+    trace_record rec;
+    while (trace_pop(log, &rec)){
+        trace_print(&rec);
+    }
+}
+
+void trace_timing_init(trace_timing *t){
+    memset(t, 0, sizeof(trace_timing));
+    t->min = 0xFFFFFFFF;
+}
+
+// Marks the start of an ISR
+void trace_timing_begin(trace_timing *t){
+    t->start = CLOCK_DWT_CYCCNT;
+}
+
+// Marks the end of an ISR and folds its duration into the statistics
+void trace_timing_end(trace_timing *t){
+    uint32_t cycles = CLOCK_DWT_CYCCNT - t->start;
+    if (cycles < t->min) t->min = cycles;
+    if (cycles > t->max) t->max = cycles;
+    t->total += cycles;
+    t->count++;
+}
@@ -0,0 +1,261 @@
+/*
+ ==============================================
+ Name        : transmit.c
+ Author      :
+ Version     :
+ Description : Sends frames over the light link: four alternating clock
+             : bit pairs, the 0000 1111 frame flag, the PAM-4 training
+             : levels when enabled, then the encoded payload. Messages
+             : are encoded into packed frames in the main loop and queued;
+             : the timer ISR only shifts the next symbol out of a word.
+             : Driven one timer tick at a time, so a board can share one
+             : oversampling timer between a transmitter and a receiver.
+ ==============================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+// Set to 1 to log every symbol sent to global_trace (needs tracelog.c)
+#ifndef TRANSMIT_TRACE
+#define TRANSMIT_TRACE 0
+#endif
+
+// Encoding buffer lengths
+#define TRANSMIT_BUFFER_LEN      128
+#define TRANSMIT_LINE_BUFFER_LEN (TRANSMIT_BUFFER_LEN * 5 / 4)
+
+// Frames that can wait to be sent, a power of two
+#define TRANSMIT_QUEUE_LEN 4
+
+// Bits per symbol on the wire: levels 0-3 in PAM-4 mode, else on/off
+#if PAM4_ENABLED
+#define TRANSMIT_SYMBOL_BITS 2
+#else
+#define TRANSMIT_SYMBOL_BITS 1
+#endif
+#define TRANSMIT_SYMBOL_MASK ((1 << TRANSMIT_SYMBOL_BITS) - 1)
+
+// Preamble, flag, PAM-4 training, payload, and one closing low symbol
+#define TRANSMIT_MAX_SYMBOLS (16 + PAM4_TRAINING_SYMBOLS + \
+                              TRANSMIT_LINE_BUFFER_LEN * 8 + 1)
+#define TRANSMIT_FRAME_WORDS \
+    ((TRANSMIT_MAX_SYMBOLS * TRANSMIT_SYMBOL_BITS + 31) / 32)
+
+// A fully encoded frame, symbols packed least significant bits first
+typedef struct {
+    uint32_t words[TRANSMIT_FRAME_WORDS];
+    int num_symbols;
+} transmit_frame;
+
+// Transmit state definition
+typedef struct {
+
+    transmit_frame queue[TRANSMIT_QUEUE_LEN];
+    volatile int head;          // Next slot to fill, owned by the main loop
+    volatile int tail;          // Slot being sent, owned by the ISR
+
+    // Position within the frame being sent
+    const uint32_t *next_word;
+    uint32_t word;              // Symbols of the current word not yet sent
+    int word_symbols;
+    volatile int symbols_left;
+    int tick;                   // Ticks already spent on the current bit
+    int ticks_per_bit;
+    int num_frames_sent;
+
+    volatile uint32_t *output;  // LED GPIO register, or DACR in PAM-4 mode
+    int output_mask;            // Mask to use when writing the GPIO register
+
+} transmit_state;
+
+// Payload as it goes through the coding stages
+char transmit_compress_buffer[TRANSMIT_BUFFER_LEN];
+char transmit_fec_buffer[TRANSMIT_BUFFER_LEN];
+char transmit_line_buffer[TRANSMIT_LINE_BUFFER_LEN];
+
+// Function to initialize a transmit state - idle with an empty queue
+void transmit_init(transmit_state *state, volatile uint32_t *output, int mask,
+        int ticks_per_bit){
+
+    state->head = 0;
+    state->tail = 0;
+
+    state->next_word    = NULL;
+    state->word         = 0;
+    state->word_symbols = 0;
+    state->symbols_left = 0;
+    state->tick         = 0;
+    state->ticks_per_bit   = ticks_per_bit;
+    state->num_frames_sent = 0;
+
+    state->output      = output;
+    state->output_mask = mask;
+}
+
+/*
+ * Drives the output to one symbol: on/off, a PAM-4 level, or the PWM
+ * carrier gated on/off.
+ */
+void transmit_set_symbol(transmit_state *state, int symbol){
+#if PAM4_ENABLED
+    *state->output = pam4_dac_value(symbol);
+#elif PWM_CARRIER_ENABLED
+    (void) state;
+    pwm_carrier_set(&global_pwm_carrier, symbol);
+#else
+    if (symbol){
+        *state->output |= state->output_mask;
+    } else {
+        *state->output &= ~state->output_mask;
+    }
+#endif
+}
+
+/*
+ * Sets the output to on or off.
+ */
+void transmit_set_bit(transmit_state *state, int bit){
+    transmit_set_symbol(state, bit ? TRANSMIT_SYMBOL_MASK : 0);
+}
+
+// Appends one symbol to a frame being encoded
+void transmit_frame_append(transmit_frame *frame, int symbol){
+    int pos = frame->num_symbols * TRANSMIT_SYMBOL_BITS;
+
+    if (pos % 32 == 0) frame->words[pos/32] = 0;
+    frame->words[pos/32] |= ((uint32_t) symbol) << (pos%32);
+    frame->num_symbols++;
+}
+
+/*
+ * Runs text and its null terminator through the enabled coding stages,
+ * then packs the whole frame - preamble, flag, training levels and
+ * payload - into frame. Returns -1 if the message does not fit.
+ */
+int transmit_frame_encode(transmit_frame *frame, const char *text){
+    char *payload = (char *) text;
+    int payload_len = strlen(text) + 1;
+    int num_bits, i;
+
+#if COMPRESS_ENABLED
+    payload_len = compress_encode(payload, payload_len,
+        transmit_compress_buffer, TRANSMIT_BUFFER_LEN);
+    if (payload_len < 0) return -1;
+    payload = transmit_compress_buffer;
+#endif
+
+#if FEC_ENABLED
+    payload_len = fec_encode(payload, payload_len,
+        transmit_fec_buffer, TRANSMIT_BUFFER_LEN);
+    if (payload_len < 0) return -1;
+    payload = transmit_fec_buffer;
+#endif
+
+#if LINE_CODE_ENABLED
+    // The frame flag ends high, so NRZI starts from level 1
+    num_bits = linecode_encode(payload, payload_len,
+        transmit_line_buffer, TRANSMIT_LINE_BUFFER_LEN, 1);
+    if (num_bits < 0) return -1;
+    payload = transmit_line_buffer;
+#else
+    num_bits = payload_len * 8;
+    if (num_bits > TRANSMIT_LINE_BUFFER_LEN * 8) return -1;
+#endif
+
+    frame->num_symbols = 0;
+
+    // Four alternating clock bit pairs, then the 0000 1111 frame flag
+    for (i = 0; i < 8; i++){
+        transmit_frame_append(frame, (i%2) ? 0 : TRANSMIT_SYMBOL_MASK);
+    }
+    for (i = 0; i < 8; i++){
+        transmit_frame_append(frame, (i >= 4) ? TRANSMIT_SYMBOL_MASK : 0);
+    }
+
+#if PAM4_ENABLED
+    for (i = 0; i < PAM4_TRAINING_SYMBOLS; i++){
+        transmit_frame_append(frame, pam4_training_level(i));
+    }
+    for (i = 0; i < num_bits; i += 2){
+        transmit_frame_append(frame, pam4_map_symbol(payload, i, num_bits));
+    }
+#else
+    for (i = 0; i < num_bits; i++){
+        transmit_frame_append(frame, (payload[i/8] >> (i%8)) & 1);
+    }
+#endif
+
+    // Return the line to idle
+    transmit_frame_append(frame, 0);
+    return 0;
+}
+
+int transmit_queue_full(transmit_state *state){
+    return ((state->head + 1) % TRANSMIT_QUEUE_LEN) == state->tail;
+}
+
+/*
+ * Encodes text as a frame and queues it behind any frames already
+ * waiting; queued frames go out back to back. Returns -1 if the queue
+ * is full or the message does not fit. Call from the main loop only.
+ */
+int transmit_queue(transmit_state *state, const char *text){
+    if (transmit_queue_full(state)) return -1;
+    if (transmit_frame_encode(&state->queue[state->head], text)) return -1;
+
+    // The frame must be in memory before the ISR can see it
+    __DMB();
+    state->head = (state->head + 1) % TRANSMIT_QUEUE_LEN;
+    return 0;
+}
+
+int transmit_busy(transmit_state *state){
+    return state->symbols_left > 0 || state->head != state->tail;
+}
+
+// Function to drive the transmit functionality, once per timer tick
+void transmit_step(transmit_state *state){
+
+    // Start the next queued frame once the last symbol has had its bit
+    if (state->symbols_left == 0){
+        if (state->tick != 0){
+            if (++state->tick >= state->ticks_per_bit) state->tick = 0;
+            return;
+        }
+        if (state->head == state->tail) return;
+        state->next_word    = state->queue[state->tail].words;
+        state->word_symbols = 0;
+        state->symbols_left = state->queue[state->tail].num_symbols;
+    }
+
+    // Only change the output on the first tick of each bit
+    int first_tick = (state->tick == 0);
+    if (++state->tick >= state->ticks_per_bit){
+        state->tick = 0;
+    }
+    if (!first_tick) return;
+
+    if (state->word_symbols == 0){
+        state->word = *state->next_word++;
+        state->word_symbols = 32 / TRANSMIT_SYMBOL_BITS;
+    }
+    int symbol = state->word & TRANSMIT_SYMBOL_MASK;
+    state->word >>= TRANSMIT_SYMBOL_BITS;
+    state->word_symbols--;
+
+    transmit_set_symbol(state, symbol);
+#if TRANSMIT_TRACE
+    trace_push(&global_trace, TRACE_TX_SYMBOL, symbol, state->symbols_left);
+#endif
+
+    // Release the slot once its last symbol is out
+    if (--state->symbols_left == 0){
+#if TRANSMIT_TRACE
+        trace_push(&global_trace, TRACE_TX_FRAME, state->tail,
+            state->num_frames_sent + 1);
+#endif
+        state->tail = (state->tail + 1) % TRANSMIT_QUEUE_LEN;
+        state->num_frames_sent++;
+    }
+}
@@ -0,0 +1,154 @@
+/*
+ ==============================================
+ Name        : transmit_dma.c
+ Author      :
+ Version     :
+ Description : GPDMA backend for the light transmitter. Queued frames are
+             : rendered into blocks of GPIO set and clear words, and two
+             : DMA channels paced by a timer match write them to FIOSET
+             : and FIOCLR once per bit. The blocks form a ring of linked
+             : list descriptors that streams forever; the CPU only
+             : renders a block after the DMA has finished playing it.
+             : On/off keying only.
+ ==============================================
+ */
+
+// Bits per block and blocks in the ring
+#define TRANSMIT_DMA_BLOCK_LEN 64
+#define TRANSMIT_DMA_BLOCKS    2
+
+// GPDMA channel control: 32-bit source and destination, source increment,
+// terminal count interrupt
+#define TRANSMIT_DMA_CONTROL ((2 << 18) | (2 << 21) | (1 << 26))
+#define TRANSMIT_DMA_CONTROL_TC (1 << 31)
+
+// GPDMA channel config: enable, memory to peripheral, terminal count
+// interrupt unmasked
+#define TRANSMIT_DMA_CONFIG(request) (1 | ((request) << 6) | (1 << 11) | (1 << 15))
+
+// GPDMA linked list item, as the controller reads it
+typedef struct {
+    uint32_t src;
+    uint32_t dst;
+    uint32_t next;
+    uint32_t control;
+} transmit_dma_lli;
+
+typedef struct {
+    uint32_t set[TRANSMIT_DMA_BLOCKS][TRANSMIT_DMA_BLOCK_LEN];
+    uint32_t clr[TRANSMIT_DMA_BLOCKS][TRANSMIT_DMA_BLOCK_LEN];
+    transmit_dma_lli set_lli[TRANSMIT_DMA_BLOCKS];
+    transmit_dma_lli clr_lli[TRANSMIT_DMA_BLOCKS];
+    int next_block;             // Oldest block, the next one to re-render
+    int num_blocks_rendered;
+} transmit_dma_state;
+
+/*
+ * Renders the next len bits of the transmit queue into set and clr:
+ * each bit becomes a pair of words holding the LED mask in the set word
+ * for a 1 or in the clear word for a 0. Follows the queue with the same
+ * fields as transmit_step and pads with idle zeros when it is empty.
+ * Returns the number of frame bits rendered.
+ */
+int transmit_dma_render(transmit_state *state, uint32_t *set, uint32_t *clr,
+        int len){
+    uint32_t mask = state->output_mask;
+    int i, num_bits = 0;
+
+    for (i = 0; i < len; i++){
+        int bit = 0;
+
+        // Start the next queued frame
+        if (state->symbols_left == 0 && state->head != state->tail){
+            state->next_word    = state->queue[state->tail].words;
+            state->word_symbols = 0;
+            state->symbols_left = state->queue[state->tail].num_symbols;
+        }
+
+        if (state->symbols_left > 0){
+            if (state->word_symbols == 0){
+                state->word = *state->next_word++;
+                state->word_symbols = 32;
+            }
+            bit = state->word & 1;
+            state->word >>= 1;
+            state->word_symbols--;
+            num_bits++;
+
+            // Release the slot once its last bit is rendered
+            if (--state->symbols_left == 0){
+                state->tail = (state->tail + 1) % TRANSMIT_QUEUE_LEN;
+                state->num_frames_sent++;
+            }
+        }
+
+        set[i] = bit ? mask : 0;
+        clr[i] = bit ? 0 : mask;
+    }
+    return num_bits;
+}
+
+/*
+ * Links the blocks into two descriptor rings, one writing set words to
+ * fioset and one writing clear words to fioclr, and renders every block.
+ * Only the clear channel raises the block interrupt: it runs after the
+ * set channel on the shared request, so when it finishes a block both
+ * channels are done with it.
+ */
+void transmit_dma_init(transmit_dma_state *dma, transmit_state *state,
+        volatile uint32_t *fioset, volatile uint32_t *fioclr){
+    int b;
+
+    for (b = 0; b < TRANSMIT_DMA_BLOCKS; b++){
+        int next = (b + 1) % TRANSMIT_DMA_BLOCKS;
+
+        dma->set_lli[b].src     = (uint32_t) dma->set[b];
+        dma->set_lli[b].dst     = (uint32_t) fioset;
+        dma->set_lli[b].next    = (uint32_t) &dma->set_lli[next];
+        dma->set_lli[b].control = TRANSMIT_DMA_CONTROL | TRANSMIT_DMA_BLOCK_LEN;
+
+        dma->clr_lli[b].src     = (uint32_t) dma->clr[b];
+        dma->clr_lli[b].dst     = (uint32_t) fioclr;
+        dma->clr_lli[b].next    = (uint32_t) &dma->clr_lli[next];
+        dma->clr_lli[b].control = TRANSMIT_DMA_CONTROL | TRANSMIT_DMA_CONTROL_TC |
+            TRANSMIT_DMA_BLOCK_LEN;
+
+        transmit_dma_render(state, dma->set[b], dma->clr[b], TRANSMIT_DMA_BLOCK_LEN);
+    }
+    dma->next_block = 0;
+    dma->num_blocks_rendered = TRANSMIT_DMA_BLOCKS;
+}
+
+// Loads a channel with the first item of a ring and enables it
+void transmit_dma_start_channel(LPC_GPDMACH_TypeDef *ch,
+        const transmit_dma_lli *lli, int request){
+    ch->DMACCConfig   = 0;
+    ch->DMACCSrcAddr  = lli->src;
+    ch->DMACCDestAddr = lli->dst;
+    ch->DMACCLLI      = lli->next;
+    ch->DMACCControl  = lli->control;
+    ch->DMACCConfig   = TRANSMIT_DMA_CONFIG(request);
+}
+
+/*
+ * Starts both rings. set_ch must have the higher priority (lower channel
+ * number) so it always runs first on each request.
+ */
+void transmit_dma_start(transmit_dma_state *dma, LPC_GPDMACH_TypeDef *set_ch,
+        LPC_GPDMACH_TypeDef *clr_ch, int set_request, int clr_request){
+    transmit_dma_start_channel(set_ch, &dma->set_lli[0], set_request);
+    transmit_dma_start_channel(clr_ch, &dma->clr_lli[0], clr_request);
+}
+
+/*
+ * Renders the block the DMA just finished with, which will next play
+ * after the rest of the ring. Call from the DMA interrupt on the clear
+ * channel's terminal count.
+ */
+void transmit_dma_refill(transmit_dma_state *dma, transmit_state *state){
+    int b = dma->next_block;
+
+    transmit_dma_render(state, dma->set[b], dma->clr[b], TRANSMIT_DMA_BLOCK_LEN);
+    dma->next_block = (b + 1) % TRANSMIT_DMA_BLOCKS;
+    dma->num_blocks_rendered++;
+}
@@ -0,0 +1,150 @@
+/*
+ ==============================================
+ Name        : transmit_parallel.c
+ Author      :
+ Version     :
+ Description : Parallel transmitter for up to eight LEDs on one GPIO byte
+             : lane. Each LED carries its own complete frame; the frames
+             : are encoded and transposed ahead of time into one byte per
+             : bit period, so the timer ISR sends eight bits with a single
+             : byte store. On/off keying only.
+ ==============================================
+ */
+
+#define TRANSMIT_LANES 8
+
+// Bit periods in a parallel frame, rounded up to whole transposed blocks
+#define TRANSMIT_PARALLEL_TICKS ((TRANSMIT_MAX_SYMBOLS + 7) / 8 * 8)
+
+// Parallel frames that can wait to be sent, a power of two
+#define TRANSMIT_PARALLEL_QUEUE_LEN 2
+
+// Up to eight frames sent side by side: bit k of each byte is lane k
+typedef struct {
+    unsigned char bytes[TRANSMIT_PARALLEL_TICKS];
+    int num_ticks;
+} transmit_parallel_frame;
+
+typedef struct {
+
+    transmit_parallel_frame queue[TRANSMIT_PARALLEL_QUEUE_LEN];
+    volatile int head;          // Next slot to fill, owned by the main loop
+    volatile int tail;          // Slot being sent, owned by the ISR
+
+    int pos;                    // Next byte of the frame being sent
+    volatile int ticks_left;
+    int tick;                   // Ticks already spent on the current bit
+    int ticks_per_bit;
+    int num_frames_sent;
+
+    volatile uint8_t *output;   // Byte lane register, e.g. FIO2PIN0
+
+} transmit_parallel_state;
+
+// Single lane frames before transposition
+transmit_frame transmit_lane_frames[TRANSMIT_LANES];
+
+void transmit_parallel_init(transmit_parallel_state *state,
+        volatile uint8_t *output, int ticks_per_bit){
+    state->head = 0;
+    state->tail = 0;
+    state->pos  = 0;
+    state->ticks_left      = 0;
+    state->tick            = 0;
+    state->ticks_per_bit   = ticks_per_bit;
+    state->num_frames_sent = 0;
+    state->output = output;
+}
+
+// Returns byte n of a lane frame, zero past its last symbol
+unsigned char transmit_lane_byte(const transmit_frame *frame, int n){
+    if (n * 8 >= frame->num_symbols) return 0;
+    return (unsigned char)(frame->words[n/4] >> ((n%4) * 8));
+}
+
+/*
+ * Encodes texts[k] for lane k, leaving lanes past num_texts idle, then
+ * transposes the lanes eight bit periods at a time: byte k of a block
+ * holds eight bits of lane k, and after fec_transpose byte t holds bit t
+ * of every lane. Returns -1 if a message does not fit.
+ */
+int transmit_parallel_encode(transmit_parallel_frame *frame,
+        const char **texts, int num_texts){
+    unsigned char block[8];
+    int k, n, num_symbols = 0;
+
+    if (num_texts > TRANSMIT_LANES) return -1;
+    for (k = 0; k < TRANSMIT_LANES; k++){
+        transmit_lane_frames[k].num_symbols = 0;
+        if (k < num_texts){
+            if (transmit_frame_encode(&transmit_lane_frames[k], texts[k])) return -1;
+        }
+        if (transmit_lane_frames[k].num_symbols > num_symbols){
+            num_symbols = transmit_lane_frames[k].num_symbols;
+        }
+    }
+
+    frame->num_ticks = (num_symbols + 7) / 8 * 8;
+    for (n = 0; n < frame->num_ticks / 8; n++){
+        for (k = 0; k < TRANSMIT_LANES; k++){
+            block[k] = transmit_lane_byte(&transmit_lane_frames[k], n);
+        }
+        fec_transpose(block);
+        memcpy(&frame->bytes[n * 8], block, 8);
+    }
+    return 0;
+}
+
+int transmit_parallel_queue_full(transmit_parallel_state *state){
+    return ((state->head + 1) % TRANSMIT_PARALLEL_QUEUE_LEN) == state->tail;
+}
+
+/*
+ * Encodes one message per lane and queues the result. Returns -1 if the
+ * queue is full or a message does not fit. Call from the main loop only.
+ */
+int transmit_parallel_queue(transmit_parallel_state *state,
+        const char **texts, int num_texts){
+    if (transmit_parallel_queue_full(state)) return -1;
+    if (transmit_parallel_encode(&state->queue[state->head], texts, num_texts))
+        return -1;
+
+    // The frame must be in memory before the ISR can see it
+    __DMB();
+    state->head = (state->head + 1) % TRANSMIT_PARALLEL_QUEUE_LEN;
+    return 0;
+}
+
+int transmit_parallel_busy(transmit_parallel_state *state){
+    return state->ticks_left > 0 || state->head != state->tail;
+}
+
+// Drives all lanes, once per timer tick
+void transmit_parallel_step(transmit_parallel_state *state){
+
+    // Start the next queued frame once the last symbol has had its bit
+    if (state->ticks_left == 0){
+        if (state->tick != 0){
+            if (++state->tick >= state->ticks_per_bit) state->tick = 0;
+            return;
+        }
+        if (state->head == state->tail) return;
+        state->pos        = 0;
+        state->ticks_left = state->queue[state->tail].num_ticks;
+    }
+
+    // Only change the outputs on the first tick of each bit
+    int first_tick = (state->tick == 0);
+    if (++state->tick >= state->ticks_per_bit){
+        state->tick = 0;
+    }
+    if (!first_tick) return;
+
+    *state->output = state->queue[state->tail].bytes[state->pos++];
+
+    // Release the slot once its last bit period is out
+    if (--state->ticks_left == 0){
+        state->tail = (state->tail + 1) % TRANSMIT_PARALLEL_QUEUE_LEN;
+        state->num_frames_sent++;
+    }
+}
@@ -0,0 +1,93 @@
+/*
+ ==============================================
+ Name        : transmit_ssp.c
+ Author      :
+ Version     :
+ Description : SSP backend for the light transmitter. Frames queued with
+             : transmit_queue are shifted out of an SSP MOSI pin 16 bits
+             : at a time, so every bit lasts exactly one SSP clock and
+             : the CPU only refills the FIFO every 128 bits. On/off
+             : keying only; PAM-4 needs the DAC. The bit rate comes
+             : from ssp_plan_rate in peripheral_clock.c.
+ ==============================================
+ */
+
+// SSP frame size, the largest the controller supports
+#define TRANSMIT_SSP_FRAME_BITS 16
+#define TRANSMIT_SSP_FIFO_LEN   8
+
+// SSP status and interrupt bits
+#define TRANSMIT_SSP_SR_TNF (1 << 1)  // Transmit FIFO not full
+#define TRANSMIT_SSP_SR_BSY (1 << 4)  // Still shifting a frame
+#define TRANSMIT_SSP_TXIM   (1 << 3)  // Transmit FIFO at least half empty
+
+/*
+ * Sets up ssp as a 16-bit SPI master at the planned bit rate. CPHA = 1
+ * keeps SSEL asserted between back to back frames, so MOSI carries a
+ * continuous bit stream with no gap between FIFO entries.
+ */
+void transmit_ssp_init(LPC_SSP_TypeDef *ssp, const ssp_plan *plan){
+    ssp->CR1  = 0;
+    ssp->CR0  = (TRANSMIT_SSP_FRAME_BITS - 1) | (1 << 7) | (plan->scr << 8);
+    ssp->CPSR = plan->cpsdvsr;
+    ssp->IMSC = 0;
+    ssp->CR1  = 1 << 1;     // Enable as master
+}
+
+/*
+ * Returns the next 16 symbols of a frame word as an SSP frame. Frames
+ * store symbols least significant bit first but the SSP shifts the most
+ * significant bit first, so the half word is reversed.
+ */
+uint32_t transmit_ssp_halfword(uint32_t word){
+    word &= 0xFFFF;
+    word = ((word & 0x5555) << 1) | ((word >> 1) & 0x5555);
+    word = ((word & 0x3333) << 2) | ((word >> 2) & 0x3333);
+    word = ((word & 0x0F0F) << 4) | ((word >> 4) & 0x0F0F);
+    word = ((word & 0x00FF) << 8) | ((word >> 8) & 0x00FF);
+    return word;
+}
+
+/*
+ * Moves queued frame bits into the SSP transmit FIFO until it is full
+ * or the queue is empty. Uses the transmit_state fields transmit_step
+ * would, counting 16-bit SSP frames instead of symbols; the last SSP
+ * frame of each message is padded with idle zeros. A queue slot is
+ * released as soon as its last bits are in the FIFO. Call from the SSP
+ * interrupt, or poll it from the main loop. Returns 1 while frames are
+ * still waiting for FIFO space, 0 once everything has been handed over.
+ */
+int transmit_ssp_fill(transmit_state *state, LPC_SSP_TypeDef *ssp){
+    while (ssp->SR & TRANSMIT_SSP_SR_TNF){
+
+        // Start the next queued frame
+        if (state->symbols_left == 0){
+            if (state->head == state->tail) return 0;
+            state->next_word    = state->queue[state->tail].words;
+            state->word_symbols = 0;
+            state->symbols_left = state->queue[state->tail].num_symbols;
+        }
+
+        if (state->word_symbols == 0){
+            state->word = *state->next_word++;
+            state->word_symbols = 32;
+        }
+        ssp->DR = transmit_ssp_halfword(state->word);
+        state->word >>= TRANSMIT_SSP_FRAME_BITS;
+        state->word_symbols -= TRANSMIT_SSP_FRAME_BITS;
+
+        if (state->symbols_left > TRANSMIT_SSP_FRAME_BITS){
+            state->symbols_left -= TRANSMIT_SSP_FRAME_BITS;
+        } else {
+            state->symbols_left = 0;
+            state->tail = (state->tail + 1) % TRANSMIT_QUEUE_LEN;
+            state->num_frames_sent++;
+        }
+    }
+    return 1;
+}
+
+// Whether bits are queued, waiting in the FIFO or still being shifted out
+int transmit_ssp_busy(transmit_state *state, LPC_SSP_TypeDef *ssp){
+    return transmit_busy(state) || (ssp->SR & TRANSMIT_SSP_SR_BSY);
+}